@@ -0,0 +1,192 @@
+// Asset manager check: loads small generated OBJ models through an
+// AssetManager with a tight byte budget, one update per frame as in the
+// demos, and checks that
+//   - a model larger than the whole budget still loads and stays resident
+//     while it is used every frame,
+//   - a working set larger than the budget stays resident, over budget,
+//     instead of being evicted and reloaded every frame,
+//   - models no longer used are evicted down to the budget and load again
+//     when used,
+//   - a texture that can't load is drawn with the fallback.
+// Exits non-zero when any of them fails.
+//
+//   asset_check
+#include "assets.h"
+#include "obj_loader.h"
+#include "types.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define MODEL_COUNT 3
+#define MODEL_GRID 48
+#define MISSING_PATH "asset_check_missing.png"
+// Frames to wait for a load, at a millisecond each, before giving up.
+#define LOAD_FRAMES 5000
+// Frames every model must stay ready for once loaded.
+#define HOLD_FRAMES 50
+
+static void model_path(char *out, size_t size, int index) {
+  snprintf(out, size, "asset_check_%d.obj", index);
+}
+
+static bool write_model(const char *path, int n) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    return false;
+  }
+  for (int y = 0; y <= n; y++) {
+    for (int x = 0; x <= n; x++) {
+      fprintf(f, "v %d 0 %d\nvt %.4f %.4f\n", x, y, (double)x / n,
+              (double)y / n);
+    }
+  }
+  for (int y = 0; y < n; y++) {
+    for (int x = 0; x < n; x++) {
+      int a = y * (n + 1) + x + 1, b = a + 1, c = a + n + 2, d = c - 1;
+      fprintf(f, "f %d/%d %d/%d %d/%d %d/%d\n", a, a, b, b, c, c, d, d);
+    }
+  }
+  return fclose(f) == 0;
+}
+
+// One frame that uses the handles; true when every model was ready.
+static bool frame(AssetManager *mgr, const AssetHandle *handles, int count) {
+  asset_manager_update(mgr);
+  bool ready = true;
+  for (int i = 0; i < count; i++) {
+    ready &= asset_model(mgr, handles[i]) != NULL;
+  }
+  return ready;
+}
+
+static bool wait_ready(AssetManager *mgr, const AssetHandle *handles,
+                       int count) {
+  for (int i = 0; i < LOAD_FRAMES; i++) {
+    if (frame(mgr, handles, count)) {
+      return true;
+    }
+    SDL_Delay(1);
+  }
+  return false;
+}
+
+// Frames, after the first load, in which a used model wasn't ready.
+static int missed_frames(AssetManager *mgr, const AssetHandle *handles,
+                         int count) {
+  int missed = 0;
+  for (int i = 0; i < HOLD_FRAMES; i++) {
+    missed += !frame(mgr, handles, count);
+    SDL_Delay(1);
+  }
+  return missed;
+}
+
+static bool report(const char *name, bool ok, const char *detail) {
+  printf("%-12s %s: %s\n", name, ok ? "ok  " : "FAIL", detail);
+  return ok;
+}
+
+// The bytes one model takes once resident, for the budgets.
+static size_t model_size(const char *path) {
+  AssetManager mgr;
+  if (!asset_manager_init(&mgr, 1, 0)) {
+    return 0;
+  }
+  AssetHandle handle = asset_request(&mgr, path, ASSET_MODEL);
+  size_t size = wait_ready(&mgr, &handle, 1) ? mgr.resident : 0;
+  asset_manager_destroy(&mgr);
+  return size;
+}
+
+static bool check_oversized(const char *path) {
+  AssetManager mgr;
+  if (!asset_manager_init(&mgr, 1, 1)) {
+    return false;
+  }
+  AssetHandle handle = asset_request(&mgr, path, ASSET_MODEL);
+  bool loaded = wait_ready(&mgr, &handle, 1);
+  int missed = loaded ? missed_frames(&mgr, &handle, 1) : HOLD_FRAMES;
+  char detail[128];
+  snprintf(detail, sizeof(detail),
+           "%zu bytes on a 1-byte budget, missing in %d of %d frames",
+           mgr.resident, missed, HOLD_FRAMES);
+  asset_manager_destroy(&mgr);
+  return report("oversized", loaded && missed == 0, detail);
+}
+
+static bool check_working_set(char paths[][64], size_t size) {
+  size_t budget = size * (MODEL_COUNT - 1);
+  AssetManager mgr;
+  if (!asset_manager_init(&mgr, MODEL_COUNT, budget)) {
+    return false;
+  }
+  AssetHandle handles[MODEL_COUNT];
+  for (int i = 0; i < MODEL_COUNT; i++) {
+    handles[i] = asset_request(&mgr, paths[i], ASSET_MODEL);
+  }
+  bool loaded = wait_ready(&mgr, handles, MODEL_COUNT);
+  int missed =
+      loaded ? missed_frames(&mgr, handles, MODEL_COUNT) : HOLD_FRAMES;
+  char detail[128];
+  snprintf(detail, sizeof(detail),
+           "%zu of %zu bytes resident, missing in %d of %d frames",
+           mgr.resident, budget, missed, HOLD_FRAMES);
+  bool ok = report("working set", loaded && missed == 0, detail);
+
+  // Only the last model from here on: the others are evicted to the budget
+  // and load again once used.
+  for (int i = 0; i < 3; i++) {
+    frame(&mgr, &handles[MODEL_COUNT - 1], 1);
+  }
+  bool evicted = asset_state(&mgr, handles[0]) == ASSET_UNLOADED &&
+                 mgr.resident <= budget;
+  snprintf(detail, sizeof(detail), "%zu of %zu bytes resident once idle",
+           mgr.resident, budget);
+  ok &= report("eviction", evicted, detail);
+  bool reloaded = wait_ready(&mgr, handles, 1);
+  ok &= report("reload", reloaded,
+               reloaded ? "evicted model ready again" : "never ready");
+  asset_manager_destroy(&mgr);
+  return ok;
+}
+
+static bool check_fallback(void) {
+  AssetManager mgr;
+  if (!asset_manager_init(&mgr, 1, 0)) {
+    return false;
+  }
+  AssetHandle handle = asset_request(&mgr, MISSING_PATH, ASSET_TEXTURE);
+  bool ok = asset_texture(&mgr, handle) == &mgr.fallback;
+  for (int i = 0; i < LOAD_FRAMES && asset_state(&mgr, handle) != ASSET_FAILED;
+       i++) {
+    SDL_Delay(1);
+  }
+  ok &= asset_state(&mgr, handle) == ASSET_FAILED &&
+        asset_texture(&mgr, handle) == &mgr.fallback;
+  asset_manager_destroy(&mgr);
+  return report("fallback", ok, "missing texture drawn as the checkerboard");
+}
+
+int main(void) {
+  char paths[MODEL_COUNT][64];
+  bool ok = true;
+  for (int i = 0; i < MODEL_COUNT; i++) {
+    model_path(paths[i], sizeof(paths[i]), i);
+    ok &= write_model(paths[i], MODEL_GRID);
+  }
+  size_t size = ok ? model_size(paths[0]) : 0;
+  if (size == 0) {
+    fprintf(stderr, "could not write or load %s\n", paths[0]);
+    ok = false;
+  } else {
+    ok &= check_oversized(paths[0]);
+    ok &= check_working_set(paths, size);
+    ok &= check_fallback();
+  }
+  for (int i = 0; i < MODEL_COUNT; i++) {
+    remove(paths[i]);
+  }
+  printf("%s\n", ok ? "all checks passed" : "CHECKS FAILED");
+  return ok ? 0 : 1;
+}
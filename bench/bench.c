@@ -0,0 +1,456 @@
+// Headless frame benchmark: renders scripted camera paths over the cube,
+// voxel terrain and OBJ scenes into offscreen buffers and prints ms/frame
+// percentiles, triangles/s and pixels/s, the per-stage breakdown and the
+// rasterizer counters as JSON on stdout. --trace PREFIX also writes the first
+// TRACE_FRAMES measured frames of each scene as Chrome trace-event JSON to
+// PREFIX_<scene>.json. --reuse-depth renders with S3DContext.reuse_depth.
+// --obj also takes a cooked .s3dm model; model_load_ms is its load time.
+//
+//   bench [--size WxH] [--frames N] [--threads N] [--obj PATH] [--trace PREFIX]
+//         [--reuse-depth]
+#include "cooked_model.h"
+#include "math.h"
+#include "mesh.h"
+#include "obj_loader.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "render.h"
+#include "span.h"
+#include "types.h"
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WARMUP_FRAMES 10
+#define TRACE_FRAMES 60
+#define TERRAIN_SIZE 128
+#define TERRAIN_HEIGHT 16
+#define TERRAIN_CHUNK 16
+#define TERRAIN_CHUNKS (TERRAIN_SIZE / TERRAIN_CHUNK)
+
+typedef struct {
+  int w;
+  int h;
+  int frames;
+  int threads;
+  const char *obj_path;
+  const char *trace_prefix;
+  bool reuse_depth;
+} BenchOptions;
+
+// One benchmark scene: meshes drawn every frame with a camera that follows
+// a fixed path, so runs are comparable between builds and machines.
+typedef struct {
+  const char *name;
+  Mesh *meshes;
+  int mesh_count;
+  S3DMaterial *materials;
+  mat4 model;
+  v3f center; // path parameters, in world space
+  float radius;
+  float height;
+  bool fly; // move along the circle looking ahead, else orbit the center
+} Scene;
+
+typedef struct {
+  double total_ms;
+  long long triangles;
+  double stage_ms[PROF_STAGE_COUNT];     // summed over the measured frames
+  double counters[PROF_COUNTER_COUNT]; // likewise
+  double frame_ms[];
+} SceneTimes;
+
+// JSON keys for the profiler counters, in ProfCounter order.
+static const char *counter_keys[PROF_COUNTER_COUNT] = {
+    "triangles_in",   "triangles_out",  "pixels_tested",
+    "pixels_written", "depth_rejected", "overdraw",
+};
+
+static double ms_since(Uint64 start) {
+  return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 /
+         (double)SDL_GetPerformanceFrequency();
+}
+
+static bool make_checker(Texture *tex) {
+  tex->w = 64;
+  tex->h = 64;
+  tex->wrap = TEXTURE_REPEAT;
+  tex->pixels = malloc((size_t)tex->w * (size_t)tex->h * sizeof(u32));
+  if (!tex->pixels) {
+    return false;
+  }
+  for (int y = 0; y < tex->h; y++) {
+    for (int x = 0; x < tex->w; x++) {
+      tex->pixels[y * tex->w + x] =
+          (((x >> 3) ^ (y >> 3)) & 1) ? 0xFFC0C0C0 : 0xFF404040;
+    }
+  }
+  return true;
+}
+
+// Asset textures when present, a checkerboard otherwise, so the bench still
+// runs from a bare checkout. Mipmapped like the demos' textures.
+static bool load_or_checker(Texture *tex, const char *path) {
+  if (texture_load(tex, path)) {
+    tex->wrap = TEXTURE_REPEAT;
+  } else if (!make_checker(tex)) {
+    return false;
+  }
+  return texture_build_mips(tex);
+}
+
+// Cooked models (.s3dm, from tools/cook.c) are mapped instead of parsed.
+static bool load_model(const char *path, ObjModel *model) {
+  size_t len = strlen(path);
+  if (len > 5 && strcmp(path + len - 5, ".s3dm") == 0) {
+    return cooked_model_load(path, model);
+  }
+  return obj_model_load(path, model);
+}
+
+static int heights[TERRAIN_SIZE][TERRAIN_SIZE];
+
+// Rolling heightfield of voxel columns, one mesh per 16x16 column chunk so
+// frustum culling has something to work with. Quads are unit faces sharing
+// corner positions within their chunk.
+static bool build_terrain_chunk(Mesh *mesh, int x0, int z0) {
+  static u32 ids[TERRAIN_CHUNK + 1][TERRAIN_HEIGHT + 1][TERRAIN_CHUNK + 1];
+  static const v2f uvs[4] = {{0, 1}, {1, 1}, {1, 0}, {0, 0}};
+  memset(ids, 0xFF, sizeof(ids));
+  for (int x = x0; x < x0 + TERRAIN_CHUNK; x++) {
+    for (int z = z0; z < z0 + TERRAIN_CHUNK; z++) {
+      int h = heights[x][z];
+      // Top face, then the sides facing each lower neighbour, as corners
+      // (dx, y, dz) wound counter-clockwise seen from outside.
+      int quads[1 + 4 * TERRAIN_HEIGHT][4][3];
+      int quad_count = 0;
+      int top[4][3] = {{0, h, 1}, {1, h, 1}, {1, h, 0}, {0, h, 0}};
+      memcpy(quads[quad_count++], top, sizeof(top));
+      // Per side: neighbour offset (dx, dz), then the (x, z) of the bottom
+      // corners running left to right as seen from outside.
+      static const int sides[4][6] = {{1, 0, 1, 1, 1, 0},
+                                      {-1, 0, 0, 0, 0, 1},
+                                      {0, 1, 0, 1, 1, 1},
+                                      {0, -1, 1, 0, 0, 0}};
+      for (int s = 0; s < 4; s++) {
+        const int *side = sides[s];
+        int nx = x + side[0];
+        int nz = z + side[1];
+        int nh = (nx < 0 || nz < 0 || nx >= TERRAIN_SIZE || nz >= TERRAIN_SIZE)
+                     ? 0
+                     : heights[nx][nz];
+        for (int y = nh; y < h; y++) {
+          int face[4][3] = {{side[2], y, side[3]},
+                            {side[4], y, side[5]},
+                            {side[4], y + 1, side[5]},
+                            {side[2], y + 1, side[3]}};
+          memcpy(quads[quad_count++], face, sizeof(face));
+        }
+      }
+
+      for (int q = 0; q < quad_count; q++) {
+        u32 first = (u32)mesh->vertex_count;
+        for (int i = 0; i < 4; i++) {
+          int cx = x - x0 + quads[q][i][0];
+          int cy = quads[q][i][1];
+          int cz = z - z0 + quads[q][i][2];
+          u32 *id = &ids[cx][cy][cz];
+          if (*id == UINT32_MAX) {
+            v3f p = {(float)(x0 + cx), (float)cy, (float)(z0 + cz)};
+            if (!mesh_add_position(mesh, p)) {
+              return false;
+            }
+            *id = (u32)(mesh->position_count - 1);
+          }
+          if (!mesh_add_vertex(mesh, *id, uvs[i])) {
+            return false;
+          }
+        }
+        if (!mesh_add_triangle(mesh, first, first + 1, first + 2, 0) ||
+            !mesh_add_triangle(mesh, first, first + 2, first + 3, 0)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static bool build_terrain(Mesh *meshes) {
+  for (int x = 0; x < TERRAIN_SIZE; x++) {
+    for (int z = 0; z < TERRAIN_SIZE; z++) {
+      float n = sinf((float)x * 0.11f) + cosf((float)z * 0.07f) +
+                0.5f * sinf((float)(x + z) * 0.23f);
+      heights[x][z] = 1 + (int)((n + 2.5f) * (TERRAIN_HEIGHT - 2) / 5.0f);
+    }
+  }
+  for (int cx = 0; cx < TERRAIN_CHUNKS; cx++) {
+    for (int cz = 0; cz < TERRAIN_CHUNKS; cz++) {
+      if (!build_terrain_chunk(&meshes[cx * TERRAIN_CHUNKS + cz],
+                               cx * TERRAIN_CHUNK, cz * TERRAIN_CHUNK)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static mat4 camera_at(const Scene *scene, int frame, int frames, float aspect) {
+  float t = (float)frame / (float)frames * 6.2831853f;
+  v3f eye = {scene->center.x + cosf(t) * scene->radius,
+             scene->center.y + scene->height,
+             scene->center.z + sinf(t) * scene->radius};
+  v3f target = scene->center;
+  if (scene->fly) {
+    // Look a quarter turn ahead along the circle, slightly down.
+    float ahead = t + 0.8f;
+    target = (v3f){scene->center.x + cosf(ahead) * scene->radius,
+                   scene->center.y + scene->height * 0.5f,
+                   scene->center.z + sinf(ahead) * scene->radius};
+  }
+  mat4 view = mat4_look_at(eye, target, (v3f){0.0f, 1.0f, 0.0f});
+  mat4 proj = mat4_perspective(1.0471976f, aspect, 0.1f, 300.0f);
+  return mat4_mul(proj, mat4_mul(view, scene->model));
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(const double *sorted, int count, double p) {
+  int rank = (int)ceil(p / 100.0 * count);
+  if (rank < 1)
+    rank = 1;
+  if (rank > count)
+    rank = count;
+  return sorted[rank - 1];
+}
+
+static SceneTimes *run_scene(S3DContext *s3d, Profiler *prof,
+                             const Scene *scene, const BenchOptions *opt,
+                             u32 *color, float *depth) {
+  SceneTimes *times =
+      calloc(1, sizeof(SceneTimes) + (size_t)opt->frames * sizeof(double));
+  if (!times) {
+    return NULL;
+  }
+  float aspect = (float)opt->w / (float)opt->h;
+  for (int f = -WARMUP_FRAMES; f < opt->frames; f++) {
+    int frame = f < 0 ? 0 : f;
+    if (f == 0 && opt->trace_prefix) {
+      char path[512];
+      snprintf(path, sizeof(path), "%s_%s.json", opt->trace_prefix,
+               scene->name);
+      int frames = opt->frames < TRACE_FRAMES ? opt->frames : TRACE_FRAMES;
+      profiler_start_trace(prof, path, frames);
+    }
+    profiler_begin_frame(prof);
+    Uint64 start = SDL_GetPerformanceCounter();
+    s3d_begin(s3d, color, depth, opt->w, opt->h);
+    s3d_clear(s3d, 0);
+    for (int i = 0; i < scene->mesh_count; i++) {
+      s3d_draw_mesh(s3d, &scene->meshes[i],
+                    camera_at(scene, frame, opt->frames, aspect),
+                    scene->materials);
+    }
+    s3d_end(s3d);
+    double ms = ms_since(start);
+    profiler_end_frame(prof);
+    if (f >= 0) {
+      times->frame_ms[f] = ms;
+      times->total_ms += ms;
+      times->triangles += s3d->stats.triangles;
+      for (int i = 0; i < PROF_STAGE_COUNT; i++) {
+        times->stage_ms[i] += prof->stage_ms[i];
+      }
+      for (int i = 0; i < PROF_COUNTER_COUNT; i++) {
+        times->counters[i] += prof->counters[i];
+      }
+    }
+  }
+  return times;
+}
+
+static void print_scene(const Scene *scene, const BenchOptions *opt,
+                        SceneTimes *times, bool last) {
+  qsort(times->frame_ms, (size_t)opt->frames, sizeof(double), cmp_double);
+  double seconds = times->total_ms / 1000.0;
+  double pixels = (double)opt->w * (double)opt->h * (double)opt->frames;
+  printf("    {\"name\": \"%s\", \"frames\": %d, \"ms_per_frame\": {"
+         "\"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, "
+         "\"p99\": %.4f, \"max\": %.4f}, \"triangles_per_frame\": %.1f, "
+         "\"triangles_per_s\": %.0f, \"pixels_per_s\": %.0f, ",
+         scene->name, opt->frames, times->total_ms / opt->frames,
+         times->frame_ms[0], percentile(times->frame_ms, opt->frames, 50),
+         percentile(times->frame_ms, opt->frames, 90),
+         percentile(times->frame_ms, opt->frames, 99),
+         times->frame_ms[opt->frames - 1],
+         (double)times->triangles / opt->frames,
+         (double)times->triangles / seconds, pixels / seconds);
+  // Per-frame means. Headless frames have no HUD or present stage.
+  printf("\"stage_ms\": {");
+  for (int i = 0; i <= PROF_RASTER; i++) {
+    printf("%s\"%s\": %.4f", i > 0 ? ", " : "", profiler_stage_name(i),
+           times->stage_ms[i] / opt->frames);
+  }
+  printf("}, \"counters\": {");
+  for (int i = 0; i < PROF_COUNTER_COUNT; i++) {
+    printf("%s\"%s\": %.2f", i > 0 ? ", " : "", counter_keys[i],
+           times->counters[i] / opt->frames);
+  }
+  printf("}}%s\n", last ? "" : ",");
+}
+
+static bool parse_options(int argc, char **argv, BenchOptions *opt) {
+  *opt = (BenchOptions){.w = 960,
+                        .h = 540,
+                        .frames = 300,
+                        .threads = 0,
+                        .obj_path = "assets/backpack/backpack.obj"};
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--size") == 0 && has_value) {
+      if (sscanf(argv[++i], "%dx%d", &opt->w, &opt->h) != 2) {
+        return false;
+      }
+    } else if (strcmp(argv[i], "--frames") == 0 && has_value) {
+      opt->frames = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+      opt->threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--obj") == 0 && has_value) {
+      opt->obj_path = argv[++i];
+    } else if (strcmp(argv[i], "--trace") == 0 && has_value) {
+      opt->trace_prefix = argv[++i];
+    } else if (strcmp(argv[i], "--reuse-depth") == 0) {
+      opt->reuse_depth = true;
+    } else {
+      return false;
+    }
+  }
+  return opt->w > 0 && opt->h > 0 && opt->frames > 0;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions opt;
+  if (!parse_options(argc, argv, &opt)) {
+    fprintf(stderr, "usage: %s [--size WxH] [--frames N] [--threads N] "
+                    "[--obj PATH] [--trace PREFIX] [--reuse-depth]\n",
+            argv[0]);
+    return 2;
+  }
+  // Only the image loaders are initialised; no window or video subsystem.
+  IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG | IMG_INIT_WEBP);
+
+  u32 *color = malloc((size_t)opt.w * (size_t)opt.h * sizeof(u32));
+  float *depth = malloc((size_t)opt.w * (size_t)opt.h * sizeof(float));
+  S3DContext s3d;
+  Profiler prof;
+  if (!color || !depth || !s3d_init(&s3d, opt.threads) ||
+      !profiler_init(&prof)) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  s3d.profiler = &prof;
+  s3d.reuse_depth = opt.reuse_depth;
+
+  Texture brick = {0}, dirt = {0};
+  Mesh cube = {0};
+  Mesh terrain[TERRAIN_CHUNKS * TERRAIN_CHUNKS] = {0};
+  ObjModel model = {0};
+  S3DMaterial *model_materials = NULL;
+  if (!load_or_checker(&brick, "assets/brick.png") ||
+      !load_or_checker(&dirt, "assets/dirt.webp") || !mesh_build_cube(&cube) ||
+      !build_terrain(terrain)) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  S3DMaterial brick_material = {&brick};
+  S3DMaterial dirt_material = {&dirt};
+
+  Scene scenes[3];
+  int scene_count = 0;
+  scenes[scene_count++] = (Scene){.name = "cube",
+                                  .meshes = &cube,
+                                  .mesh_count = 1,
+                                  .materials = &brick_material,
+                                  .model = mat4_identity(),
+                                  .radius = 2.0f,
+                                  .height = 0.8f};
+  float half = TERRAIN_SIZE * 0.5f;
+  scenes[scene_count++] =
+      (Scene){.name = "voxel",
+              .meshes = terrain,
+              .mesh_count = TERRAIN_CHUNKS * TERRAIN_CHUNKS,
+              .materials = &dirt_material,
+              .model = mat4_identity(),
+              .center = {half, TERRAIN_HEIGHT * 0.5f, half},
+              .radius = half * 0.6f,
+              .height = TERRAIN_HEIGHT,
+              .fly = true};
+  Uint64 load_start = SDL_GetPerformanceCounter();
+  bool model_loaded = load_model(opt.obj_path, &model);
+  double load_ms = (double)(SDL_GetPerformanceCounter() - load_start) *
+                   1000.0 / (double)SDL_GetPerformanceFrequency();
+  if (model_loaded && model.mesh.has_bounds) {
+    model_materials = malloc((size_t)model.material_count * sizeof(S3DMaterial));
+    if (model_materials) {
+      for (int i = 0; i < model.material_count; i++) {
+        ObjMaterial *mat = &model.materials[i];
+        model_materials[i].texture =
+            mat->has_diffuse ? &mat->diffuse : &brick;
+      }
+      v3f lo = model.mesh.bounds_min, hi = model.mesh.bounds_max;
+      v3f center = {(lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f,
+                    (lo.z + hi.z) * 0.5f};
+      float extent = fmaxf(hi.x - lo.x, fmaxf(hi.y - lo.y, hi.z - lo.z));
+      scenes[scene_count++] = (Scene){.name = "obj",
+                                      .meshes = &model.mesh,
+                                      .mesh_count = 1,
+                                      .materials = model_materials,
+                                      .model = mat4_identity(),
+                                      .center = center,
+                                      .radius = extent * 1.2f,
+                                      .height = extent * 0.3f};
+    }
+  } else {
+    fprintf(stderr, "skipping obj scene: could not load %s\n", opt.obj_path);
+  }
+
+  printf("{\n  \"width\": %d,\n  \"height\": %d,\n  \"threads\": %d,\n"
+         "  \"span_path\": \"%s\",\n  \"reuse_depth\": %s,\n"
+         "  \"model_load_ms\": %.3f,\n  \"scenes\": [\n",
+         opt.w, opt.h, s3d.jobs.thread_count + 1, span_path_name(span_path()),
+         opt.reuse_depth ? "true" : "false", model_loaded ? load_ms : 0.0);
+  for (int i = 0; i < scene_count; i++) {
+    SceneTimes *times =
+        run_scene(&s3d, &prof, &scenes[i], &opt, color, depth);
+    if (!times) {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+    print_scene(&scenes[i], &opt, times, i == scene_count - 1);
+    free(times);
+  }
+  printf("  ]\n}\n");
+
+  free(model_materials);
+  obj_model_free(&model);
+  for (int i = 0; i < TERRAIN_CHUNKS * TERRAIN_CHUNKS; i++) {
+    mesh_free(&terrain[i]);
+  }
+  mesh_free(&cube);
+  texture_destroy(&brick);
+  texture_destroy(&dirt);
+  s3d_destroy(&s3d);
+  profiler_destroy(&prof);
+  free(color);
+  free(depth);
+  IMG_Quit();
+  return 0;
+}
@@ -0,0 +1,636 @@
+// Golden-image check for the rasterizers: renders fixed edge-case scenes
+// (slivers, huge triangles, near-plane crossings, off-screen bounds, heavy
+// overlap, shared edges, minification, atlas views, bilinear filtering and
+// wireframe) headlessly on every span path the CPU supports and with a
+// multi-threaded binner, and compares each image with the scalar,
+// single-worker render. Nothing is random between runs, so the scalar render
+// is also checked against the PPM files in GOLDEN_DIR, which catches changes
+// on the scalar path itself: that is the default at the default size.
+// --save DIR writes the reference images (--save bench/golden refreshes the
+// checked-in ones after an intended change) and --compare DIR checks against
+// another set. Exits non-zero on any pixel over the tolerance.
+//
+//   golden [--size WxH] [--threads N] [--tolerance N] [--save DIR]
+//          [--compare DIR]
+#include "atlas.h"
+#include "colors.h"
+#include "math.h"
+#include "mesh.h"
+#include "pipeline.h"
+#include "render.h"
+#include "shapes.h"
+#include "span.h"
+#include "types.h"
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Reference images for the default size, relative to the repository root.
+#define GOLDEN_DIR "bench/golden"
+#define GOLDEN_W 317
+#define GOLDEN_H 239
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct {
+  int w;
+  int h;
+  int threads;   // workers of the threaded variant
+  int tolerance; // largest per-channel difference still counted as equal
+  const char *save_dir;
+  const char *compare_dir;
+} GoldenOptions;
+
+typedef struct {
+  Texture clamp;
+  Texture repeat;
+  Texture mipped; // repeat, tiled, with a mip chain
+  TextureAtlas atlas; // tiled; views of clamp, repeat and mipped
+  // Bilinear copies of clamp, repeat, mipped and the repeat view, sharing
+  // their texels.
+  Texture smooth[4];
+  Mesh cube;
+} GoldenAssets;
+
+typedef void (*SceneFn)(S3DContext *s3d, const GoldenAssets *assets);
+
+typedef struct {
+  const char *name;
+  SceneFn draw;
+} GoldenScene;
+
+typedef struct {
+  int color_diff; // pixels with any channel over the tolerance
+  int max_delta;
+  int depth_diff; // pixels whose depth bits differ
+} Diff;
+
+static u32 rng_state = 0x12345678u;
+
+// xorshift32, reseeded per scene so every variant sees the same triangles.
+static u32 rng_next(void) {
+  u32 x = rng_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return rng_state = x;
+}
+
+static float rng_float(float lo, float hi) {
+  return lo + (hi - lo) * (float)(rng_next() & 0xFFFFFF) / (float)0xFFFFFF;
+}
+
+// x and y in pixels, rounded to the rasterizer's subpixel grid.
+static VertexPC vert(float x, float y, float u, float v, float depth,
+                     float inv_w) {
+  v2i pos = {(int)floorf(x * SUBPIXEL_ONE + 0.5f),
+             (int)floorf(y * SUBPIXEL_ONE + 0.5f)};
+  return (VertexPC){.pos = pos, .uv = {u, v}, .inv_w = inv_w, .depth = depth};
+}
+
+static void tri(S3DContext *s3d, const Texture *tex, VertexPC a, VertexPC b,
+                VertexPC c) {
+  binner_textured_triangle(&s3d->binner, (Texture *)tex, a, b, c);
+}
+
+// Fans of one-pixel-wide wedges, hairline strips along rows and columns, and
+// near-degenerate triangles whose area is a fraction of a pixel.
+static void scene_slivers(S3DContext *s3d, const GoldenAssets *assets) {
+  int w = s3d->w, h = s3d->h;
+  v2i c = {w / 2, h / 2};
+  for (int i = 0; i < 96; i++) {
+    int x = (i * w) / 96;
+    float z = 0.2f + 0.006f * (float)i;
+    tri(s3d, &assets->clamp, vert(c.x, c.y, 0.5f, 0.5f, z, 1.0f),
+        vert(x, 0, 0.0f, 0.0f, z, 1.0f), vert(x + 1, 0, 1.0f, 0.0f, z, 1.0f));
+    tri(s3d, &assets->repeat, vert(c.x, c.y, 0.5f, 0.5f, z, 1.0f),
+        vert(x + 1, h - 1, 4.0f, 4.0f, z, 0.5f),
+        vert(x, h - 1, 0.0f, 4.0f, z, 0.5f));
+  }
+  for (int y = 3; y < h; y += 17) {
+    tri(s3d, &assets->repeat, vert(-5, y, 0.0f, 0.0f, 0.1f, 1.0f),
+        vert(w + 5, y, 8.0f, 0.0f, 0.1f, 1.0f),
+        vert(w + 5, y + 1, 8.0f, 1.0f, 0.1f, 1.0f));
+  }
+  for (int x = 5; x < w; x += 23) {
+    tri(s3d, &assets->clamp, vert(x, -5, 0.0f, 0.0f, 0.15f, 1.0f),
+        vert(x + 1, h + 5, 1.0f, 1.0f, 0.15f, 1.0f),
+        vert(x, h + 5, 0.0f, 1.0f, 0.15f, 1.0f));
+  }
+  rng_state = 0x5eed0001u;
+  for (int i = 0; i < 400; i++) {
+    int x = (int)rng_float(0.0f, (float)w);
+    int y = (int)rng_float(0.0f, (float)h);
+    int len = (int)rng_float(2.0f, 60.0f);
+    tri(s3d, &assets->clamp, vert(x, y, 0.0f, 0.0f, 0.05f, 1.0f),
+        vert(x + len, y + 1, 1.0f, 0.0f, 0.05f, 1.0f),
+        vert(x + 2 * len, y + 1, 1.0f, 1.0f, 0.05f, 1.0f));
+  }
+}
+
+// Triangles whose corners are hundreds of thousands of pixels off-screen,
+// which pushes the edge values past 32 bits and the SIMD paths onto their
+// fallbacks, crossing each other at shallow depth slopes.
+static void scene_huge(S3DContext *s3d, const GoldenAssets *assets) {
+  const int far = 400000;
+  int w = s3d->w, h = s3d->h;
+  tri(s3d, &assets->repeat, vert(-far, -far, -500.0f, -500.0f, 0.3f, 1.0f),
+      vert(far, -far, 500.0f, -500.0f, 0.7f, 1.0f),
+      vert(0, far, 0.0f, 500.0f, 0.5f, 1.0f));
+  tri(s3d, &assets->clamp, vert(-far, h / 2, 0.0f, 0.0f, 0.2f, 0.25f),
+      vert(w / 2, -far, 1.0f, 0.0f, 0.8f, 1.0f),
+      vert(far, far, 1.0f, 1.0f, 0.4f, 2.0f));
+  tri(s3d, &assets->repeat, vert(w / 3, h / 3, 0.0f, 0.0f, 0.45f, 1.0f),
+      vert(far, h / 3 + 7, 3000.0f, 0.0f, 0.45f, 1.0f),
+      vert(w / 3, far, 0.0f, 3000.0f, 0.45f, 1.0f));
+}
+
+// Cubes through the pipeline with the camera placed so the near plane cuts
+// through them at several angles, including from inside one.
+static void scene_near_plane(S3DContext *s3d, const GoldenAssets *assets) {
+  S3DMaterial repeat = {(Texture *)&assets->repeat};
+  S3DMaterial clamp = {(Texture *)&assets->clamp};
+  float aspect = (float)s3d->w / (float)s3d->h;
+  mat4 proj = mat4_perspective((float)M_PI / 3.0f, aspect, 0.1f, 100.0f);
+  mat4 view = mat4_look_at((v3f){0.05f, 0.1f, 0.0f}, (v3f){0.6f, -0.2f, -1.0f},
+                           (v3f){0.0f, 1.0f, 0.0f});
+  mat4 vp = mat4_mul(proj, view);
+
+  const struct {
+    v3f pos;
+    float scale;
+    float angle;
+  } cubes[] = {
+      {{0.0f, 0.0f, 0.0f}, 6.0f, 0.3f},   // the camera sits inside
+      {{0.1f, 0.0f, -0.3f}, 0.5f, 0.7f},  // straddles the near plane
+      {{0.4f, -0.2f, -0.15f}, 0.4f, 1.9f},
+      {{-0.2f, 0.15f, -0.08f}, 0.3f, 2.6f},
+      {{1.0f, -0.5f, -2.0f}, 1.0f, 0.4f},
+  };
+  for (int i = 0; i < (int)(sizeof(cubes) / sizeof(cubes[0])); i++) {
+    mat4 model = mat4_mul(mat4_translate(cubes[i].pos),
+                          mat4_mul(mat4_rotate_y(cubes[i].angle),
+                                   mat4_rotate_x(cubes[i].angle * 0.7f)));
+    mat4 scale = mat4_identity();
+    scale.m[0][0] = scale.m[1][1] = scale.m[2][2] = cubes[i].scale;
+    mat4 mvp = mat4_mul(vp, mat4_mul(model, scale));
+    s3d_draw_mesh(s3d, &assets->cube, mvp, i % 2 ? &clamp : &repeat);
+  }
+}
+
+// Triangles straddling every border and corner, and some entirely outside,
+// next to ones ending exactly on the last row and column.
+static void scene_offscreen(S3DContext *s3d, const GoldenAssets *assets) {
+  int w = s3d->w, h = s3d->h;
+  const v2i anchors[] = {{0, 0},         {w / 2, 0},     {w - 1, 0},
+                         {w - 1, h / 2}, {w - 1, h - 1}, {w / 2, h - 1},
+                         {0, h - 1},     {0, h / 2}};
+  for (int i = 0; i < 8; i++) {
+    v2i a = anchors[i];
+    float z = 0.1f + 0.1f * (float)i;
+    tri(s3d, i % 2 ? &assets->clamp : &assets->repeat,
+        vert(a.x - 70, a.y - 50, 0.0f, 0.0f, z, 1.0f),
+        vert(a.x + 90, a.y - 30, 2.0f, 0.0f, z, 0.8f),
+        vert(a.x - 20, a.y + 80, 0.0f, 2.0f, z, 1.2f));
+  }
+  tri(s3d, &assets->clamp, vert(-300, -300, 0, 0, 0.1f, 1.0f),
+      vert(-10, -300, 1, 0, 0.1f, 1.0f), vert(-10, -1, 1, 1, 0.1f, 1.0f));
+  tri(s3d, &assets->clamp, vert(w, 0, 0, 0, 0.1f, 1.0f),
+      vert(w + 50, 0, 1, 0, 0.1f, 1.0f), vert(w, h, 1, 1, 0.1f, 1.0f));
+  tri(s3d, &assets->repeat, vert(w / 4, h - 40, 0, 0, 0.05f, 1.0f),
+      vert(w - 1, h - 1, 3, 3, 0.05f, 1.0f),
+      vert(w / 4, h - 1, 0, 3, 0.05f, 1.0f));
+}
+
+// Several hundred random triangles of mixed sizes competing in depth, as
+// in raster_bench but small enough to keep the check quick.
+static void scene_overlap(S3DContext *s3d, const GoldenAssets *assets) {
+  rng_state = 0x5eed0002u;
+  const float spreads[] = {8.0f, 40.0f, 250.0f};
+  for (int i = 0; i < 900; i++) {
+    float cx = rng_float(-30.0f, (float)s3d->w + 30.0f);
+    float cy = rng_float(-30.0f, (float)s3d->h + 30.0f);
+    float spread = spreads[(i % 16 == 0) ? 2 : (i % 4 == 0) ? 1 : 0];
+    VertexPC v[3];
+    for (int j = 0; j < 3; j++) {
+      v[j] = vert(cx + rng_float(-spread, spread),
+                  cy + rng_float(-spread, spread), rng_float(-1.0f, 2.0f),
+                  rng_float(-1.0f, 2.0f),
+                  rng_float(0.0f, 1.0f), rng_float(0.2f, 2.0f));
+    }
+    tri(s3d, i % 3 ? &assets->clamp : &assets->repeat, v[0], v[1], v[2]);
+  }
+}
+
+// A grid with jittered subpixel corners and a fan around an off-centre
+// point, at one depth: with the top-left rule every covered pixel is drawn
+// by exactly one triangle, so the edges show no double-drawn seams.
+static void scene_shared_edges(S3DContext *s3d, const GoldenAssets *assets) {
+  enum { COLS = 14, ROWS = 10 };
+  rng_state = 0x5eed0003u;
+  v2f grid[ROWS + 1][COLS + 1];
+  for (int y = 0; y <= ROWS; y++) {
+    for (int x = 0; x <= COLS; x++) {
+      float jitter = (x > 0 && x < COLS && y > 0 && y < ROWS) ? 0.4f : 0.0f;
+      grid[y][x] = (v2f){
+          ((float)x + rng_float(-jitter, jitter)) * (float)s3d->w / COLS,
+          ((float)y + rng_float(-jitter, jitter)) * (float)s3d->h / ROWS};
+    }
+  }
+  for (int y = 0; y < ROWS; y++) {
+    for (int x = 0; x < COLS; x++) {
+      v2f a = grid[y][x], b = grid[y][x + 1];
+      v2f c = grid[y + 1][x + 1], d = grid[y + 1][x];
+      const Texture *tex = (x + y) % 2 ? &assets->clamp : &assets->repeat;
+      tri(s3d, tex, vert(a.x, a.y, 0.0f, 0.0f, 0.5f, 1.0f),
+          vert(b.x, b.y, 1.0f, 0.0f, 0.5f, 1.0f),
+          vert(c.x, c.y, 1.0f, 1.0f, 0.5f, 1.0f));
+      tri(s3d, tex, vert(a.x, a.y, 0.0f, 0.0f, 0.5f, 1.0f),
+          vert(c.x, c.y, 1.0f, 1.0f, 0.5f, 1.0f),
+          vert(d.x, d.y, 0.0f, 1.0f, 0.5f, 1.0f));
+    }
+  }
+  v2f c = {(float)s3d->w * 0.37f + 0.3f, (float)s3d->h * 0.61f + 0.7f};
+  const int spokes = 37;
+  for (int i = 0; i < spokes; i++) {
+    float a0 = 2.0f * (float)M_PI * (float)i / spokes;
+    float a1 = 2.0f * (float)M_PI * (float)(i + 1) / spokes;
+    float r = (float)s3d->h * 0.3f;
+    tri(s3d, i % 2 ? &assets->clamp : &assets->repeat,
+        vert(c.x, c.y, 0.5f, 0.5f, 0.2f, 1.0f),
+        vert(c.x + r * cosf(a1), c.y + r * sinf(a1), 1.0f, 0.0f, 0.2f, 1.0f),
+        vert(c.x + r * cosf(a0), c.y + r * sinf(a0), 0.0f, 1.0f, 0.2f, 1.0f));
+  }
+}
+
+// A floor receding to a horizon and a row of ever smaller quads, on the
+// mipmapped texture, so levels change within triangles and along rows.
+static void scene_minified(S3DContext *s3d, const GoldenAssets *assets) {
+  const Texture *tex = &assets->mipped;
+  float w = (float)s3d->w, h = (float)s3d->h;
+  float far_w = 0.02f; // 1/w at the horizon
+  VertexPC near_l = vert(-0.5f * w, h, 0.0f, 0.0f, 0.1f, 1.0f);
+  VertexPC near_r = vert(1.5f * w, h, 24.0f, 0.0f, 0.1f, 1.0f);
+  VertexPC far_l = vert(0.3f * w, 0.35f * h, 0.0f, 300.0f, 0.9f, far_w);
+  VertexPC far_r = vert(0.7f * w, 0.35f * h, 24.0f, 300.0f, 0.9f, far_w);
+  tri(s3d, tex, near_l, near_r, far_r);
+  tri(s3d, tex, near_l, far_r, far_l);
+
+  float x = 2.5f;
+  for (int i = 0; i < 9; i++) {
+    float size = 48.0f / (float)(1 << (i / 2)) + 0.3f * (float)i;
+    float y = 4.0f + 0.25f * (float)i;
+    float uv = 6.0f;
+    tri(s3d, tex, vert(x, y, 0.0f, 0.0f, 0.05f, 1.0f),
+        vert(x + size, y, uv, 0.0f, 0.05f, 1.0f),
+        vert(x + size, y + size, uv, uv, 0.05f, 1.0f));
+    tri(s3d, tex, vert(x, y, 0.0f, 0.0f, 0.05f, 1.0f),
+        vert(x + size, y + size, uv, uv, 0.05f, 1.0f),
+        vert(x, y + size, 0.0f, uv, 0.05f, 1.0f));
+    x += size + 3.0f;
+  }
+}
+
+// Atlas views sampled past their edges, clamped and repeated, next to a
+// receding floor that uses their mip levels.
+static void scene_atlas(S3DContext *s3d, const GoldenAssets *assets) {
+  const Texture *views = assets->atlas.views;
+  float w = (float)s3d->w, h = (float)s3d->h;
+  VertexPC near_l = vert(0.0f, h, 0.0f, 0.0f, 0.2f, 1.0f);
+  VertexPC near_r = vert(w, h, 12.0f, 0.0f, 0.2f, 1.0f);
+  VertexPC far_l = vert(0.35f * w, 0.45f * h, 0.0f, 150.0f, 0.9f, 0.03f);
+  VertexPC far_r = vert(0.65f * w, 0.45f * h, 12.0f, 150.0f, 0.9f, 0.03f);
+  tri(s3d, &views[2], near_l, near_r, far_r);
+  tri(s3d, &views[2], near_l, far_r, far_l);
+
+  for (int i = 0; i < 6; i++) {
+    const Texture *tex = &views[i % 2];
+    float x = 4.0f + 0.17f * w * (float)i, y = 3.0f + 1.3f * (float)i;
+    float size = 0.15f * w;
+    float lo = -0.75f, hi = 1.5f + 0.5f * (float)i;
+    tri(s3d, tex, vert(x, y, lo, lo, 0.1f, 1.0f),
+        vert(x + size, y + 5.0f, hi, lo, 0.1f, 1.0f),
+        vert(x + size, y + size, hi, hi, 0.1f, 1.0f));
+    tri(s3d, tex, vert(x, y, lo, lo, 0.1f, 1.0f),
+        vert(x + size, y + size, hi, hi, 0.1f, 1.0f),
+        vert(x - 2.0f, y + size, lo, hi, 0.1f, 1.0f));
+  }
+}
+
+// Bilinear filtering on the mipped floor and on quads magnified well past
+// their texture's edges, tilted and in perspective: clamped, repeated and an
+// atlas view, whose repeat must wrap inside the view.
+static void scene_bilinear(S3DContext *s3d, const GoldenAssets *assets) {
+  const Texture *smooth = assets->smooth;
+  float w = (float)s3d->w, h = (float)s3d->h;
+  VertexPC near_l = vert(-0.5f * w, h, 0.0f, 0.0f, 0.2f, 1.0f);
+  VertexPC near_r = vert(1.5f * w, h, 24.0f, 0.0f, 0.2f, 1.0f);
+  VertexPC far_l = vert(0.3f * w, 0.55f * h, 0.0f, 300.0f, 0.9f, 0.02f);
+  VertexPC far_r = vert(0.7f * w, 0.55f * h, 24.0f, 300.0f, 0.9f, 0.02f);
+  tri(s3d, &smooth[2], near_l, near_r, far_r);
+  tri(s3d, &smooth[2], near_l, far_r, far_l);
+
+  const int quads[] = {0, 1, 3};
+  for (int i = 0; i < 3; i++) {
+    const Texture *tex = &smooth[quads[i]];
+    float x = 3.0f + 0.33f * w * (float)i, y = 2.0f + 2.7f * (float)i;
+    float size = 0.3f * w;
+    float lo = -0.4f, hi = 1.3f + 0.7f * (float)i;
+    tri(s3d, tex, vert(x, y, lo, lo, 0.1f, 1.0f),
+        vert(x + size, y + 9.0f, hi, lo, 0.1f, 0.6f),
+        vert(x + size - 6.0f, y + size, hi, hi, 0.1f, 0.6f));
+    tri(s3d, tex, vert(x, y, lo, lo, 0.1f, 1.0f),
+        vert(x + size - 6.0f, y + size, hi, hi, 0.1f, 0.6f),
+        vert(x - 3.0f, y + size - 4.0f, lo, hi, 0.1f, 1.0f));
+  }
+}
+
+// Wireframe pipeline output plus draw_linei and the flat-filled
+// draw_triangle, all reaching past the edges.
+static void scene_wireframe(S3DContext *s3d, const GoldenAssets *assets) {
+  s3d->wireframe = true;
+  scene_near_plane(s3d, assets);
+  s3d->wireframe = false;
+
+  int w = s3d->w, h = s3d->h;
+  for (int i = 0; i < 24; i++) {
+    int x = (i * w) / 24;
+    draw_linei(s3d->color, w, h, (v2i){x, -40}, (v2i){w - x, h + 40},
+               0xFF00FF00u);
+  }
+  draw_linei(s3d->color, w, h, (v2i){-500, h / 3}, (v2i){w + 500, h / 3 + 3},
+             WHITE);
+  draw_triangle(s3d->color, w, h, (v2i){-60, h / 2}, (v2i){w / 3, -80},
+                (v2i){w / 2, h + 60}, 0xFF3060C0u, FILLED);
+  draw_triangle(s3d->color, w, h, (v2i){w - 10, 10}, (v2i){w + 90, h / 2},
+                (v2i){w / 2, h - 5}, 0xFFC06030u, FILLED);
+}
+
+static const GoldenScene scenes[] = {
+    {"slivers", scene_slivers},       {"huge", scene_huge},
+    {"near_plane", scene_near_plane}, {"offscreen", scene_offscreen},
+    {"overlap", scene_overlap},       {"shared_edges", scene_shared_edges},
+    {"minified", scene_minified},     {"atlas", scene_atlas},
+    {"bilinear", scene_bilinear},     {"wireframe", scene_wireframe},
+};
+#define SCENE_COUNT ((int)(sizeof(scenes) / sizeof(scenes[0])))
+
+static void render(S3DContext *s3d, const GoldenScene *scene,
+                   const GoldenAssets *assets, u32 *color, float *depth,
+                   int w, int h) {
+  s3d_begin(s3d, color, depth, w, h);
+  s3d_clear(s3d, 0xFF202020u);
+  scene->draw(s3d, assets);
+  s3d_end(s3d);
+}
+
+static Diff compare(const u32 *ref, const float *ref_depth, const u32 *img,
+                    const float *depth, int count, int tolerance) {
+  Diff diff = {0};
+  for (int i = 0; i < count; i++) {
+    int pixel_delta = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      int a = (int)((ref[i] >> shift) & 0xFF);
+      int b = (int)((img[i] >> shift) & 0xFF);
+      int delta = a > b ? a - b : b - a;
+      pixel_delta = delta > pixel_delta ? delta : pixel_delta;
+    }
+    if (pixel_delta > diff.max_delta) {
+      diff.max_delta = pixel_delta;
+    }
+    if (pixel_delta > tolerance) {
+      diff.color_diff++;
+    }
+    if (ref_depth && memcmp(&ref_depth[i], &depth[i], sizeof(float)) != 0) {
+      diff.depth_diff++;
+    }
+  }
+  return diff;
+}
+
+// Binary PPM, RGB only: the targets are opaque.
+static bool save_ppm(const char *path, const u32 *pixels, int w, int h) {
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+  fprintf(file, "P6\n%d %d\n255\n", w, h);
+  for (int i = 0; i < w * h; i++) {
+    u8 rgb[3] = {(u8)(pixels[i] >> 16), (u8)(pixels[i] >> 8), (u8)pixels[i]};
+    fwrite(rgb, 1, 3, file);
+  }
+  bool ok = !ferror(file);
+  return fclose(file) == 0 && ok;
+}
+
+static bool load_ppm(const char *path, u32 *pixels, int w, int h) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return false;
+  }
+  int fw, fh, max;
+  bool ok = fscanf(file, "P6 %d %d %d", &fw, &fh, &max) == 3 && fw == w &&
+            fh == h && max == 255 && fgetc(file) != EOF;
+  for (int i = 0; ok && i < w * h; i++) {
+    u8 rgb[3];
+    ok = fread(rgb, 1, 3, file) == 3;
+    pixels[i] = 0xFF000000u | (u32)rgb[0] << 16 | (u32)rgb[1] << 8 | rgb[2];
+  }
+  fclose(file);
+  return ok;
+}
+
+static bool report(const char *scene, const char *variant, Diff diff) {
+  bool ok = diff.color_diff == 0 && diff.depth_diff == 0;
+  printf("%-12s %-16s %s: %d pixels over tolerance (max delta %d), "
+         "%d depth mismatches\n",
+         scene, variant, ok ? "ok  " : "FAIL", diff.color_diff,
+         diff.max_delta, diff.depth_diff);
+  return ok;
+}
+
+static bool make_texture(Texture *tex, int size, TextureWrap wrap) {
+  tex->pixels = malloc((size_t)size * size * sizeof(u32));
+  if (!tex->pixels) {
+    return false;
+  }
+  tex->w = tex->h = size;
+  tex->wrap = wrap;
+  // A gradient with a checker on top, so a texel off by one shows.
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      u32 r = (u32)(x * 255 / (size - 1));
+      u32 g = (u32)(y * 255 / (size - 1));
+      u32 b = ((x ^ y) & 1) ? 0xFF : 0x40;
+      tex->pixels[y * size + x] = 0xFF000000u | r << 16 | g << 8 | b;
+    }
+  }
+  return true;
+}
+
+// Equal-sized textures plus a 1x1 in a tiled atlas, as the model demo
+// builds one: the packed atlas may waste a shelf's slack, not a shelf per
+// texture.
+static bool check_atlas_packing(void) {
+  enum { COUNT = 4, SIZE = 256 };
+  Texture textures[COUNT + 1] = {0};
+  const Texture *sources[COUNT + 1];
+  bool ok = true;
+  for (int i = 0; i <= COUNT; i++) {
+    ok &= make_texture(&textures[i], i < COUNT ? SIZE : 2, TEXTURE_REPEAT);
+    textures[i].w = textures[i].h = i < COUNT ? SIZE : 1;
+    sources[i] = &textures[i];
+  }
+  TextureAtlas atlas;
+  if (!ok || !atlas_build(&atlas, sources, COUNT + 1, TEXTURE_TILED)) {
+    fprintf(stderr, "out of memory\n");
+    return false;
+  }
+  long long used = (long long)COUNT * SIZE * SIZE + 1;
+  long long packed = (long long)atlas.texture.w * atlas.texture.h;
+  ok = packed * 4 <= used * 5;
+  printf("%-12s %-16s %s: %dx%d for %lld texels\n", "atlas", "packing",
+         ok ? "ok  " : "FAIL", atlas.texture.w, atlas.texture.h, used);
+  atlas_destroy(&atlas);
+  for (int i = 0; i <= COUNT; i++) {
+    free(textures[i].pixels);
+  }
+  return ok;
+}
+
+static bool parse_options(int argc, char **argv, GoldenOptions *opt) {
+  *opt = (GoldenOptions){.w = GOLDEN_W, .h = GOLDEN_H, .threads = 4};
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--size") == 0 && has_value) {
+      if (sscanf(argv[++i], "%dx%d", &opt->w, &opt->h) != 2) {
+        return false;
+      }
+    } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+      opt->threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--tolerance") == 0 && has_value) {
+      opt->tolerance = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--save") == 0 && has_value) {
+      opt->save_dir = argv[++i];
+    } else if (strcmp(argv[i], "--compare") == 0 && has_value) {
+      opt->compare_dir = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  if (!opt->save_dir && !opt->compare_dir && opt->w == GOLDEN_W &&
+      opt->h == GOLDEN_H) {
+    opt->compare_dir = GOLDEN_DIR;
+  }
+  return opt->w > 0 && opt->h > 0 && opt->threads > 0 && opt->tolerance >= 0;
+}
+
+int main(int argc, char **argv) {
+  GoldenOptions opt;
+  if (!parse_options(argc, argv, &opt)) {
+    fprintf(stderr, "usage: %s [--size WxH] [--threads N] [--tolerance N] "
+                    "[--save DIR] [--compare DIR]\n",
+            argv[0]);
+    return 2;
+  }
+
+  size_t count = (size_t)opt.w * (size_t)opt.h;
+  u32 *ref = malloc(count * sizeof(u32));
+  u32 *img = malloc(count * sizeof(u32));
+  float *ref_depth = malloc(count * sizeof(float));
+  float *depth = malloc(count * sizeof(float));
+  GoldenAssets assets = {0};
+  // Reference: one worker. Both contexts bin, so the threaded one checks
+  // tile ownership and the HiZ updates rather than the binning itself.
+  S3DContext serial, threaded;
+  const Texture *atlas_sources[] = {&assets.clamp, &assets.repeat,
+                                    &assets.mipped};
+  if (!ref || !img || !ref_depth || !depth ||
+      !make_texture(&assets.clamp, 16, TEXTURE_CLAMP) ||
+      !make_texture(&assets.repeat, 8, TEXTURE_REPEAT) ||
+      !make_texture(&assets.mipped, 64, TEXTURE_REPEAT) ||
+      !texture_build_mips(&assets.mipped) ||
+      !texture_set_layout(&assets.mipped, TEXTURE_TILED) ||
+      !atlas_build(&assets.atlas, atlas_sources, 3, TEXTURE_TILED) ||
+      !mesh_build_cube(&assets.cube) || !s3d_init(&serial, 1) ||
+      !s3d_init(&threaded, opt.threads)) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  const Texture *smooth_sources[] = {&assets.clamp, &assets.repeat,
+                                     &assets.mipped, &assets.atlas.views[1]};
+  for (int i = 0; i < 4; i++) {
+    assets.smooth[i] = *smooth_sources[i];
+    assets.smooth[i].filter = TEXTURE_BILINEAR;
+  }
+
+  printf("golden scenes at %dx%d, tolerance %d\n", opt.w, opt.h,
+         opt.tolerance);
+  SpanPath best = span_path();
+  bool ok = check_atlas_packing();
+  for (int s = 0; s < SCENE_COUNT; s++) {
+    const GoldenScene *scene = &scenes[s];
+    span_set_path(SPAN_SCALAR);
+    render(&serial, scene, &assets, ref, ref_depth, opt.w, opt.h);
+
+    char path[512];
+    if (opt.save_dir) {
+      snprintf(path, sizeof(path), "%s/%s.ppm", opt.save_dir, scene->name);
+      if (!save_ppm(path, ref, opt.w, opt.h)) {
+        fprintf(stderr, "failed to write %s\n", path);
+        ok = false;
+      }
+    }
+    if (opt.compare_dir) {
+      snprintf(path, sizeof(path), "%s/%s.ppm", opt.compare_dir, scene->name);
+      if (!load_ppm(path, img, opt.w, opt.h)) {
+        fprintf(stderr, "failed to read %s (or its size differs)\n", path);
+        ok = false;
+      } else {
+        // The files hold no alpha and load as opaque, like every scene.
+        ok &= report(scene->name, "saved image",
+                     compare(img, NULL, ref, NULL, (int)count, opt.tolerance));
+      }
+    }
+
+    for (int p = SPAN_SCALAR; p <= SPAN_AVX2; p++) {
+      if (!span_set_path((SpanPath)p)) {
+        continue;
+      }
+      S3DContext *contexts[2] = {&serial, &threaded};
+      for (int c = 0; c < 2; c++) {
+        if (p == SPAN_SCALAR && c == 0) {
+          continue; // the reference itself
+        }
+        render(contexts[c], scene, &assets, img, depth, opt.w, opt.h);
+        char variant[32];
+        snprintf(variant, sizeof(variant), "%s x%d",
+                 span_path_name((SpanPath)p),
+                 contexts[c]->jobs.thread_count + 1);
+        ok &= report(scene->name, variant,
+                     compare(ref, ref_depth, img, depth, (int)count,
+                             opt.tolerance));
+      }
+    }
+  }
+  span_set_path(best);
+  printf("%s\n", ok ? "all images match" : "MISMATCHES FOUND");
+
+  s3d_destroy(&serial);
+  s3d_destroy(&threaded);
+  mesh_free(&assets.cube);
+  free(assets.clamp.pixels);
+  free(assets.repeat.pixels);
+  texture_destroy(&assets.mipped);
+  atlas_destroy(&assets.atlas);
+  free(ref);
+  free(img);
+  free(ref_depth);
+  free(depth);
+  return ok ? 0 : 1;
+}
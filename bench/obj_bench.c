@@ -0,0 +1,303 @@
+// OBJ parse throughput: loads an OBJ with obj_model_load a few times and
+// reports the best run in MB/s, next to a reference pass that only tokenizes
+// the same file line by line with fgets and sscanf (the loader's previous
+// approach, without building the mesh). Without --obj it writes a synthetic
+// N x N grid (positions, UVs, normals, quads and triangles) to a temporary
+// file and times that. --threads sets the loader's thread count, as for
+// obj_model_load_threads; 1 parses the file in one piece.
+//
+// Before timing, it writes a second file of a few MB with negative and
+// absolute indices, `usemtl` runs that span chunks (including unknown names,
+// and faces before the `mtllib` that defines them) and unparseable v and vt
+// lines, loads it on one thread and in chunks on --threads threads (4 by
+// default), and exits non-zero unless both meshes are identical.
+//
+//   obj_bench [--obj PATH] [--grid N] [--runs N] [--threads N]
+#include "obj_loader.h"
+#include "types.h"
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRID_PATH "obj_bench_grid.obj"
+#define EDGE_PATH "obj_bench_edge.obj"
+#define EDGE_MTL "obj_bench_edge.mtl"
+// Strips of EDGE_STRIP positions; about 6 MB, so it splits into chunks.
+#define EDGE_STRIPS 1000
+#define EDGE_STRIP 64
+
+typedef struct {
+  const char *obj_path;
+  int grid;
+  int runs;
+  int threads;
+} BenchOptions;
+
+static double ms_since(Uint64 start) {
+  return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 /
+         (double)SDL_GetPerformanceFrequency();
+}
+
+static bool write_grid(const char *path, int n) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    return false;
+  }
+  srand(1);
+  fprintf(f, "# obj_bench grid\n");
+  for (int y = 0; y <= n; y++) {
+    for (int x = 0; x <= n; x++) {
+      fprintf(f, "v %.6f %.6f %.6f\n", (double)x / n,
+              (double)rand() / RAND_MAX * 0.01, (double)y / n);
+    }
+  }
+  for (int y = 0; y <= n; y++) {
+    for (int x = 0; x <= n; x++) {
+      fprintf(f, "vt %.6f %.6f\n", (double)x / n * 4.0, (double)y / n * 4.0);
+    }
+  }
+  fprintf(f, "vn 0 1 0\n");
+  for (int y = 0; y < n; y++) {
+    for (int x = 0; x < n; x++) {
+      int a = y * (n + 1) + x + 1, b = a + 1, c = a + n + 1, d = c + 1;
+      if ((x + y) % 2 == 0) {
+        fprintf(f, "f %d/%d/1 %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, b, b, d, d,
+                c, c);
+      } else {
+        fprintf(f, "f %d/%d %d/%d %d/%d\nf %d/%d %d/%d %d/%d\n", a, a, b, b,
+                d, d, a, a, d, d, c, c);
+      }
+    }
+  }
+  return fclose(f) == 0;
+}
+
+// Strips of quads, each joined to the strip before it. Corners use
+// negative indices in even strips and absolute ones in odd strips, and the
+// malformed lines in between must not count as positions or UVs.
+static bool write_edge_cases(const char *obj_path, const char *mtl_path) {
+  FILE *f = fopen(mtl_path, "w");
+  if (!f) {
+    return false;
+  }
+  fprintf(f, "newmtl red\nnewmtl green\nnewmtl blue\n");
+  if (fclose(f) != 0) {
+    return false;
+  }
+  static const char *const names[] = {"red", "green", "missing", "blue"};
+  f = fopen(obj_path, "w");
+  if (!f) {
+    return false;
+  }
+  srand(2);
+  fprintf(f, "# obj_bench edge cases\n");
+  int count = 0; // valid v lines so far; vt lines match them
+  for (int strip = 0; strip < EDGE_STRIPS; strip++) {
+    if (strip == EDGE_STRIPS / 2) {
+      fprintf(f, "mtllib %s\n", mtl_path);
+    }
+    if (strip % 37 == 5) {
+      fprintf(f, "usemtl %s\n", names[strip / 37 % 4]);
+    }
+    for (int i = 0; i < EDGE_STRIP; i++) {
+      fprintf(f, "v %.6f %.6f %.6f\n", (double)i, (double)rand() / RAND_MAX,
+              (double)strip);
+      if (i % 16 == 7) {
+        fprintf(f, "v 1.5 oops 2\nvt 0.25\nv 3\n");
+      }
+      fprintf(f, "vt %.6f %.6f\n", (double)i / EDGE_STRIP,
+              (double)(strip % 8) / 8.0);
+    }
+    count += EDGE_STRIP;
+    for (int i = 0; strip > 0 && i + 1 < EDGE_STRIP; i++) {
+      int base = strip % 2 == 0 ? -(count + 1) : 0; // -1 is the last v
+      int a = base + count - 2 * EDGE_STRIP + i + 1, b = a + 1;
+      int c = b + EDGE_STRIP, d = a + EDGE_STRIP;
+      if (i % 3 == 0) {
+        fprintf(f, "f %d/%d %d/%d %d/%d %d/%d\n", a, a, b, b, c, c, d, d);
+      } else if (i % 3 == 1) {
+        fprintf(f, "f %d//1 %d//1 %d//1\nf %d %d %d\n", a, b, c, a, c, d);
+      } else {
+        fprintf(f, "f %d/%d/1 %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, b, b, c, c,
+                d, d);
+      }
+    }
+  }
+  fprintf(f, "vn 0 1 0\n");
+  return fclose(f) == 0;
+}
+
+static bool same_array(const void *a, const void *b, int count,
+                       size_t elem) {
+  return count == 0 || memcmp(a, b, (size_t)count * elem) == 0;
+}
+
+static bool same_mesh(const Mesh *a, const Mesh *b) {
+  return a->position_count == b->position_count &&
+         a->vertex_count == b->vertex_count &&
+         a->index_count == b->index_count &&
+         a->group_count == b->group_count &&
+         same_array(a->positions, b->positions, a->position_count,
+                    sizeof(v3f)) &&
+         same_array(a->vertices, b->vertices, a->vertex_count,
+                    sizeof(MeshVertex)) &&
+         same_array(a->indices, b->indices, a->index_count, sizeof(u32)) &&
+         same_array(a->groups, b->groups, a->group_count, sizeof(MeshGroup));
+}
+
+// Loads the edge-case file with one thread and with threads, and compares.
+static bool check_chunks(int threads) {
+  if (!write_edge_cases(EDGE_PATH, EDGE_MTL)) {
+    fprintf(stderr, "could not write %s\n", EDGE_PATH);
+    return false;
+  }
+  ObjModel serial = {0}, chunked = {0};
+  bool loaded = obj_model_load_threads(EDGE_PATH, &serial, 1) &&
+                obj_model_load_threads(EDGE_PATH, &chunked, threads);
+  bool ok = loaded && same_mesh(&serial.mesh, &chunked.mesh);
+  printf("%s: 1 vs %d threads: %d vertices, %d triangles, %d groups: %s\n",
+         EDGE_PATH, threads, serial.mesh.vertex_count,
+         serial.mesh.index_count / 3, serial.mesh.group_count,
+         !loaded ? "FAILED TO LOAD" : ok ? "identical" : "MISMATCH");
+  obj_model_free(&serial);
+  obj_model_free(&chunked);
+  remove(EDGE_PATH);
+  remove(EDGE_MTL);
+  return ok;
+}
+
+static long file_size(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fclose(f);
+  return size;
+}
+
+// Keeps the reference pass's sums alive.
+static volatile double sink;
+
+// Tokenizes every v, vt and f line the way the loader used to.
+static double reference_pass(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return 0.0;
+  }
+  char line[512];
+  double sum = 0.0;
+  while (fgets(line, sizeof(line), f)) {
+    float x, y, z;
+    if (strncmp(line, "v ", 2) == 0 &&
+        sscanf(line + 2, "%f %f %f", &x, &y, &z) == 3) {
+      sum += x + y + z;
+    } else if (strncmp(line, "vt", 2) == 0 &&
+               sscanf(line + 2, "%f %f", &x, &y) == 2) {
+      sum += x + y;
+    } else if (strncmp(line, "f ", 2) == 0) {
+      char *cursor = line + 2;
+      char token[64];
+      int used = 0;
+      while (sscanf(cursor, "%63s%n", token, &used) == 1) {
+        int vi = 0, ti = 0, ni = 0;
+        if (sscanf(token, "%d/%d/%d", &vi, &ti, &ni) < 1) {
+          sscanf(token, "%d//%d", &vi, &ni);
+        }
+        sum += vi + ti + ni;
+        cursor += used;
+      }
+    }
+  }
+  fclose(f);
+  return sum;
+}
+
+static bool parse_options(int argc, char **argv, BenchOptions *opt) {
+  *opt = (BenchOptions){.grid = 500, .runs = 5};
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--obj") == 0 && has_value) {
+      opt->obj_path = argv[++i];
+    } else if (strcmp(argv[i], "--grid") == 0 && has_value) {
+      opt->grid = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--runs") == 0 && has_value) {
+      opt->runs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+      opt->threads = atoi(argv[++i]);
+    } else {
+      return false;
+    }
+  }
+  return opt->grid > 0 && opt->runs > 0;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions opt;
+  if (!parse_options(argc, argv, &opt)) {
+    fprintf(stderr, "usage: %s [--obj PATH] [--grid N] [--runs N] "
+                    "[--threads N]\n",
+            argv[0]);
+    return 2;
+  }
+  // Models with an MTL decode their textures too, as in the demos.
+  IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG | IMG_INIT_WEBP);
+  if (!check_chunks(opt.threads > 1 ? opt.threads : 4)) {
+    IMG_Quit();
+    return 1;
+  }
+  const char *path = opt.obj_path;
+  if (!path) {
+    if (!write_grid(GRID_PATH, opt.grid)) {
+      fprintf(stderr, "could not write %s\n", GRID_PATH);
+      return 1;
+    }
+    path = GRID_PATH;
+  }
+  double mb = (double)file_size(path) / (1024.0 * 1024.0);
+
+  double load_ms = 0.0, reference_ms = 0.0;
+  ObjModel model = {0};
+  bool ok = true;
+  for (int run = 0; ok && run < opt.runs; run++) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    ok = obj_model_load_threads(path, &model, opt.threads);
+    double ms = ms_since(start);
+    load_ms = (run == 0 || ms < load_ms) ? ms : load_ms;
+    if (ok && run + 1 < opt.runs) {
+      obj_model_free(&model);
+    }
+
+    start = SDL_GetPerformanceCounter();
+    sink = reference_pass(path);
+    ms = ms_since(start);
+    reference_ms = (run == 0 || ms < reference_ms) ? ms : reference_ms;
+  }
+  if (!ok) {
+    fprintf(stderr, "could not load %s\n", path);
+  } else {
+    const Mesh *mesh = &model.mesh;
+    double mesh_mb = ((double)mesh->position_count * sizeof(v3f) +
+                      (double)mesh->vertex_count * sizeof(MeshVertex) +
+                      (double)mesh->index_count * sizeof(u32)) /
+                     (1024.0 * 1024.0);
+    printf("%s: %.1f MB, %d positions, %d vertices, %d triangles, "
+           "%.1f MB mesh\n",
+           path, mb, mesh->position_count, mesh->vertex_count,
+           mesh->index_count / 3, mesh_mb);
+    printf("obj_model_load:  %8.2f ms %8.1f MB/s\n", load_ms,
+           mb * 1000.0 / load_ms);
+    printf("fgets + sscanf:  %8.2f ms %8.1f MB/s (tokenize only)\n",
+           reference_ms, mb * 1000.0 / reference_ms);
+    obj_model_free(&model);
+  }
+  if (!opt.obj_path) {
+    remove(GRID_PATH);
+  }
+  IMG_Quit();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,389 @@
+// Microbenchmark for draw_textured_triangle: renders the same random triangle
+// sets with a brute-force per-pixel rasterizer, the span-based one on
+// every span path the CPU supports and the tiled binner (with and without
+// HiZ), checks that all produce identical color/depth buffers and reports
+// timings. Bilinear filtering is timed against nearest on every span path.
+// Last, it compares a large texture in both memory layouts.
+#include "binner.h"
+#include "hiz.h"
+#include "jobs.h"
+#include "render.h"
+#include "shapes.h"
+#include "span.h"
+#include "types.h"
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_W 960
+#define BENCH_H 540
+#define BENCH_TRIS 4096
+#define BENCH_FRAMES 20
+#define LAYOUT_TEX 2048 // texture size for the layout comparison
+#define LAYOUT_TRIS 256
+#define LAYOUT_SIZE 512 // legs of those triangles, in pixels
+
+static inline long long ref_edge(v2i a, v2i b, long long x, long long y) {
+  return (y - a.y) * ((long long)b.x - a.x) -
+         (x - a.x) * ((long long)b.y - a.y);
+}
+
+// Whether a centre exactly on edge a-b is covered, for a triangle whose
+// inside is where sign * ref_edge > 0 (the top-left rule).
+static bool ref_owns_edge(v2i a, v2i b, int sign) {
+  long long step_x = -((long long)b.y - a.y) * sign;
+  long long step_y = ((long long)b.x - a.x) * sign;
+  return step_x > 0 || (step_x == 0 && step_y > 0);
+}
+
+// Brute force over the bounding box of the rules the rasterizer implements:
+// 28.4 positions, centre sampling, the top-left rule. The reference for the
+// pixel comparison.
+static void ref_textured_triangle(u32 *buffer, float *depth, int w, int h,
+                                  Texture *tex, VertexPC v0, VertexPC v1,
+                                  VertexPC v2) {
+  long long area = ref_edge(v0.pos, v1.pos, v2.pos.x, v2.pos.y);
+  if (area == 0) {
+    return;
+  }
+  int sign = area < 0 ? -1 : 1;
+  float scale = fabsf(1.0f / (float)area);
+  bool own0 = ref_owns_edge(v1.pos, v2.pos, sign);
+  bool own1 = ref_owns_edge(v2.pos, v0.pos, sign);
+  bool own2 = ref_owns_edge(v0.pos, v1.pos, sign);
+
+  // Whole pixels around the box, clamped to the target.
+  int min_x = fminf(fminf(v0.pos.x, v1.pos.x), v2.pos.x) / SUBPIXEL_ONE - 1;
+  int max_x = fmaxf(fmaxf(v0.pos.x, v1.pos.x), v2.pos.x) / SUBPIXEL_ONE + 1;
+  int min_y = fminf(fminf(v0.pos.y, v1.pos.y), v2.pos.y) / SUBPIXEL_ONE - 1;
+  int max_y = fmaxf(fmaxf(v0.pos.y, v1.pos.y), v2.pos.y) / SUBPIXEL_ONE + 1;
+  min_x = min_x < 0 ? 0 : min_x;
+  min_y = min_y < 0 ? 0 : min_y;
+  max_x = max_x >= w ? w - 1 : max_x;
+  max_y = max_y >= h ? h - 1 : max_y;
+
+  for (int y = min_y; y <= max_y; y++) {
+    for (int x = min_x; x <= max_x; x++) {
+      long long px = (long long)x * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+      long long py = (long long)y * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+      long long e0 = ref_edge(v1.pos, v2.pos, px, py) * sign;
+      long long e1 = ref_edge(v2.pos, v0.pos, px, py) * sign;
+      long long e2 = ref_edge(v0.pos, v1.pos, px, py) * sign;
+      if (e0 < 0 || e1 < 0 || e2 < 0 || (e0 == 0 && !own0) ||
+          (e1 == 0 && !own1) || (e2 == 0 && !own2)) {
+        continue;
+      }
+      float w0 = (float)e0 * scale;
+      float w1 = (float)e1 * scale;
+      float w2 = (float)e2 * scale;
+
+      float inv_w_interp = w0 * v0.inv_w + w1 * v1.inv_w + w2 * v2.inv_w;
+      if (inv_w_interp == 0.0f) {
+        continue;
+      }
+
+      float u_over_w = w0 * (v0.uv.x * v0.inv_w) + w1 * (v1.uv.x * v1.inv_w) +
+                       w2 * (v2.uv.x * v2.inv_w);
+      float v_over_w = w0 * (v0.uv.y * v0.inv_w) + w1 * (v1.uv.y * v1.inv_w) +
+                       w2 * (v2.uv.y * v2.inv_w);
+      float u = u_over_w / inv_w_interp;
+      float v = v_over_w / inv_w_interp;
+
+      float depth_interp = w0 * v0.depth + w1 * v1.depth + w2 * v2.depth;
+      int idx = y * w + x;
+      if (depth_interp >= depth[idx]) {
+        continue;
+      }
+      depth[idx] = depth_interp;
+
+      if (u < 0.0f)
+        u = 0.0f;
+      if (u > 1.0f)
+        u = 1.0f;
+      if (v < 0.0f)
+        v = 0.0f;
+      if (v > 1.0f)
+        v = 1.0f;
+
+      int tx = (int)(u * (float)(tex->w - 1));
+      int ty = (int)(v * (float)(tex->h - 1));
+      buffer[idx] = tex->pixels[ty * tex->w + tx];
+    }
+  }
+}
+
+typedef void (*RasterFn)(u32 *, float *, int, int, Texture *, VertexPC,
+                         VertexPC, VertexPC);
+
+static u32 rng_state = 0x12345678u;
+
+static u32 rng_next(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static float rng_float(float lo, float hi) {
+  return lo + (hi - lo) * (float)(rng_next() & 0xFFFFFF) / (float)0xFFFFFF;
+}
+
+// Positions land anywhere on the subpixel grid.
+static VertexPC random_vertex(v2i center, int spread) {
+  VertexPC v;
+  float sub = (float)(spread * SUBPIXEL_ONE);
+  v.pos = (v2i){center.x * SUBPIXEL_ONE + (int)rng_float(-sub, sub),
+                center.y * SUBPIXEL_ONE + (int)rng_float(-sub, sub)};
+  v.uv = (v2f){rng_float(-0.1f, 1.1f), rng_float(-0.1f, 1.1f)};
+  v.inv_w = rng_float(0.05f, 2.0f);
+  v.depth = rng_float(0.0f, 1.0f);
+  return v;
+}
+
+static void clear_target(u32 *buffer, float *depth) {
+  memset(buffer, 0, BENCH_W * BENCH_H * sizeof(u32));
+  for (int i = 0; i < BENCH_W * BENCH_H; i++) {
+    depth[i] = 1.0f;
+  }
+}
+
+static double run(RasterFn fn, const VertexPC *tris, int count, Texture *tex,
+                  u32 *buffer, float *depth) {
+  Uint64 total = 0;
+  for (int f = 0; f < BENCH_FRAMES; f++) {
+    clear_target(buffer, depth);
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < count; i++) {
+      fn(buffer, depth, BENCH_W, BENCH_H, tex, tris[i * 3], tris[i * 3 + 1],
+         tris[i * 3 + 2]);
+    }
+    total += SDL_GetPerformanceCounter() - start;
+  }
+  return (double)total * 1000.0 / (double)SDL_GetPerformanceFrequency() /
+         BENCH_FRAMES;
+}
+
+static double run_binned(Binner *binner, HiZ *hiz, const VertexPC *tris,
+                         Texture *tex, u32 *buffer, float *depth) {
+  Uint64 total = 0;
+  for (int f = 0; f < BENCH_FRAMES; f++) {
+    clear_target(buffer, depth);
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (hiz) {
+      hiz_clear(hiz, 1.0f);
+    }
+    binner_begin(binner, buffer, depth, hiz, BENCH_W, BENCH_H);
+    for (int i = 0; i < BENCH_TRIS; i++) {
+      binner_textured_triangle(binner, tex, tris[i * 3], tris[i * 3 + 1],
+                               tris[i * 3 + 2]);
+    }
+    binner_flush(binner);
+    total += SDL_GetPerformanceCounter() - start;
+  }
+  return (double)total * 1000.0 / (double)SDL_GetPerformanceFrequency() /
+         BENCH_FRAMES;
+}
+
+static float tri_depth(const VertexPC *v) {
+  return v[0].depth + v[1].depth + v[2].depth;
+}
+
+static int cmp_front_to_back(const void *a, const void *b) {
+  float da = tri_depth(a), db = tri_depth(b);
+  return (da > db) - (da < db);
+}
+
+static int count_mismatches(const u32 *ref_buf, const float *ref_depth,
+                            const u32 *buf, const float *depth) {
+  int diff = 0;
+  for (int i = 0; i < BENCH_W * BENCH_H; i++) {
+    if (ref_buf[i] != buf[i] ||
+        memcmp(&ref_depth[i], &depth[i], sizeof(float)) != 0) {
+      diff++;
+    }
+  }
+  return diff;
+}
+
+int main(void) {
+  static u32 pixels[64 * 64];
+  for (int i = 0; i < 64 * 64; i++) {
+    pixels[i] = 0xFF000000u | (rng_next() & 0xFFFFFF);
+  }
+  Texture tex = {.w = 64, .h = 64, .pixels = pixels};
+
+  VertexPC *tris = malloc(BENCH_TRIS * 3 * sizeof(VertexPC));
+  u32 *ref_buf = malloc(BENCH_W * BENCH_H * sizeof(u32));
+  u32 *new_buf = malloc(BENCH_W * BENCH_H * sizeof(u32));
+  float *ref_depth = malloc(BENCH_W * BENCH_H * sizeof(float));
+  float *new_depth = malloc(BENCH_W * BENCH_H * sizeof(float));
+  u32 *bil_buf = malloc(BENCH_W * BENCH_H * sizeof(u32));
+  float *bil_depth = malloc(BENCH_W * BENCH_H * sizeof(float));
+  if (!tris || !ref_buf || !new_buf || !ref_depth || !new_depth || !bil_buf ||
+      !bil_depth) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  // Mix of small voxel-sized, medium and screen-filling triangles, some of
+  // them partially off-screen.
+  const int spreads[] = {12, 60, 400};
+  for (int i = 0; i < BENCH_TRIS; i++) {
+    v2i c = {(int)rng_float(-40.0f, BENCH_W + 40.0f),
+             (int)rng_float(-40.0f, BENCH_H + 40.0f)};
+    int spread = spreads[(i % 16 == 0) ? 2 : (i % 4 == 0) ? 1 : 0];
+    for (int j = 0; j < 3; j++) {
+      tris[i * 3 + j] = random_vertex(c, spread);
+    }
+  }
+
+  double ref_ms =
+      run(ref_textured_triangle, tris, BENCH_TRIS, &tex, ref_buf, ref_depth);
+  printf("triangles/frame: %d (%dx%d)\n", BENCH_TRIS, BENCH_W, BENCH_H);
+  printf("reference:   %8.3f ms/frame\n", ref_ms);
+
+  SpanPath best = span_path();
+  int diff = 0;
+  double nearest_ms[SPAN_AVX2 + 1] = {0};
+  for (int p = SPAN_SCALAR; p <= SPAN_AVX2; p++) {
+    if (!span_set_path((SpanPath)p)) {
+      continue;
+    }
+    double ms = run(draw_textured_triangle, tris, BENCH_TRIS, &tex, new_buf,
+                    new_depth);
+    int path_diff = count_mismatches(ref_buf, ref_depth, new_buf, new_depth);
+    printf("%-6s span: %8.3f ms/frame (%.2fx), mismatched pixels: %d\n",
+           span_path_name((SpanPath)p), ms, ref_ms / ms, path_diff);
+    diff += path_diff;
+    nearest_ms[p] = ms;
+  }
+
+  // Bilinear has no brute-force reference: the scalar path, which always
+  // runs first, is the one the others must match.
+  tex.filter = TEXTURE_BILINEAR;
+  for (int p = SPAN_SCALAR; p <= SPAN_AVX2; p++) {
+    if (!span_set_path((SpanPath)p)) {
+      continue;
+    }
+    bool scalar = p == SPAN_SCALAR;
+    double ms = run(draw_textured_triangle, tris, BENCH_TRIS, &tex,
+                    scalar ? bil_buf : new_buf, scalar ? bil_depth : new_depth);
+    int path_diff =
+        scalar ? 0 : count_mismatches(bil_buf, bil_depth, new_buf, new_depth);
+    printf("%-6s bilinear: %8.3f ms/frame (%.2fx nearest), mismatched pixels: "
+           "%d\n",
+           span_path_name((SpanPath)p), ms, ms / nearest_ms[p], path_diff);
+    diff += path_diff;
+  }
+  tex.filter = TEXTURE_NEAREST;
+  span_set_path(best);
+
+  JobPool jobs;
+  Binner binner;
+  if (!job_pool_init(&jobs, 0) || !binner_init(&binner, &jobs)) {
+    fprintf(stderr, "failed to start job pool\n");
+    return 1;
+  }
+  double bin_ms = run_binned(&binner, NULL, tris, &tex, new_buf, new_depth);
+  int bin_diff = count_mismatches(ref_buf, ref_depth, new_buf, new_depth);
+  printf("binned (%d threads): %8.3f ms/frame (%.2fx), mismatched pixels: %d\n",
+         jobs.thread_count + 1, bin_ms, ref_ms / bin_ms, bin_diff);
+
+  HiZ hiz = {0};
+  if (!hiz_resize(&hiz, BENCH_W, BENCH_H)) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  double hiz_ms = run_binned(&binner, &hiz, tris, &tex, new_buf, new_depth);
+  int hiz_diff = count_mismatches(ref_buf, ref_depth, new_buf, new_depth);
+  printf("binned + HiZ:        %8.3f ms/frame (%.2fx), mismatched pixels: %d\n",
+         hiz_ms, ref_ms / hiz_ms, hiz_diff);
+  bin_diff += hiz_diff;
+
+  // Front-to-back submission of roughly camera-facing triangles, where HiZ
+  // rejects most of the overdraw.
+  for (int i = 0; i < BENCH_TRIS; i++) {
+    float z = rng_float(0.05f, 0.95f);
+    for (int j = 0; j < 3; j++) {
+      tris[i * 3 + j].depth = z + rng_float(-0.01f, 0.01f);
+    }
+  }
+  qsort(tris, BENCH_TRIS, 3 * sizeof(VertexPC), cmp_front_to_back);
+  ref_ms =
+      run(ref_textured_triangle, tris, BENCH_TRIS, &tex, ref_buf, ref_depth);
+  printf("front-to-back reference: %8.3f ms/frame\n", ref_ms);
+  bin_ms = run_binned(&binner, NULL, tris, &tex, new_buf, new_depth);
+  hiz_diff = count_mismatches(ref_buf, ref_depth, new_buf, new_depth);
+  printf("binned:              %8.3f ms/frame (%.2fx), mismatched pixels: %d\n",
+         bin_ms, ref_ms / bin_ms, hiz_diff);
+  bin_diff += hiz_diff;
+  hiz_ms = run_binned(&binner, &hiz, tris, &tex, new_buf, new_depth);
+  hiz_diff = count_mismatches(ref_buf, ref_depth, new_buf, new_depth);
+  printf("binned + HiZ:        %8.3f ms/frame (%.2fx), mismatched pixels: %d\n",
+         hiz_ms, ref_ms / hiz_ms, hiz_diff);
+  bin_diff += hiz_diff;
+
+  // A texture well over L2 in both memory layouts, drawn about one texel per
+  // pixel on large triangles at random rotations: rows of the screen walk the
+  // texture at every angle, down its columns included.
+  Texture linear = {.w = LAYOUT_TEX, .h = LAYOUT_TEX};
+  Texture tiled = {.w = LAYOUT_TEX, .h = LAYOUT_TEX};
+  size_t texels = (size_t)LAYOUT_TEX * LAYOUT_TEX;
+  linear.pixels = malloc(texels * sizeof(u32));
+  tiled.pixels = malloc(texels * sizeof(u32));
+  if (!linear.pixels || !tiled.pixels) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (size_t i = 0; i < texels; i++) {
+    linear.pixels[i] = tiled.pixels[i] = 0xFF000000u | (rng_next() & 0xFFFFFF);
+  }
+  if (!texture_set_layout(&tiled, TEXTURE_TILED)) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (int i = 0; i < LAYOUT_TRIS; i++) {
+    float angle = rng_float(0.0f, 6.2831853f);
+    float c = cosf(angle), sn = sinf(angle);
+    v2f center = {rng_float(0.0f, BENCH_W), rng_float(0.0f, BENCH_H)};
+    v2f origin = {rng_float(0.0f, 0.9f), rng_float(0.0f, 0.9f)};
+    float z = rng_float(0.0f, 1.0f);
+    const v2f corners[3] = {{0, 0}, {LAYOUT_SIZE, 0}, {0, LAYOUT_SIZE}};
+    for (int j = 0; j < 3; j++) {
+      v2f p = corners[j];
+      VertexPC *v = &tris[i * 3 + j];
+      v->pos = (v2i){(int)((center.x + p.x * c - p.y * sn) * SUBPIXEL_ONE),
+                     (int)((center.y + p.x * sn + p.y * c) * SUBPIXEL_ONE)};
+      v->uv = (v2f){origin.x + p.x / LAYOUT_TEX, origin.y + p.y / LAYOUT_TEX};
+      v->inv_w = 1.0f;
+      v->depth = z;
+    }
+  }
+  double linear_ms = run(draw_textured_triangle, tris, LAYOUT_TRIS, &linear,
+                         ref_buf, ref_depth);
+  double tiled_ms = run(draw_textured_triangle, tris, LAYOUT_TRIS, &tiled,
+                        new_buf, new_depth);
+  int layout_diff = count_mismatches(ref_buf, ref_depth, new_buf, new_depth);
+  printf("rotated, linear:     %8.3f ms/frame\n", linear_ms);
+  printf("rotated, tiled:      %8.3f ms/frame (%.2fx), mismatched pixels: %d\n",
+         tiled_ms, linear_ms / tiled_ms, layout_diff);
+  bin_diff += layout_diff;
+  texture_destroy(&linear);
+  texture_destroy(&tiled);
+
+  hiz_destroy(&hiz);
+  binner_destroy(&binner);
+  job_pool_destroy(&jobs);
+
+  free(tris);
+  free(ref_buf);
+  free(new_buf);
+  free(ref_depth);
+  free(new_depth);
+  free(bil_buf);
+  free(bil_depth);
+  return (diff == 0 && bin_diff == 0) ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+// Microbenchmark for the vertex transform stage on a voxel terrain mesh:
+// compares transforming every triangle corner separately (two matrix
+// multiplies each, as the per-face demo loops did) against mesh_transform,
+// which visits each shared corner position once.
+#include "math.h"
+#include "mesh.h"
+#include "render.h"
+#include "types.h"
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRID 96
+#define MAX_HEIGHT 8
+#define BENCH_W 960
+#define BENCH_H 540
+#define BENCH_FRAMES 50
+
+static u32 rng_state = 0x9E3779B9u;
+
+static u32 rng_next(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static int heights[GRID][GRID];
+static u32 corner_ids[GRID + 1][MAX_HEIGHT + 1][GRID + 1];
+
+static u32 corner(Mesh *mesh, int x, int y, int z) {
+  u32 *id = &corner_ids[x][y][z];
+  if (*id == UINT32_MAX) {
+    mesh_add_position(mesh, (v3f){(float)x, (float)y, (float)z});
+    *id = (u32)(mesh->position_count - 1);
+  }
+  return *id;
+}
+
+static void quad(Mesh *mesh, const int c[4][3]) {
+  static const v2f uvs[4] = {{0, 1}, {1, 1}, {1, 0}, {0, 0}};
+  u32 first = (u32)mesh->vertex_count;
+  for (int i = 0; i < 4; i++) {
+    mesh_add_vertex(mesh, corner(mesh, c[i][0], c[i][1], c[i][2]), uvs[i]);
+  }
+  mesh_add_triangle(mesh, first, first + 1, first + 2, 0);
+  mesh_add_triangle(mesh, first, first + 2, first + 3, 0);
+}
+
+// Heightfield of voxel columns: a top quad per column plus the side quads
+// exposed by lower neighbours.
+static void build_terrain(Mesh *mesh) {
+  memset(corner_ids, 0xFF, sizeof(corner_ids));
+  for (int x = 0; x < GRID; x++) {
+    for (int z = 0; z < GRID; z++) {
+      heights[x][z] = 1 + (int)(rng_next() % MAX_HEIGHT);
+    }
+  }
+  for (int x = 0; x < GRID; x++) {
+    for (int z = 0; z < GRID; z++) {
+      int h = heights[x][z];
+      quad(mesh, (const int[4][3]){
+                     {x, h, z + 1}, {x + 1, h, z + 1}, {x + 1, h, z}, {x, h, z}});
+      for (int y = 0; y < h; y++) {
+        if (x + 1 >= GRID || heights[x + 1][z] <= y) {
+          quad(mesh, (const int[4][3]){{x + 1, y, z + 1},
+                                       {x + 1, y, z},
+                                       {x + 1, y + 1, z},
+                                       {x + 1, y + 1, z + 1}});
+        }
+        if (z + 1 >= GRID || heights[x][z + 1] <= y) {
+          quad(mesh, (const int[4][3]){{x, y, z + 1},
+                                       {x + 1, y, z + 1},
+                                       {x + 1, y + 1, z + 1},
+                                       {x, y + 1, z + 1}});
+        }
+      }
+    }
+  }
+}
+
+// The old per-face path: every corner of every triangle goes through the
+// model-view and projection matrices and is projected on its own.
+static float per_corner(const Mesh *mesh, mat4 mv, mat4 proj) {
+  float sink = 0.0f;
+  for (int i = 0; i < mesh->index_count; i++) {
+    v3f p = mesh->positions[mesh->vertices[mesh->indices[i]].pos];
+    v4f view = mat4_mul_v4(mv, (v4f){p.x, p.y, p.z, 1.0f});
+    v4f clip = mat4_mul_v4(proj, view);
+    if (clip.w == 0.0f) {
+      continue;
+    }
+    float inv_w = 1.0f / clip.w;
+    v2i s = norm_to_subpixel((v2f){clip.x * inv_w, clip.y * inv_w}, BENCH_W,
+                             BENCH_H);
+    sink += (float)s.x + 0.5f * (clip.z * inv_w + 1.0f);
+  }
+  return sink;
+}
+
+static double ms_since(Uint64 start) {
+  return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 /
+         (double)SDL_GetPerformanceFrequency();
+}
+
+int main(void) {
+  Mesh mesh = {0};
+  build_terrain(&mesh);
+  if (mesh.index_count == 0) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  mat4 view = mat4_look_at((v3f){GRID * 0.5f, 20.0f, GRID + 10.0f},
+                           (v3f){GRID * 0.5f, 0.0f, GRID * 0.5f},
+                           (v3f){0.0f, 1.0f, 0.0f});
+  mat4 proj = mat4_perspective(1.0f, (float)BENCH_W / BENCH_H, 0.1f, 200.0f);
+  mat4 mvp = mat4_mul(proj, view);
+
+  volatile float sink = 0.0f;
+  Uint64 start = SDL_GetPerformanceCounter();
+  for (int f = 0; f < BENCH_FRAMES; f++) {
+    sink += per_corner(&mesh, view, proj);
+  }
+  double old_ms = ms_since(start) / BENCH_FRAMES;
+
+  TransformCache cache = {0};
+  start = SDL_GetPerformanceCounter();
+  for (int f = 0; f < BENCH_FRAMES; f++) {
+    if (!mesh_transform(&mesh, mvp, BENCH_W, BENCH_H, &cache)) {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+    sink += cache.verts[f % mesh.position_count].depth;
+  }
+  double new_ms = ms_since(start) / BENCH_FRAMES;
+  (void)sink;
+
+  printf("triangles: %d, triangle corners: %d, unique positions: %d\n",
+         mesh.index_count / 3, mesh.index_count, mesh.position_count);
+  printf("per-corner:     %8.3f ms/frame\n", old_ms);
+  printf("mesh_transform: %8.3f ms/frame (%.2fx)\n", new_ms, old_ms / new_ms);
+
+  transform_cache_free(&cache);
+  mesh_free(&mesh);
+  return 0;
+}
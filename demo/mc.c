@@ -1,5 +1,10 @@
+#include "atlas.h"
 #include "colors.h"
+#include "jobs.h"
 #include "math.h"
+#include "mesh.h"
+#include "pipeline.h"
+#include "profiler.h"
 #include "render.h"
 #include "shapes.h"
 #include "text.h"
@@ -26,6 +31,15 @@
 #define JUMP_VELOCITY 6.0f
 #define WALK_SPEED 4.0f
 
+// The world is stored and meshed in CHUNK_SIZE^3 pieces, so editing a block
+// only remeshes the chunks that can see it.
+#define CHUNK_SIZE 16
+#define CHUNK_BLOCKS (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+#define CHUNK_CORNERS ((CHUNK_SIZE + 1) * (CHUNK_SIZE + 1) * (CHUNK_SIZE + 1))
+#define CHUNK_PAD (CHUNK_SIZE + 2) // a chunk plus a one block border
+// Chunks meshed in the background at once.
+#define MESH_JOB_COUNT 16
+
 typedef struct
 {
   u32 window_w;
@@ -59,22 +73,43 @@ typedef enum
 
 typedef struct
 {
-  Vertex3D v[3];
-  Texture *tex;
-} Face;
+  u8 blocks[CHUNK_BLOCKS]; // BlockType, indexed like block_index
+  Mesh mesh;               // world-space positions, drawn with the view mvp
+  int origin[3];           // grid coordinates of the first block
+  int size[3];             // blocks per axis, less than CHUNK_SIZE at edges
+  bool dirty;              // edited since its current mesh was started
+  bool meshing;            // a job is building its next mesh
+} Chunk;
+
+// Everything needed to mesh one chunk. The blocks are copied in on the
+// render thread, so a background job never reads blocks being edited.
+typedef struct
+{
+  u8 blocks[CHUNK_PAD * CHUNK_PAD * CHUNK_PAD]; // indexed like pad_index
+  int size[3];
+  v3f origin; // world position of the chunk's first grid corner
+  bool greedy;
+  Mesh mesh;                     // result, swapped into the chunk when done
+  u32 corner_ids[CHUNK_CORNERS]; // position index, UINT32_MAX if unused
+  BlockType mask[CHUNK_SIZE * CHUNK_SIZE]; // greedy slice
+} Mesher;
 
 typedef struct
 {
-  v3f view_pos;
-  v2f uv;
-} ClipVert;
+  Mesher mesher;
+  Chunk *chunk; // NULL while the slot is free; render thread only
+  SDL_atomic_t done;
+} MeshJob;
 
 typedef struct
 {
   Game game;
   Camera camera;
-  Texture dirt_tex;
-  Texture stone_tex;
+  S3DContext s3d;
+  Profiler profiler;
+  bool show_profiler;
+  S3DMaterial materials[4]; // indexed by BlockType
+  TextureAtlas block_atlas; // views: dirt, stone
   bool wireframe;
   bool noclip;
   float fps;
@@ -87,14 +122,19 @@ typedef struct
   int render_scale;
   float near_plane;
   float mouse_sens;
-  Face *faces;
-  int face_count;
-  int face_cap;
-  BlockType *blocks;
-  int size_x;
+  bool greedy; // merge coplanar faces into large quads
+  Chunk *chunks;
+  int chunks_x;
+  int chunks_y;
+  int chunks_z;
+  int size_x; // world size in blocks
   int size_y;
   int size_z;
-  bool mesh_dirty;
+  int triangle_count; // over every chunk mesh
+  int remesh_us;      // render thread time of the last frame that remeshed
+  int meshing_count;  // chunk jobs in flight
+  TaskQueue mesh_tasks;
+  MeshJob *mesh_jobs; // MESH_JOB_COUNT slots
 } Demo;
 
 static v3f camera_forward(const Camera *cam)
@@ -106,14 +146,6 @@ static v3f camera_forward(const Camera *cam)
   return v3_normalize((v3f){sy * cp, sp, -cy * cp});
 }
 
-static void clear_depth(float *depth, size_t count)
-{
-  for (size_t i = 0; i < count; i++)
-  {
-    depth[i] = 1.0f;
-  }
-}
-
 static void resize_render(Game *game, int window_w, int window_h,
                           int render_scale)
 {
@@ -141,51 +173,139 @@ static void resize_render(Game *game, int window_w, int window_h,
   }
 }
 
-static bool load_texture(Texture *tex, const char *path)
+// Packs the block textures into one atlas with a mip chain, so every chunk
+// samples a single block of memory and far blocks a smaller level of it.
+static bool load_block_textures(TextureAtlas *atlas)
 {
-  return texture_load(tex, path);
+  Texture dirt = {0}, stone = {0};
+  if (!texture_load(&dirt, "assets/dirt.webp") ||
+      !texture_load(&stone, "assets/stone.webp"))
+  {
+    texture_destroy(&dirt);
+    return false;
+  }
+  // Greedy quads span several blocks and tile the texture across them.
+  dirt.wrap = TEXTURE_REPEAT;
+  stone.wrap = TEXTURE_REPEAT;
+  const Texture *sources[] = {&dirt, &stone};
+  bool ok = atlas_build(atlas, sources, 2, TEXTURE_LINEAR);
+  texture_destroy(&dirt);
+  texture_destroy(&stone);
+  return ok;
 }
 
-static void add_face(Face *faces, int *count, Texture *tex, v3f p0, v3f p1,
-                     v3f p2, v3f p3)
+static inline int block_index(int x, int y, int z)
 {
-  faces[*count].v[0] = (Vertex3D){p0, {0.0f, 1.0f}};
-  faces[*count].v[1] = (Vertex3D){p1, {1.0f, 1.0f}};
-  faces[*count].v[2] = (Vertex3D){p2, {1.0f, 0.0f}};
-  faces[*count].tex = tex;
-  (*count)++;
-
-  faces[*count].v[0] = (Vertex3D){p0, {0.0f, 1.0f}};
-  faces[*count].v[1] = (Vertex3D){p2, {1.0f, 0.0f}};
-  faces[*count].v[2] = (Vertex3D){p3, {0.0f, 0.0f}};
-  faces[*count].tex = tex;
-  (*count)++;
+  return (y * CHUNK_SIZE + z) * CHUNK_SIZE + x;
 }
 
-static inline int block_index(const Demo *demo, int x, int y, int z)
+static inline Chunk *chunk_at(const Demo *demo, int x, int y, int z)
 {
-  return (y * demo->size_z + z) * demo->size_x + x;
+  if (x < 0 || x >= demo->size_x || y < 0 || y >= demo->size_y || z < 0 ||
+      z >= demo->size_z)
+  {
+    return NULL;
+  }
+  int cx = x / CHUNK_SIZE;
+  int cy = y / CHUNK_SIZE;
+  int cz = z / CHUNK_SIZE;
+  return &demo->chunks[(cy * demo->chunks_z + cz) * demo->chunks_x + cx];
 }
 
 static inline BlockType block_get(const Demo *demo, int x, int y, int z)
 {
-  if (x < 0 || x >= demo->size_x || y < 0 || y >= demo->size_y || z < 0 ||
-      z >= demo->size_z)
+  const Chunk *chunk = chunk_at(demo, x, y, z);
+  if (!chunk)
   {
     return BLOCK_AIR;
   }
-  return demo->blocks[block_index(demo, x, y, z)];
+  return (BlockType)chunk->blocks[block_index(
+      x % CHUNK_SIZE, y % CHUNK_SIZE, z % CHUNK_SIZE)];
+}
+
+static inline void mark_dirty(Demo *demo, int x, int y, int z)
+{
+  Chunk *chunk = chunk_at(demo, x, y, z);
+  if (chunk)
+  {
+    chunk->dirty = true;
+  }
 }
 
 static inline void block_set(Demo *demo, int x, int y, int z, BlockType t)
 {
-  if (x < 0 || x >= demo->size_x || y < 0 || y >= demo->size_y || z < 0 ||
-      z >= demo->size_z)
+  Chunk *chunk = chunk_at(demo, x, y, z);
+  if (!chunk)
   {
     return;
   }
-  demo->blocks[block_index(demo, x, y, z)] = t;
-  demo->mesh_dirty = true;
+  chunk->blocks[block_index(x % CHUNK_SIZE, y % CHUNK_SIZE, z % CHUNK_SIZE)] =
+      (u8)t;
+  // A block on a chunk border also shows or hides faces of the neighbour.
+  mark_dirty(demo, x, y, z);
+  mark_dirty(demo, x - 1, y, z);
+  mark_dirty(demo, x + 1, y, z);
+  mark_dirty(demo, x, y - 1, z);
+  mark_dirty(demo, x, y + 1, z);
+  mark_dirty(demo, x, y, z - 1);
+  mark_dirty(demo, x, y, z + 1);
+}
+
+// Index into Mesher.blocks of chunk-local block (x, y, z), each in
+// [-1, CHUNK_SIZE].
+static inline int pad_index(int x, int y, int z)
+{
+  return ((y + 1) * CHUNK_PAD + (z + 1)) * CHUNK_PAD + (x + 1);
+}
+
+// Position index of chunk-local grid corner (x, y, z), added on first use so
+// every face meeting at a corner shares one transformed position.
+static bool corner_position(Mesher *m, int x, int y, int z, u32 *out)
+{
+  u32 *id = &m->corner_ids[(y * (CHUNK_SIZE + 1) + z) * (CHUNK_SIZE + 1) + x];
+  if (*id == UINT32_MAX)
+  {
+    v3f pos = {m->origin.x + (float)x, m->origin.y - (float)y,
+               m->origin.z + (float)z};
+    if (!mesh_add_position(&m->mesh, pos))
+    {
+      return false;
+    }
+    *id = (u32)(m->mesh.position_count - 1);
+  }
+  *out = *id;
+  return true;
+}
+
+// Adds the quad spanning corners c[0..3] of the box at chunk-local cell
+// origin with size cells per axis, as two triangles. Corner bits: 1 = +x,
+// 2 = one block down, 4 = +z. The texture repeats once per block along each
+// side.
+static bool add_quad(Mesher *m, BlockType type, const int origin[3],
+                     const int size[3], const int c[4])
+{
+  static const v2f uvs[4] = {{0.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, 0.0f},
+                             {0.0f, 0.0f}};
+  // c0 -> c1 runs along u and c1 -> c2 along v; each flips a single bit,
+  // and bit >> 1 is that bit's axis.
+  float repeat_u = (float)size[(c[0] ^ c[1]) >> 1];
+  float repeat_v = (float)size[(c[1] ^ c[2]) >> 1];
+  u32 first = (u32)m->mesh.vertex_count;
+  for (int i = 0; i < 4; i++)
+  {
+    u32 pos;
+    v2f uv = {uvs[i].x * repeat_u, uvs[i].y * repeat_v};
+    if (!corner_position(m, origin[0] + (c[i] & 1) * size[0],
+                         origin[1] + ((c[i] >> 1) & 1) * size[1],
+                         origin[2] + ((c[i] >> 2) & 1) * size[2], &pos) ||
+        !mesh_add_vertex(&m->mesh, pos, uv))
+    {
+      return false;
+    }
+  }
+  return mesh_add_triangle(&m->mesh, first, first + 1, first + 2,
+                           (int)type) &&
+         mesh_add_triangle(&m->mesh, first, first + 2, first + 3, (int)type);
 }
 
 static void resolve_collisions(Demo *demo)
@@ -281,119 +401,336 @@ static void resolve_collisions(Demo *demo)
     }
   }
 }
-static void rebuild_faces(Demo *demo)
+// One side of a block: the grid axis it faces along (0 = x, 1 = y, which
+// grows downwards, 2 = z), the direction along it and its add_quad corners.
+typedef struct
 {
-  demo->face_count = 0;
-  const int max_faces = demo->size_x * demo->size_y * demo->size_z * 12;
-  if (!demo->faces || demo->face_cap < max_faces)
+  int axis;
+  int step;
+  int corners[4];
+} FaceDir;
+
+static const FaceDir face_dirs[6] = {
+    {1, -1, {4, 5, 1, 0}}, // top (+y in world)
+    {1, 1, {2, 3, 7, 6}},  // bottom (-y in world)
+    {2, 1, {6, 7, 5, 4}},  // front (+z)
+    {2, -1, {3, 2, 0, 1}}, // back (-z)
+    {0, -1, {2, 6, 4, 0}}, // left (-x)
+    {0, 1, {7, 3, 1, 5}},  // right (+x)
+};
+
+// Type of chunk-local block p when its face towards `face` is exposed, else
+// air.
+static BlockType exposed_face(const Mesher *m, const int p[3],
+                              const FaceDir *face)
+{
+  BlockType type = (BlockType)m->blocks[pad_index(p[0], p[1], p[2])];
+  if (type == BLOCK_AIR)
   {
-    free(demo->faces);
-    demo->faces = malloc((size_t)max_faces * sizeof(Face));
-    demo->face_cap = max_faces;
+    return BLOCK_AIR;
   }
+  int n[3] = {p[0], p[1], p[2]};
+  n[face->axis] += face->step;
+  return m->blocks[pad_index(n[0], n[1], n[2])] == BLOCK_AIR ? type
+                                                             : BLOCK_AIR;
+}
 
-#define IS_SOLID(ix, iy, iz) (block_get(demo, (ix), (iy), (iz)) != BLOCK_AIR)
+// Two triangles per exposed block face.
+static bool mesh_faces(Mesher *m)
+{
+  static const int unit[3] = {1, 1, 1};
+  for (int x = 0; x < m->size[0]; x++)
+  {
+    for (int z = 0; z < m->size[2]; z++)
+    {
+      for (int y = 0; y < m->size[1]; y++)
+      {
+        const int p[3] = {x, y, z};
+        for (int f = 0; f < 6; f++)
+        {
+          BlockType type = exposed_face(m, p, &face_dirs[f]);
+          if (type != BLOCK_AIR &&
+              !add_quad(m, type, p, unit, face_dirs[f].corners))
+          {
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
 
-  for (int x = 0; x < demo->size_x; x++)
+// Merges exposed faces of the same type lying in one plane into rectangles:
+// each slice of blocks along a face's axis gets a mask of exposed faces,
+// which is swept row by row, growing every unvisited face first along the
+// row and then over as many following rows as match in full.
+static bool mesh_greedy(Mesher *m)
+{
+  const int *dims = m->size;
+  BlockType *mask = m->mask;
+  for (int f = 0; f < 6; f++)
   {
-    for (int z = 0; z < demo->size_z; z++)
+    const FaceDir *face = &face_dirs[f];
+    int a = face->axis;
+    int u = (a + 1) % 3;
+    int v = (a + 2) % 3;
+    for (int slice = 0; slice < dims[a]; slice++)
     {
-      for (int y = 0; y < demo->size_y; y++)
+      for (int j = 0; j < dims[v]; j++)
       {
-        BlockType type = block_get(demo, x, y, z);
-        if (type == BLOCK_AIR)
+        for (int i = 0; i < dims[u]; i++)
         {
-          continue;
+          int p[3];
+          p[a] = slice;
+          p[u] = i;
+          p[v] = j;
+          mask[j * dims[u] + i] = exposed_face(m, p, face);
         }
+      }
 
-        Texture *tex = (type == BLOCK_DIRT) ? &demo->dirt_tex : &demo->stone_tex;
+      for (int j = 0; j < dims[v]; j++)
+      {
+        for (int i = 0; i < dims[u];)
+        {
+          BlockType type = mask[j * dims[u] + i];
+          if (type == BLOCK_AIR)
+          {
+            i++;
+            continue;
+          }
+          int w = 1;
+          while (i + w < dims[u] && mask[j * dims[u] + i + w] == type)
+          {
+            w++;
+          }
+          int h = 1;
+          for (; j + h < dims[v]; h++)
+          {
+            const BlockType *row = &mask[(j + h) * dims[u] + i];
+            int k = 0;
+            while (k < w && row[k] == type)
+            {
+              k++;
+            }
+            if (k < w)
+            {
+              break;
+            }
+          }
+          for (int dj = 0; dj < h; dj++)
+          {
+            for (int di = 0; di < w; di++)
+            {
+              mask[(j + dj) * dims[u] + i + di] = BLOCK_AIR;
+            }
+          }
 
-        float bx = (float)x - (demo->size_x * 0.5f) + 0.5f;
-        float by = -(float)y - 0.5f;
-        float bz = (float)z - (demo->size_z * 0.5f) + 0.5f;
+          int origin[3], size[3];
+          origin[a] = slice;
+          origin[u] = i;
+          origin[v] = j;
+          size[a] = 1;
+          size[u] = w;
+          size[v] = h;
+          if (!add_quad(m, type, origin, size, face->corners))
+          {
+            return false;
+          }
+          i += w;
+        }
+      }
+    }
+  }
+  return true;
+}
 
-        float x0 = bx - 0.5f, x1 = bx + 0.5f;
-        float y0 = by - 0.5f, y1 = by + 0.5f;
-        float z0 = bz - 0.5f, z1 = bz + 0.5f;
+// TaskFn run on a background thread.
+static void mesh_chunk_job(void *user)
+{
+  MeshJob *job = user;
+  Mesher *m = &job->mesher;
+  mesh_clear(&m->mesh);
+  memset(m->corner_ids, 0xFF, sizeof(m->corner_ids));
+  bool ok = m->greedy ? mesh_greedy(m) : mesh_faces(m);
+  if (!ok)
+  {
+    SDL_Log("Failed to allocate voxel mesh");
+    mesh_clear(&m->mesh);
+  }
+  SDL_AtomicSet(&job->done, 1);
+}
 
-        if (!IS_SOLID(x, y - 1, z))
-        { // top (+y in world)
-          add_face(demo->faces, &demo->face_count, tex,
-                   (v3f){x0, y1, z1}, (v3f){x1, y1, z1}, (v3f){x1, y1, z0},
-                   (v3f){x0, y1, z0});
-        }
-        if (!IS_SOLID(x, y + 1, z))
-        { // bottom (-y in world)
-          add_face(demo->faces, &demo->face_count, tex,
-                   (v3f){x0, y0, z0}, (v3f){x1, y0, z0}, (v3f){x1, y0, z1},
-                   (v3f){x0, y0, z1});
-        }
-        if (!IS_SOLID(x, y, z + 1))
-        { // front (+z)
-          add_face(demo->faces, &demo->face_count, tex,
-                   (v3f){x0, y0, z1}, (v3f){x1, y0, z1}, (v3f){x1, y1, z1},
-                   (v3f){x0, y1, z1});
-        }
-        if (!IS_SOLID(x, y, z - 1))
-        { // back (-z)
-          add_face(demo->faces, &demo->face_count, tex,
-                   (v3f){x1, y0, z0}, (v3f){x0, y0, z0}, (v3f){x0, y1, z0},
-                   (v3f){x1, y1, z0});
-        }
-        if (!IS_SOLID(x - 1, y, z))
-        { // left (-x)
-          add_face(demo->faces, &demo->face_count, tex,
-                   (v3f){x0, y0, z0}, (v3f){x0, y0, z1}, (v3f){x0, y1, z1},
-                   (v3f){x0, y1, z0});
-        }
-        if (!IS_SOLID(x + 1, y, z))
-        { // right (+x)
-          add_face(demo->faces, &demo->face_count, tex,
-                   (v3f){x1, y0, z1}, (v3f){x1, y0, z0}, (v3f){x1, y1, z0},
-                   (v3f){x1, y1, z1});
-        }
+// Copies the chunk and the blocks bordering it into the mesher.
+static void snapshot_chunk(const Demo *demo, const Chunk *chunk, Mesher *m)
+{
+  const int *o = chunk->origin;
+  for (int y = -1; y <= CHUNK_SIZE; y++)
+  {
+    for (int z = -1; z <= CHUNK_SIZE; z++)
+    {
+      // Rows come whole from whichever chunk holds them; blocks past the
+      // world edge are stored as air, so only the two ends need a lookup.
+      u8 *row = &m->blocks[pad_index(0, y, z)];
+      const Chunk *src = chunk_at(demo, o[0], o[1] + y, o[2] + z);
+      if (src)
+      {
+        memcpy(row,
+               &src->blocks[block_index(0, (o[1] + y) % CHUNK_SIZE,
+                                        (o[2] + z) % CHUNK_SIZE)],
+               CHUNK_SIZE);
+      }
+      else
+      {
+        memset(row, BLOCK_AIR, CHUNK_SIZE);
       }
+      row[-1] = (u8)block_get(demo, o[0] - 1, o[1] + y, o[2] + z);
+      row[CHUNK_SIZE] =
+          (u8)block_get(demo, o[0] + CHUNK_SIZE, o[1] + y, o[2] + z);
     }
   }
-#undef IS_SOLID
-  demo->mesh_dirty = false;
+  for (int k = 0; k < 3; k++)
+  {
+    m->size[k] = chunk->size[k];
+  }
+  m->origin = (v3f){(float)o[0] - demo->size_x * 0.5f, -(float)o[1],
+                    (float)o[2] - demo->size_z * 0.5f};
+  m->greedy = demo->greedy;
 }
 
-static bool project_vertex(const ClipVert *cv, const mat4 *proj, int render_w,
-                           int render_h, VertexPC *out, int *mask_out)
+// Called at frame start: swaps finished meshes into their chunks, so a frame
+// always draws complete meshes, then hands dirty chunks to free job slots.
+// Returns the number of chunks touched.
+static int update_chunks(Demo *demo)
 {
-  v4f clip = mat4_mul_v4(*proj,
-                         (v4f){cv->view_pos.x, cv->view_pos.y, cv->view_pos.z,
-                               1.0f});
-  if (clip.w == 0.0f)
+  int touched = 0;
+  for (int i = 0; i < MESH_JOB_COUNT; i++)
   {
-    return false;
+    MeshJob *job = &demo->mesh_jobs[i];
+    if (job->chunk && SDL_AtomicGet(&job->done))
+    {
+      // The chunk's old mesh storage goes back to the slot for reuse.
+      Mesh old = job->chunk->mesh;
+      job->chunk->mesh = job->mesher.mesh;
+      job->mesher.mesh = old;
+      job->chunk->meshing = false;
+      job->chunk = NULL;
+      demo->meshing_count--;
+      touched++;
+    }
   }
 
-  int mask = 0;
-  if (clip.x < -clip.w)
-    mask |= 1;
-  if (clip.x > clip.w)
-    mask |= 2;
-  if (clip.y < -clip.w)
-    mask |= 4;
-  if (clip.y > clip.w)
-    mask |= 8;
-  if (clip.z < 0.0f)
-    mask |= 16;
-  if (clip.z > clip.w)
-    mask |= 32;
-
-  float inv_w = 1.0f / clip.w;
-  v3f ndc = {clip.x * inv_w, clip.y * inv_w, clip.z * inv_w};
-  out->pos = norm_to_screen((v2f){ndc.x, ndc.y}, render_w, render_h);
-  out->uv = cv->uv;
-  out->inv_w = inv_w;
-  out->depth = 0.5f * (ndc.z + 1.0f);
-  *mask_out = mask;
+  int chunk_count = demo->chunks_x * demo->chunks_y * demo->chunks_z;
+  int slot = 0;
+  for (int i = 0; i < chunk_count; i++)
+  {
+    Chunk *chunk = &demo->chunks[i];
+    // A chunk edited mid-job waits for that job, then goes again.
+    if (!chunk->dirty || chunk->meshing)
+    {
+      continue;
+    }
+    while (slot < MESH_JOB_COUNT && demo->mesh_jobs[slot].chunk)
+    {
+      slot++;
+    }
+    if (slot == MESH_JOB_COUNT)
+    {
+      break;
+    }
+    MeshJob *job = &demo->mesh_jobs[slot];
+    snapshot_chunk(demo, chunk, &job->mesher);
+    job->chunk = chunk;
+    SDL_AtomicSet(&job->done, 0);
+    chunk->dirty = false;
+    chunk->meshing = true;
+    demo->meshing_count++;
+    if (!task_queue_push(&demo->mesh_tasks, mesh_chunk_job, job))
+    {
+      mesh_chunk_job(job);
+    }
+    touched++;
+  }
+  return touched;
+}
+
+static void mark_all_dirty(Demo *demo)
+{
+  int chunk_count = demo->chunks_x * demo->chunks_y * demo->chunks_z;
+  for (int i = 0; i < chunk_count; i++)
+  {
+    demo->chunks[i].dirty = true;
+  }
+}
+
+// Allocates empty chunks covering size_x * size_y * size_z blocks and the
+// background meshing jobs.
+static bool world_init(Demo *demo)
+{
+  demo->chunks_x = (demo->size_x + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  demo->chunks_y = (demo->size_y + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  demo->chunks_z = (demo->size_z + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  int chunk_count = demo->chunks_x * demo->chunks_y * demo->chunks_z;
+  demo->chunks = calloc((size_t)chunk_count, sizeof(Chunk));
+  demo->mesh_jobs = calloc(MESH_JOB_COUNT, sizeof(MeshJob));
+  // Two threads keep up with edits without starving the rasterizer's pool.
+  if (!demo->chunks || !demo->mesh_jobs ||
+      !task_queue_init(&demo->mesh_tasks, MESH_JOB_COUNT, 2))
+  {
+    SDL_Log("Failed to allocate world");
+    free(demo->chunks);
+    free(demo->mesh_jobs);
+    demo->chunks = NULL;
+    demo->mesh_jobs = NULL;
+    return false;
+  }
+  const int world[3] = {demo->size_x, demo->size_y, demo->size_z};
+  for (int cy = 0; cy < demo->chunks_y; cy++)
+  {
+    for (int cz = 0; cz < demo->chunks_z; cz++)
+    {
+      for (int cx = 0; cx < demo->chunks_x; cx++)
+      {
+        Chunk *chunk =
+            &demo->chunks[(cy * demo->chunks_z + cz) * demo->chunks_x + cx];
+        const int cell[3] = {cx, cy, cz};
+        for (int k = 0; k < 3; k++)
+        {
+          chunk->origin[k] = cell[k] * CHUNK_SIZE;
+          chunk->size[k] = world[k] - chunk->origin[k];
+          if (chunk->size[k] > CHUNK_SIZE)
+            chunk->size[k] = CHUNK_SIZE;
+        }
+        chunk->dirty = true;
+      }
+    }
+  }
   return true;
 }
 
+static void world_free(Demo *demo)
+{
+  if (!demo->chunks)
+  {
+    return;
+  }
+  // Finishes the jobs in flight before their chunks go away.
+  task_queue_destroy(&demo->mesh_tasks);
+  for (int i = 0; i < MESH_JOB_COUNT; i++)
+  {
+    mesh_free(&demo->mesh_jobs[i].mesher.mesh);
+  }
+  int chunk_count = demo->chunks_x * demo->chunks_y * demo->chunks_z;
+  for (int i = 0; i < chunk_count; i++)
+  {
+    mesh_free(&demo->chunks[i].mesh);
+  }
+  free(demo->mesh_jobs);
+  free(demo->chunks);
+  demo->mesh_jobs = NULL;
+  demo->chunks = NULL;
+}
+
 static bool raycast_block(Demo *demo, v3f origin, v3f dir, float max_dist,
                           int *hx, int *hy, int *hz, v3f *hnormal)
 {
@@ -500,8 +837,8 @@ static bool demo_init(Demo *demo)
   demo->camera = (Camera){.pos = {0.0f, 1.5f, 6.0f}, .yaw = 0.0f, .pitch = 0.0f};
   resize_render(&demo->game, (int)demo->game.window_w,
                 (int)demo->game.window_h, demo->render_scale);
-  demo->size_x = 16;
-  demo->size_z = 16;
+  demo->size_x = 64;
+  demo->size_z = 64;
   demo->size_y = 3;
 
   if (SDL_Init(SDL_INIT_VIDEO) != 0)
@@ -518,8 +855,7 @@ static bool demo_init(Demo *demo)
     return false;
   }
 
-  if (!load_texture(&demo->dirt_tex, "assets/dirt.webp") ||
-      !load_texture(&demo->stone_tex, "assets/stone.webp"))
+  if (!load_block_textures(&demo->block_atlas))
   {
     IMG_Quit();
     SDL_Quit();
@@ -534,8 +870,7 @@ static bool demo_init(Demo *demo)
   if (demo->game.window == NULL)
   {
     SDL_Log("Failed to create Window: %s\n", SDL_GetError());
-    texture_destroy(&demo->dirt_tex);
-    texture_destroy(&demo->stone_tex);
+    atlas_destroy(&demo->block_atlas);
     IMG_Quit();
     SDL_Quit();
     return false;
@@ -548,8 +883,7 @@ static bool demo_init(Demo *demo)
   {
     SDL_Log("Failed to create Renderer: %s\n", SDL_GetError());
     SDL_DestroyWindow(demo->game.window);
-    texture_destroy(&demo->dirt_tex);
-    texture_destroy(&demo->stone_tex);
+    atlas_destroy(&demo->block_atlas);
     IMG_Quit();
     SDL_Quit();
     return false;
@@ -568,8 +902,16 @@ static bool demo_init(Demo *demo)
   demo->last_ticks = SDL_GetTicks();
   demo->running = true;
 
-  int block_count = demo->size_x * demo->size_y * demo->size_z;
-  demo->blocks = malloc((size_t)block_count * sizeof(BlockType));
+  demo->greedy = true;
+  if (!world_init(demo))
+  {
+    SDL_DestroyRenderer(demo->game.renderer);
+    SDL_DestroyWindow(demo->game.window);
+    atlas_destroy(&demo->block_atlas);
+    IMG_Quit();
+    SDL_Quit();
+    return false;
+  }
   for (int x = 0; x < demo->size_x; x++)
   {
     for (int z = 0; z < demo->size_z; z++)
@@ -580,22 +922,30 @@ static bool demo_init(Demo *demo)
       }
     }
   }
-  rebuild_faces(demo);
+  demo->materials[BLOCK_GRASS].texture = &demo->block_atlas.views[1];
+  demo->materials[BLOCK_DIRT].texture = &demo->block_atlas.views[0];
+  demo->materials[BLOCK_STONE].texture = &demo->block_atlas.views[1];
+  if (!s3d_init(&demo->s3d, 0))
+  {
+    world_free(demo);
+    SDL_DestroyRenderer(demo->game.renderer);
+    SDL_DestroyWindow(demo->game.window);
+    atlas_destroy(&demo->block_atlas);
+    IMG_Quit();
+    SDL_Quit();
+    return false;
+  }
+  profiler_init(&demo->profiler);
+  demo->s3d.profiler = &demo->profiler;
+  demo->s3d.reuse_depth = true;
   return true;
 }
 
 static void demo_shutdown(Demo *demo)
 {
-  if (demo->faces)
-  {
-    free(demo->faces);
-    demo->faces = NULL;
-  }
-  if (demo->blocks)
-  {
-    free(demo->blocks);
-    demo->blocks = NULL;
-  }
+  s3d_destroy(&demo->s3d);
+  profiler_destroy(&demo->profiler);
+  world_free(demo);
   if (demo->game.buffer)
   {
     free(demo->game.buffer);
@@ -606,8 +956,7 @@ static void demo_shutdown(Demo *demo)
     free(demo->game.depth);
     demo->game.depth = NULL;
   }
-  texture_destroy(&demo->dirt_tex);
-  texture_destroy(&demo->stone_tex);
+  atlas_destroy(&demo->block_atlas);
   if (demo->game.texture)
   {
     SDL_DestroyTexture(demo->game.texture);
@@ -640,7 +989,7 @@ static void demo_handle_event(Demo *demo, const SDL_Event *event)
     {
       resize_render(&demo->game, event->window.data1, event->window.data2,
                     demo->render_scale);
-      demo->mesh_dirty = true;
+      s3d_invalidate_depth(&demo->s3d);
     }
     break;
   case SDL_MOUSEMOTION:
@@ -665,6 +1014,19 @@ static void demo_handle_event(Demo *demo, const SDL_Event *event)
     {
       demo->wireframe = !demo->wireframe;
     }
+    if (event->key.keysym.sym == SDLK_g)
+    {
+      demo->greedy = !demo->greedy;
+      mark_all_dirty(demo);
+    }
+    if (event->key.keysym.sym == SDLK_p)
+    {
+      demo->show_profiler = !demo->show_profiler;
+    }
+    if (event->key.keysym.sym == SDLK_t)
+    {
+      profiler_start_trace(&demo->profiler, "trace.json", 120);
+    }
     if (event->key.keysym.sym == SDLK_q)
     {
       game->mouse_grabbed = !game->mouse_grabbed;
@@ -682,6 +1044,7 @@ static void demo_handle_event(Demo *demo, const SDL_Event *event)
         int w, h;
         SDL_GetWindowSize(game->window, &w, &h);
         resize_render(&demo->game, w, h, demo->render_scale);
+        s3d_invalidate_depth(&demo->s3d);
       }
     }
     break;
@@ -834,11 +1197,15 @@ static void demo_frame(Demo *demo, Uint32 now, float dt)
   resolve_collisions(demo);
 }
 
-  memset(game->buffer, 0, game->render_w * game->render_h * sizeof(u32));
-  clear_depth(game->depth, (size_t)game->render_w * (size_t)game->render_h);
-  if (demo->mesh_dirty)
+  s3d_begin(&demo->s3d, game->buffer, game->depth, (int)game->render_w,
+            (int)game->render_h);
+  s3d_clear(&demo->s3d, 0);
+  Uint64 remesh_start = SDL_GetPerformanceCounter();
+  if (update_chunks(demo) > 0)
   {
-    rebuild_faces(demo);
+    demo->remesh_us =
+        (int)((SDL_GetPerformanceCounter() - remesh_start) * 1000000 /
+              SDL_GetPerformanceFrequency());
   }
 
   float aspect = (float)game->render_w / (float)game->render_h;
@@ -848,213 +1215,25 @@ static void demo_frame(Demo *demo, Uint32 now, float dt)
       v3_add(demo->camera.pos, camera_forward(&demo->camera)), world_up);
   mat4 proj = mat4_perspective((float)M_PI / 3.0f, aspect, demo->near_plane,
                                100.0f);
-  mat4 mv = mat4_mul(view, model);
+  mat4 mvp = mat4_mul(proj, mat4_mul(view, model));
 
-  typedef struct
+  demo->s3d.wireframe = demo->wireframe;
+  demo->triangle_count = 0;
+  int chunk_count = demo->chunks_x * demo->chunks_y * demo->chunks_z;
+  for (int i = 0; i < chunk_count; i++)
   {
-    v2i screen;
-    v2f uv;
-    v3f view_pos;
-    float inv_w;
-    float depth;
-    int clip_mask;
-    bool depth_ok;
-  } CachedVertex;
-  CachedVertex tri[3];
-
-  for (int i = 0; i < demo->face_count; i++)
-  {
-    Face *face = &demo->faces[i];
-    bool skip = false;
-    for (int j = 0; j < 3; j++)
-    {
-      v4f world = {face->v[j].pos.x, face->v[j].pos.y, face->v[j].pos.z,
-                   1.0f};
-      v4f view_pos4 = mat4_mul_v4(mv, world);
-      v4f clip = mat4_mul_v4(proj, view_pos4);
-
-      tri[j].uv = face->v[j].uv;
-      tri[j].view_pos = (v3f){view_pos4.x, view_pos4.y, view_pos4.z};
-
-      int mask = 0;
-      if (clip.w == 0.0f)
-      {
-        tri[j].clip_mask = 0x3F; // force cull
-        tri[j].depth_ok = false;
-        skip = true;
-        break;
-      }
-      if (clip.x < -clip.w)
-        mask |= 1;
-      if (clip.x > clip.w)
-        mask |= 2;
-      if (clip.y < -clip.w)
-        mask |= 4;
-      if (clip.y > clip.w)
-        mask |= 8;
-      if (clip.z < 0.0f)
-        mask |= 16;
-      if (clip.z > clip.w)
-        mask |= 32;
-      tri[j].clip_mask = mask;
-
-      float inv_w = 1.0f / clip.w;
-      tri[j].inv_w = inv_w;
-      v3f ndc = {clip.x * inv_w, clip.y * inv_w, clip.z * inv_w};
-      tri[j].depth_ok = ndc.z >= 0.0f && ndc.z <= 1.0f;
-      tri[j].screen =
-          norm_to_screen((v2f){ndc.x, ndc.y}, game->render_w, game->render_h);
-      tri[j].depth = 0.5f * (ndc.z + 1.0f);
-    }
-    if (skip)
-    {
-      continue;
-    }
-
-    if ((tri[0].clip_mask & tri[1].clip_mask & tri[2].clip_mask) != 0)
-    {
-      demo->culled_faces_count++;
-      continue; // frustum culled
-    }
-
-    bool near_in[3] = {tri[0].view_pos.z <= -demo->near_plane,
-                       tri[1].view_pos.z <= -demo->near_plane,
-                       tri[2].view_pos.z <= -demo->near_plane};
-    bool needs_clip = !(near_in[0] && near_in[1] && near_in[2]);
-
-    if (!needs_clip)
-    {
-      if (!tri[0].depth_ok || !tri[1].depth_ok || !tri[2].depth_ok)
-      {
-        continue;
-      }
-      v3f edge1 = v3_sub(tri[1].view_pos, tri[0].view_pos);
-      v3f edge2 = v3_sub(tri[2].view_pos, tri[0].view_pos);
-      v3f normal = v3_cross(edge1, edge2);
-      if (v3_dot(normal, tri[0].view_pos) >= 0.0f)
-      {
-        continue;
-      }
-      VertexPC pv[3] = {
-          {.pos = tri[0].screen, .uv = tri[0].uv, .inv_w = tri[0].inv_w, .depth = tri[0].depth},
-          {.pos = tri[1].screen, .uv = tri[1].uv, .inv_w = tri[1].inv_w, .depth = tri[1].depth},
-          {.pos = tri[2].screen, .uv = tri[2].uv, .inv_w = tri[2].inv_w, .depth = tri[2].depth},
-      };
-
-      if (demo->wireframe)
-      {
-        draw_triangle(game->buffer, game->render_w, game->render_h, pv[0].pos,
-                      pv[1].pos, pv[2].pos, WHITE, WIREFRAME);
-      }
-      else
-      {
-        draw_textured_triangle(game->buffer, game->depth, game->render_w,
-                               game->render_h, face->tex, pv[0], pv[1], pv[2]);
-      }
-      demo->rendered_faces_count++;
-    }
-    else
+    const Mesh *mesh = &demo->chunks[i].mesh;
+    if (mesh->index_count > 0)
     {
-      ClipVert in_poly[4] = {
-          {.view_pos = tri[0].view_pos, .uv = tri[0].uv},
-          {.view_pos = tri[1].view_pos, .uv = tri[1].uv},
-          {.view_pos = tri[2].view_pos, .uv = tri[2].uv},
-      };
-      int in_count = 3;
-      ClipVert out_poly[4];
-      int out_count = 0;
-
-      for (int v = 0; v < in_count; v++)
-      {
-        ClipVert a = in_poly[v];
-        ClipVert b = in_poly[(v + 1) % in_count];
-        bool a_in = a.view_pos.z <= -demo->near_plane;
-        bool b_in = b.view_pos.z <= -demo->near_plane;
-
-        if (a_in && b_in)
-        {
-          out_poly[out_count++] = b;
-        }
-        else if (a_in && !b_in)
-        {
-          float t = (-demo->near_plane - a.view_pos.z) /
-                    (b.view_pos.z - a.view_pos.z);
-          ClipVert inter = {
-              .view_pos = {a.view_pos.x + (b.view_pos.x - a.view_pos.x) * t,
-                           a.view_pos.y + (b.view_pos.y - a.view_pos.y) * t,
-                           -demo->near_plane},
-              .uv = {a.uv.x + (b.uv.x - a.uv.x) * t,
-                     a.uv.y + (b.uv.y - a.uv.y) * t}};
-          out_poly[out_count++] = inter;
-        }
-        else if (!a_in && b_in)
-        {
-          float t = (-demo->near_plane - a.view_pos.z) /
-                    (b.view_pos.z - a.view_pos.z);
-          ClipVert inter = {
-              .view_pos = {a.view_pos.x + (b.view_pos.x - a.view_pos.x) * t,
-                           a.view_pos.y + (b.view_pos.y - a.view_pos.y) * t,
-                           -demo->near_plane},
-              .uv = {a.uv.x + (b.uv.x - a.uv.x) * t,
-                     a.uv.y + (b.uv.y - a.uv.y) * t}};
-          out_poly[out_count++] = inter;
-          out_poly[out_count++] = b;
-        }
-      }
-
-      if (out_count < 3)
-      {
-        continue;
-      }
-
-      int tri_sets[2][3] = {{0, 1, 2}, {0, 2, 3}};
-      int tri_total = (out_count == 4) ? 2 : 1;
-
-      for (int t = 0; t < tri_total; t++)
-      {
-        ClipVert *a = &out_poly[tri_sets[t][0]];
-        ClipVert *b = &out_poly[tri_sets[t][1]];
-        ClipVert *c = &out_poly[tri_sets[t][2]];
-
-        v3f edge1 = v3_sub(b->view_pos, a->view_pos);
-        v3f edge2 = v3_sub(c->view_pos, a->view_pos);
-        v3f normal = v3_cross(edge1, edge2);
-        if (v3_dot(normal, a->view_pos) >= 0.0f)
-        {
-          continue;
-        }
-
-        VertexPC pv[3];
-        int masks[3];
-        if (!project_vertex(a, &proj, game->render_w, game->render_h, &pv[0],
-                            &masks[0]) ||
-            !project_vertex(b, &proj, game->render_w, game->render_h, &pv[1],
-                            &masks[1]) ||
-            !project_vertex(c, &proj, game->render_w, game->render_h, &pv[2],
-                            &masks[2]))
-        {
-          continue;
-        }
-        if ((masks[0] & masks[1] & masks[2]) != 0)
-        {
-          continue;
-        }
-
-        if (demo->wireframe)
-        {
-          draw_triangle(game->buffer, game->render_w, game->render_h, pv[0].pos,
-                        pv[1].pos, pv[2].pos, WHITE, WIREFRAME);
-        }
-        else
-        {
-          draw_textured_triangle(game->buffer, game->depth, game->render_w,
-                                 game->render_h, face->tex, pv[0], pv[1], pv[2]);
-        }
-        demo->rendered_faces_count++;
-      }
+      s3d_draw_mesh(&demo->s3d, mesh, mvp, demo->materials);
+      demo->triangle_count += mesh->index_count / 3;
     }
   }
+  s3d_end(&demo->s3d);
+  demo->culled_faces_count = demo->s3d.stats.culled;
+  demo->rendered_faces_count = demo->s3d.stats.drawn;
 
+  Uint64 hud_start = profiler_begin(&demo->profiler);
   char fps_text[32];
   snprintf(fps_text, sizeof(fps_text), "FPS: %d", (int)(demo->fps + 0.5f));
   draw_text(game->buffer, game->render_w, (v2i){5, 5}, fps_text, WHITE);
@@ -1067,6 +1246,23 @@ static void demo_frame(Demo *demo, Uint32 now, float dt)
   snprintf(rendered_text, sizeof(rendered_text), "RENDERED FACES: %d", demo->rendered_faces_count);
   draw_text(game->buffer, game->render_w, (v2i){5, 35}, rendered_text, WHITE);
 
+  char mesh_text[256];
+  snprintf(mesh_text, sizeof(mesh_text), "%s MESH: %d TRIANGLES",
+           demo->greedy ? "GREEDY" : "PER FACE", demo->triangle_count);
+  draw_text(game->buffer, game->render_w, (v2i){5, 50}, mesh_text, WHITE);
+
+  char chunk_text[64];
+  snprintf(chunk_text, sizeof(chunk_text), "VISIBLE CHUNKS: %d OF %d",
+           demo->s3d.stats.meshes - demo->s3d.stats.meshes_culled,
+           demo->s3d.stats.meshes);
+  draw_text(game->buffer, game->render_w, (v2i){5, 65}, chunk_text, WHITE);
+
+  char remesh_text[64];
+  snprintf(remesh_text, sizeof(remesh_text),
+           "CHUNK UPDATE: %d US  MESHING: %d", demo->remesh_us,
+           demo->meshing_count);
+  draw_text(game->buffer, game->render_w, (v2i){5, 80}, remesh_text, WHITE);
+
   // Crosshair at the render center
   v2i center = {(int)(game->render_w / 2), (int)(game->render_h / 2)};
   int len = 6;
@@ -1076,12 +1272,21 @@ static void demo_frame(Demo *demo, Uint32 now, float dt)
   draw_linei(game->buffer, game->render_w, game->render_h,
              (v2i){center.x, center.y - len}, (v2i){center.x, center.y + len},
              WHITE);
+  if (demo->show_profiler)
+  {
+    profiler_draw(&demo->profiler, game->buffer, (int)game->render_w,
+                  (int)game->render_h, (v2i){(int)game->render_w - 150, 5},
+                  WHITE);
+  }
+  profiler_end(&demo->profiler, PROF_HUD, hud_start);
 
+  Uint64 present_start = profiler_begin(&demo->profiler);
   SDL_UpdateTexture(game->texture, NULL, game->buffer, game->pitch);
   SDL_RenderClear(game->renderer);
   SDL_Rect dest = {0, 0, (int)game->window_w, (int)game->window_h};
   SDL_RenderCopy(game->renderer, game->texture, NULL, &dest);
   SDL_RenderPresent(game->renderer);
+  profiler_end(&demo->profiler, PROF_PRESENT, present_start);
 }
 
 int main(void)
@@ -1107,12 +1312,14 @@ int main(void)
       mc.fps = mc.fps * 0.9f + inst * 0.1f;
     }
 
+    profiler_begin_frame(&mc.profiler);
     while (SDL_PollEvent(&mc.game.event))
     {
       demo_handle_event(&mc, &mc.game.event);
     }
 
     demo_frame(&mc, now, dt);
+    profiler_end_frame(&mc.profiler);
   }
 
   demo_shutdown(&mc);
@@ -1,6 +1,11 @@
+#include "assets.h"
+#include "atlas.h"
 #include "colors.h"
 #include "math.h"
+#include "mesh.h"
 #include "obj_loader.h"
+#include "pipeline.h"
+#include "profiler.h"
 #include "render.h"
 #include "shapes.h"
 #include "text.h"
@@ -45,8 +50,14 @@ typedef struct {
 typedef struct {
   Game game;
   Camera camera;
-  ObjModel model;
-  Texture fallback_tex;
+  S3DContext s3d;
+  Profiler profiler;
+  bool show_profiler;
+  AssetManager assets;
+  AssetHandle model_asset;
+  const ObjModel *model;  // the materials were built for, see model_loaded
+  S3DMaterial *materials; // one per model material
+  TextureAtlas atlas;     // view 0: white, for materials without a texture
   bool wireframe;
   float fps;
   Uint32 last_ticks;
@@ -59,43 +70,6 @@ typedef struct {
   v3f model_pos;
 } ModelDemo;
 
-typedef struct {
-  v3f view_pos;
-  v2f uv;
-} ClipVert;
-
-static bool project_vertex(const ClipVert *cv, const mat4 *proj, int render_w,
-                           int render_h, VertexPC *out, int *mask_out) {
-  v4f clip = mat4_mul_v4(
-      *proj, (v4f){cv->view_pos.x, cv->view_pos.y, cv->view_pos.z, 1.0f});
-  if (clip.w == 0.0f) {
-    return false;
-  }
-
-  int mask = 0;
-  if (clip.x < -clip.w)
-    mask |= 1;
-  if (clip.x > clip.w)
-    mask |= 2;
-  if (clip.y < -clip.w)
-    mask |= 4;
-  if (clip.y > clip.w)
-    mask |= 8;
-  if (clip.z < 0.0f)
-    mask |= 16;
-  if (clip.z > clip.w)
-    mask |= 32;
-
-  float inv_w = 1.0f / clip.w;
-  v3f ndc = {clip.x * inv_w, clip.y * inv_w, clip.z * inv_w};
-  out->pos = norm_to_screen((v2f){ndc.x, ndc.y}, render_w, render_h);
-  out->uv = cv->uv;
-  out->inv_w = inv_w;
-  out->depth = 0.5f * (ndc.z + 1.0f);
-  *mask_out = mask;
-  return true;
-}
-
 static v3f camera_forward(const Camera *cam) {
   float cy = cosf(cam->yaw);
   float sy = sinf(cam->yaw);
@@ -104,12 +78,6 @@ static v3f camera_forward(const Camera *cam) {
   return v3_normalize((v3f){sy * cp, sp, -cy * cp});
 }
 
-static void clear_depth(float *depth, size_t count) {
-  for (size_t i = 0; i < count; i++) {
-    depth[i] = 1.0f;
-  }
-}
-
 static void resize_render(Game *game, int window_w, int window_h,
                           int render_scale) {
   game->window_w = (u32)window_w;
@@ -134,27 +102,85 @@ static void resize_render(Game *game, int window_w, int window_h,
   }
 }
 
-static void destroy_texture(Texture *tex) {
-  if (tex && tex->pixels) {
-    texture_destroy(tex);
+// Packs every material texture into one atlas and points the materials at
+// their views, filtered bilinearly. The atlas holds copies; the model's own
+// textures stay with the asset manager, which counts them.
+static bool build_materials(ModelDemo *demo) {
+  const ObjModel *model = demo->model;
+  u32 white = 0xFFFFFFFF;
+  Texture fallback = {.w = 1, .h = 1, .pixels = &white};
+  const Texture **sources =
+      malloc((size_t)(model->material_count + 1) * sizeof(Texture *));
+  demo->materials = malloc((size_t)model->material_count * sizeof(S3DMaterial));
+  if (!sources || !demo->materials) {
+    free(sources);
+    return false;
+  }
+  int count = 0;
+  sources[count++] = &fallback;
+  for (int i = 0; i < model->material_count; i++) {
+    if (model->materials[i].has_diffuse) {
+      sources[count++] = &model->materials[i].diffuse;
+    }
+  }
+  bool ok = atlas_build(&demo->atlas, sources, count, TEXTURE_TILED);
+  free(sources);
+  if (!ok) {
+    return false;
   }
+  for (int i = 0, view = 1; i < model->material_count; i++) {
+    const ObjMaterial *mat = &model->materials[i];
+    demo->materials[i].texture =
+        &demo->atlas.views[mat->has_diffuse ? view++ : 0];
+    demo->materials[i].texture->filter = TEXTURE_BILINEAR;
+  }
+  return true;
 }
 
-static void make_fallback(Texture *tex, u32 color) {
-  tex->w = 1;
-  tex->h = 1;
-  tex->pixels = malloc(sizeof(u32));
-  if (tex->pixels) {
-    tex->pixels[0] = color;
+static void toggle_filter(ModelDemo *demo) {
+  for (int i = 0; i < demo->atlas.view_count; i++) {
+    Texture *view = &demo->atlas.views[i];
+    view->filter = view->filter == TEXTURE_BILINEAR ? TEXTURE_NEAREST
+                                                    : TEXTURE_BILINEAR;
   }
 }
 
+static void free_materials(ModelDemo *demo) {
+  free(demo->materials);
+  demo->materials = NULL;
+  atlas_destroy(&demo->atlas);
+  demo->model = NULL;
+}
+
+// Fits the model into view and builds its materials, whenever it becomes
+// available: first, and again if it was reloaded.
+static bool model_loaded(ModelDemo *demo, const ObjModel *model) {
+  demo->model = model;
+  const Mesh *mesh = &model->mesh;
+  if (mesh->has_bounds) {
+    v3f size = {mesh->bounds_max.x - mesh->bounds_min.x,
+                mesh->bounds_max.y - mesh->bounds_min.y,
+                mesh->bounds_max.z - mesh->bounds_min.z};
+    demo->model_center = (v3f){(mesh->bounds_min.x + mesh->bounds_max.x) * 0.5f,
+                               (mesh->bounds_min.y + mesh->bounds_max.y) * 0.5f,
+                               (mesh->bounds_min.z + mesh->bounds_max.z) * 0.5f};
+    float max_extent = fmaxf(size.x, fmaxf(size.y, size.z));
+    demo->model_scale = (max_extent > 0.0f) ? (2.0f / max_extent) : 1.0f;
+  } else {
+    demo->model_center = (v3f){0};
+    demo->model_scale = 1.0f;
+  }
+  return build_materials(demo);
+}
+
 static bool model_demo_init(ModelDemo *demo) {
   *demo = (ModelDemo){0};
   demo->game.window_w = 960;
   demo->game.window_h = 540;
   demo->render_scale = 2;
   demo->near_plane = 0.05f;
+  demo->model_scale = 1.0f;
+  demo->model_pos = (v3f){0.0f, -0.4f, 0.0f};
   demo->mouse_sens = 0.0025f;
   demo->camera = (Camera){.pos = {0.0f, 0.3f, 3.0f}, .yaw = 0.0f, .pitch = 0.0f};
   resize_render(&demo->game, (int)demo->game.window_w,
@@ -172,30 +198,22 @@ static bool model_demo_init(ModelDemo *demo) {
     return false;
   }
 
-  if (!obj_model_load("assets/backpack/backpack.obj", &demo->model)) {
-    SDL_Log("Failed to load backpack model");
+  // A cooked copy (tools/cook.c) skips parsing and image decoding. The
+  // model loads in the background; see model_loaded.
+  const char *cooked = "assets/backpack/backpack.s3dm";
+  FILE *probe = fopen(cooked, "rb");
+  if (probe) {
+    fclose(probe);
+  }
+  if (!asset_manager_init(&demo->assets, 4, 0)) {
     IMG_Quit();
     SDL_Quit();
     return false;
   }
-
-  make_fallback(&demo->fallback_tex, 0xFFFFFFFF);
-
-  v3f size = {0};
-  if (demo->model.has_bounds) {
-    size = (v3f){demo->model.bounds_max.x - demo->model.bounds_min.x,
-                 demo->model.bounds_max.y - demo->model.bounds_min.y,
-                 demo->model.bounds_max.z - demo->model.bounds_min.z};
-    demo->model_center = (v3f){(demo->model.bounds_min.x + demo->model.bounds_max.x) * 0.5f,
-                               (demo->model.bounds_min.y + demo->model.bounds_max.y) * 0.5f,
-                               (demo->model.bounds_min.z + demo->model.bounds_max.z) * 0.5f};
-    float max_extent = fmaxf(size.x, fmaxf(size.y, size.z));
-    demo->model_scale = (max_extent > 0.0f) ? (2.0f / max_extent) : 1.0f;
-  } else {
-    demo->model_center = (v3f){0};
-    demo->model_scale = 1.0f;
-  }
-  demo->model_pos = (v3f){0.0f, -0.4f, 0.0f};
+  demo->model_asset =
+      asset_request(&demo->assets,
+                    probe ? cooked : "assets/backpack/backpack.obj",
+                    ASSET_MODEL);
 
   const char *title = "Model Demo: Backpack";
   demo->game.window = SDL_CreateWindow(
@@ -204,8 +222,7 @@ static bool model_demo_init(ModelDemo *demo) {
       SDL_WINDOW_ALWAYS_ON_TOP | SDL_WINDOW_RESIZABLE);
   if (demo->game.window == NULL) {
     SDL_Log("Failed to create Window: %s\n", SDL_GetError());
-    obj_model_free(&demo->model);
-    destroy_texture(&demo->fallback_tex);
+    asset_manager_destroy(&demo->assets);
     IMG_Quit();
     SDL_Quit();
     return false;
@@ -217,8 +234,7 @@ static bool model_demo_init(ModelDemo *demo) {
   if (demo->game.renderer == NULL) {
     SDL_Log("Failed to create Renderer: %s\n", SDL_GetError());
     SDL_DestroyWindow(demo->game.window);
-    obj_model_free(&demo->model);
-    destroy_texture(&demo->fallback_tex);
+    asset_manager_destroy(&demo->assets);
     IMG_Quit();
     SDL_Quit();
     return false;
@@ -232,12 +248,25 @@ static bool model_demo_init(ModelDemo *demo) {
   demo->fps = 0.0f;
   demo->last_ticks = SDL_GetTicks();
   demo->running = true;
+  if (!s3d_init(&demo->s3d, 0)) {
+    SDL_DestroyRenderer(demo->game.renderer);
+    SDL_DestroyWindow(demo->game.window);
+    asset_manager_destroy(&demo->assets);
+    IMG_Quit();
+    SDL_Quit();
+    return false;
+  }
+  profiler_init(&demo->profiler);
+  demo->s3d.profiler = &demo->profiler;
+  demo->s3d.reuse_depth = true;
   return true;
 }
 
 static void model_demo_shutdown(ModelDemo *demo) {
-  obj_model_free(&demo->model);
-  destroy_texture(&demo->fallback_tex);
+  s3d_destroy(&demo->s3d);
+  profiler_destroy(&demo->profiler);
+  free_materials(demo);
+  asset_manager_destroy(&demo->assets);
   if (demo->game.buffer) {
     free(demo->game.buffer);
     demo->game.buffer = NULL;
@@ -272,6 +301,7 @@ static void model_demo_handle_event(ModelDemo *demo, const SDL_Event *event) {
     if (event->window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
       resize_render(&demo->game, event->window.data1, event->window.data2,
                     demo->render_scale);
+      s3d_invalidate_depth(&demo->s3d);
     }
     break;
   case SDL_MOUSEMOTION:
@@ -287,6 +317,15 @@ static void model_demo_handle_event(ModelDemo *demo, const SDL_Event *event) {
     if (event->key.keysym.sym == SDLK_r) {
       demo->wireframe = !demo->wireframe;
     }
+    if (event->key.keysym.sym == SDLK_f) {
+      toggle_filter(demo);
+    }
+    if (event->key.keysym.sym == SDLK_p) {
+      demo->show_profiler = !demo->show_profiler;
+    }
+    if (event->key.keysym.sym == SDLK_t) {
+      profiler_start_trace(&demo->profiler, "trace.json", 120);
+    }
     if (event->key.keysym.sym == SDLK_q) {
       game->mouse_grabbed = !game->mouse_grabbed;
       SDL_SetRelativeMouseMode(game->mouse_grabbed ? SDL_TRUE : SDL_FALSE);
@@ -300,6 +339,7 @@ static void model_demo_handle_event(ModelDemo *demo, const SDL_Event *event) {
         int w, h;
         SDL_GetWindowSize(game->window, &w, &h);
         resize_render(&demo->game, w, h, demo->render_scale);
+        s3d_invalidate_depth(&demo->s3d);
       }
     }
     break;
@@ -356,8 +396,28 @@ static void model_demo_frame(ModelDemo *demo, Uint32 now, float dt) {
   if (demo->camera.pitch < -max_pitch)
     demo->camera.pitch = -max_pitch;
 
-  memset(game->buffer, 0, game->render_w * game->render_h * sizeof(u32));
-  clear_depth(game->depth, (size_t)game->render_w * (size_t)game->render_h);
+  asset_manager_update(&demo->assets);
+  // Fetched every frame, as the pointer only lasts until the next update.
+  // The materials go whenever it is not ready, so a reload rebuilds them.
+  const ObjModel *loaded = asset_model(&demo->assets, demo->model_asset);
+  if (loaded != demo->model) {
+    free_materials(demo);
+    if (loaded && !model_loaded(demo, loaded)) {
+      SDL_Log("Failed to build backpack materials");
+      demo->running = false;
+      return;
+    }
+  }
+  if (!loaded &&
+      asset_state(&demo->assets, demo->model_asset) == ASSET_FAILED) {
+    SDL_Log("Failed to load backpack model");
+    demo->running = false;
+    return;
+  }
+
+  s3d_begin(&demo->s3d, game->buffer, game->depth, (int)game->render_w,
+            (int)game->render_h);
+  s3d_clear(&demo->s3d, 0);
 
   float aspect = (float)game->render_w / (float)game->render_h;
   mat4 view = mat4_look_at(
@@ -366,208 +426,41 @@ static void model_demo_frame(ModelDemo *demo, Uint32 now, float dt) {
   mat4 proj = mat4_perspective((float)M_PI / 3.0f, aspect, demo->near_plane,
                                100.0f);
 
-  typedef struct {
-    v2i screen;
-    v2f uv;
-    v3f view_pos;
-    float inv_w;
-    float depth;
-    int clip_mask;
-    bool depth_ok;
-  } CachedVertex;
-  CachedVertex tri[3];
-
-  for (int i = 0; i < demo->model.face_count; i++) {
-    ObjFace *face = &demo->model.faces[i];
-    bool skip = false;
-    for (int j = 0; j < 3; j++) {
-      v3f local = v3_sub(face->v[j].pos, demo->model_center);
-      local = v3_scale(local, demo->model_scale);
-      v4f world = {local.x, local.y, local.z, 1.0f};
-
-      world.x += demo->model_pos.x;
-      world.y += demo->model_pos.y;
-      world.z += demo->model_pos.z;
-
-      v4f view_pos4 = mat4_mul_v4(view, world);
-      v4f clip = mat4_mul_v4(proj, view_pos4);
-
-      tri[j].uv = face->v[j].uv;
-      tri[j].view_pos = (v3f){view_pos4.x, view_pos4.y, view_pos4.z};
-
-      int mask = 0;
-      if (clip.w == 0.0f) {
-        tri[j].clip_mask = 0x3F;
-        tri[j].depth_ok = false;
-        skip = true;
-        break;
-      }
-      if (clip.x < -clip.w)
-        mask |= 1;
-      if (clip.x > clip.w)
-        mask |= 2;
-      if (clip.y < -clip.w)
-        mask |= 4;
-      if (clip.y > clip.w)
-        mask |= 8;
-      if (clip.z < 0.0f)
-        mask |= 16;
-      if (clip.z > clip.w)
-        mask |= 32;
-      tri[j].clip_mask = mask;
-
-      float inv_w = 1.0f / clip.w;
-      tri[j].inv_w = inv_w;
-      v3f ndc = {clip.x * inv_w, clip.y * inv_w, clip.z * inv_w};
-      tri[j].depth_ok = ndc.z >= 0.0f && ndc.z <= 1.0f;
-      tri[j].screen =
-          norm_to_screen((v2f){ndc.x, ndc.y}, game->render_w, game->render_h);
-      tri[j].depth = 0.5f * (ndc.z + 1.0f);
-    }
-    if (skip) {
-      continue;
-    }
-
-    if ((tri[0].clip_mask & tri[1].clip_mask & tri[2].clip_mask) != 0) {
-      continue;
-    }
-
-    bool near_in[3] = {tri[0].view_pos.z <= -demo->near_plane,
-                       tri[1].view_pos.z <= -demo->near_plane,
-                       tri[2].view_pos.z <= -demo->near_plane};
-    bool needs_clip = !(near_in[0] && near_in[1] && near_in[2]);
-
-    Texture *tex =
-        (face->mat && face->mat->has_diffuse) ? &face->mat->diffuse
-                                              : &demo->fallback_tex;
-
-    if (!needs_clip) {
-      if (!tri[0].depth_ok || !tri[1].depth_ok || !tri[2].depth_ok) {
-        continue;
-      }
-      v3f edge1 = v3_sub(tri[1].view_pos, tri[0].view_pos);
-      v3f edge2 = v3_sub(tri[2].view_pos, tri[0].view_pos);
-      v3f normal = v3_cross(edge1, edge2);
-      if (v3_dot(normal, tri[0].view_pos) >= 0.0f) {
-        continue;
-      }
-      VertexPC pv[3] = {
-          {.pos = tri[0].screen,
-           .uv = tri[0].uv,
-           .inv_w = tri[0].inv_w,
-           .depth = tri[0].depth},
-          {.pos = tri[1].screen,
-           .uv = tri[1].uv,
-           .inv_w = tri[1].inv_w,
-           .depth = tri[1].depth},
-          {.pos = tri[2].screen,
-           .uv = tri[2].uv,
-           .inv_w = tri[2].inv_w,
-           .depth = tri[2].depth},
-      };
-
-      if (demo->wireframe) {
-        draw_triangle(game->buffer, game->render_w, game->render_h, pv[0].pos,
-                      pv[1].pos, pv[2].pos, WHITE, WIREFRAME);
-      } else {
-        draw_textured_triangle(game->buffer, game->depth, game->render_w,
-                               game->render_h, tex, pv[0], pv[1], pv[2]);
-      }
-    } else {
-      ClipVert in_poly[4] = {
-          {.view_pos = tri[0].view_pos, .uv = tri[0].uv},
-          {.view_pos = tri[1].view_pos, .uv = tri[1].uv},
-          {.view_pos = tri[2].view_pos, .uv = tri[2].uv},
-      };
-      int in_count = 3;
-      ClipVert out_poly[4];
-      int out_count = 0;
-
-      for (int v = 0; v < in_count; v++) {
-        ClipVert a = in_poly[v];
-        ClipVert b = in_poly[(v + 1) % in_count];
-        bool a_in = a.view_pos.z <= -demo->near_plane;
-        bool b_in = b.view_pos.z <= -demo->near_plane;
-
-        if (a_in && b_in) {
-          out_poly[out_count++] = b;
-        } else if (a_in && !b_in) {
-          float t = (-demo->near_plane - a.view_pos.z) /
-                    (b.view_pos.z - a.view_pos.z);
-          ClipVert inter = {
-              .view_pos = {a.view_pos.x + (b.view_pos.x - a.view_pos.x) * t,
-                           a.view_pos.y + (b.view_pos.y - a.view_pos.y) * t,
-                           -demo->near_plane},
-              .uv = {a.uv.x + (b.uv.x - a.uv.x) * t,
-                     a.uv.y + (b.uv.y - a.uv.y) * t}};
-          out_poly[out_count++] = inter;
-        } else if (!a_in && b_in) {
-          float t = (-demo->near_plane - a.view_pos.z) /
-                    (b.view_pos.z - a.view_pos.z);
-          ClipVert inter = {
-              .view_pos = {a.view_pos.x + (b.view_pos.x - a.view_pos.x) * t,
-                           a.view_pos.y + (b.view_pos.y - a.view_pos.y) * t,
-                           -demo->near_plane},
-              .uv = {a.uv.x + (b.uv.x - a.uv.x) * t,
-                     a.uv.y + (b.uv.y - a.uv.y) * t}};
-          out_poly[out_count++] = inter;
-          out_poly[out_count++] = b;
-        }
-      }
-
-      if (out_count < 3) {
-        continue;
-      }
-
-      int tri_sets[2][3] = {{0, 1, 2}, {0, 2, 3}};
-      int tri_total = (out_count == 4) ? 2 : 1;
-
-      for (int t = 0; t < tri_total; t++) {
-        ClipVert *a = &out_poly[tri_sets[t][0]];
-        ClipVert *b = &out_poly[tri_sets[t][1]];
-        ClipVert *c = &out_poly[tri_sets[t][2]];
-
-        v3f edge1 = v3_sub(b->view_pos, a->view_pos);
-        v3f edge2 = v3_sub(c->view_pos, a->view_pos);
-        v3f normal = v3_cross(edge1, edge2);
-        if (v3_dot(normal, a->view_pos) >= 0.0f) {
-          continue;
-        }
-
-        VertexPC pv[3];
-        int masks[3];
-        if (!project_vertex(a, &proj, game->render_w, game->render_h, &pv[0],
-                            &masks[0]) ||
-            !project_vertex(b, &proj, game->render_w, game->render_h, &pv[1],
-                            &masks[1]) ||
-            !project_vertex(c, &proj, game->render_w, game->render_h, &pv[2],
-                            &masks[2])) {
-          continue;
-        }
-        if ((masks[0] & masks[1] & masks[2]) != 0) {
-          continue;
-        }
-
-        if (demo->wireframe) {
-          draw_triangle(game->buffer, game->render_w, game->render_h, pv[0].pos,
-                        pv[1].pos, pv[2].pos, WHITE, WIREFRAME);
-        } else {
-          draw_textured_triangle(game->buffer, game->depth, game->render_w,
-                                 game->render_h, tex, pv[0], pv[1], pv[2]);
-        }
-      }
-    }
+  // (p - center) * scale + pos as one matrix.
+  mat4 model = mat4_identity();
+  model.m[0][0] = model.m[1][1] = model.m[2][2] = demo->model_scale;
+  model.m[0][3] = demo->model_pos.x - demo->model_center.x * demo->model_scale;
+  model.m[1][3] = demo->model_pos.y - demo->model_center.y * demo->model_scale;
+  model.m[2][3] = demo->model_pos.z - demo->model_center.z * demo->model_scale;
+  mat4 mvp = mat4_mul(proj, mat4_mul(view, model));
+
+  demo->s3d.wireframe = demo->wireframe;
+  if (loaded) {
+    s3d_draw_mesh(&demo->s3d, &loaded->mesh, mvp, demo->materials);
   }
+  s3d_end(&demo->s3d);
 
+  Uint64 hud_start = profiler_begin(&demo->profiler);
   char fps_text[32];
   snprintf(fps_text, sizeof(fps_text), "FPS %d", (int)(demo->fps + 0.5f));
   draw_text(game->buffer, game->render_w, (v2i){5, 5}, fps_text, WHITE);
+  if (!loaded) {
+    draw_text(game->buffer, game->render_w, (v2i){5, 20}, "Loading model...",
+              WHITE);
+  }
+  if (demo->show_profiler) {
+    profiler_draw(&demo->profiler, game->buffer, (int)game->render_w,
+                  (int)game->render_h, (v2i){5, 20}, WHITE);
+  }
+  profiler_end(&demo->profiler, PROF_HUD, hud_start);
 
+  Uint64 present_start = profiler_begin(&demo->profiler);
   SDL_UpdateTexture(game->texture, NULL, game->buffer, game->pitch);
   SDL_RenderClear(game->renderer);
   SDL_Rect dest = {0, 0, (int)game->window_w, (int)game->window_h};
   SDL_RenderCopy(game->renderer, game->texture, NULL, &dest);
   SDL_RenderPresent(game->renderer);
+  profiler_end(&demo->profiler, PROF_PRESENT, present_start);
 }
 
 int main(void) {
@@ -585,11 +478,13 @@ int main(void) {
       demo.fps = demo.fps * 0.9f + inst * 0.1f;
     }
 
+    profiler_begin_frame(&demo.profiler);
     while (SDL_PollEvent(&demo.game.event)) {
       model_demo_handle_event(&demo, &demo.game.event);
     }
 
     model_demo_frame(&demo, now, dt);
+    profiler_end_frame(&demo.profiler);
   }
 
   model_demo_shutdown(&demo);
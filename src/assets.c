@@ -0,0 +1,310 @@
+#include "assets.h"
+#include "cooked_model.h"
+#include "render.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FALLBACK_SIZE 16
+#define FALLBACK_SQUARE 4 // texels per checker square
+
+static size_t texture_bytes(const Texture *tex) {
+  if (tex->stride != 0 || !tex->pixels) {
+    return 0; // an atlas or a cooked model file owns the texels
+  }
+  size_t bytes = 0;
+  int levels = tex->level_count > 1 ? tex->level_count : 1;
+  for (int level = 0; level < levels; level++) {
+    bytes += texture_level_size(tex, level) * sizeof(u32);
+  }
+  return bytes;
+}
+
+static size_t model_bytes(const ObjModel *model) {
+  const Mesh *mesh = &model->mesh;
+  size_t bytes = (size_t)model->material_count * sizeof(ObjMaterial);
+  if (model->file) {
+    return bytes + model->file_size; // the mesh and texels are in the file
+  }
+  bytes += (size_t)mesh->position_cap * sizeof(v3f) +
+           (size_t)mesh->vertex_cap * sizeof(MeshVertex) +
+           (size_t)mesh->index_cap * sizeof(u32) +
+           (size_t)mesh->group_cap * sizeof(MeshGroup);
+  for (int i = 0; i < model->material_count; i++) {
+    if (model->materials[i].has_diffuse) {
+      bytes += texture_bytes(&model->materials[i].diffuse);
+    }
+  }
+  return bytes;
+}
+
+// Runs on the I/O thread, without the lock.
+static bool load_asset(AssetKind kind, const char *path, Texture *tex,
+                       ObjModel *model, size_t *bytes) {
+  if (kind == ASSET_TEXTURE) {
+    if (!texture_load(tex, path)) {
+      return false;
+    }
+    texture_build_mips(tex); // an optimisation; the texture works without
+    *bytes = texture_bytes(tex);
+    return true;
+  }
+  size_t len = strlen(path);
+  bool cooked = len > 5 && strcmp(path + len - 5, ".s3dm") == 0;
+  if (!(cooked ? cooked_model_load(path, model)
+               : obj_model_load(path, model))) {
+    return false;
+  }
+  *bytes = model_bytes(model);
+  return true;
+}
+
+static int io_main(void *data) {
+  AssetManager *mgr = data;
+  SDL_LockMutex(mgr->lock);
+  for (;;) {
+    while (!mgr->quit && mgr->queue_count == 0) {
+      SDL_CondWait(mgr->wake, mgr->lock);
+    }
+    if (mgr->quit) {
+      break;
+    }
+    Asset *asset = &mgr->assets[mgr->queue[mgr->queue_head]];
+    mgr->queue_head = (mgr->queue_head + 1) % mgr->capacity;
+    mgr->queue_count--;
+    // The caller's thread leaves a loading asset alone, so its slot can be
+    // filled in after the lock is taken again.
+    asset->state = ASSET_LOADING;
+    char path[sizeof(asset->path)];
+    memcpy(path, asset->path, sizeof(path));
+    AssetKind kind = asset->kind;
+    SDL_UnlockMutex(mgr->lock);
+
+    Texture tex = {0};
+    ObjModel model = {0};
+    size_t bytes = 0;
+    bool ok = load_asset(kind, path, &tex, &model, &bytes);
+
+    SDL_LockMutex(mgr->lock);
+    asset->texture = tex;
+    asset->model = model;
+    asset->bytes = ok ? bytes : 0;
+    asset->state = ok ? ASSET_READY : ASSET_FAILED;
+    mgr->resident += asset->bytes;
+  }
+  SDL_UnlockMutex(mgr->lock);
+  return 0;
+}
+
+static void unload(AssetManager *mgr, Asset *asset) {
+  if (asset->state != ASSET_READY) {
+    return;
+  }
+  if (asset->kind == ASSET_TEXTURE) {
+    texture_destroy(&asset->texture);
+  } else {
+    obj_model_free(&asset->model);
+  }
+  mgr->resident -= asset->bytes;
+  asset->bytes = 0;
+  asset->state = ASSET_UNLOADED;
+}
+
+// The resident asset used least recently, not counting those used this frame
+// or the one before, or with unreferenced, the least recently used asset
+// that can be dropped. NULL when there is none.
+static Asset *least_recent(AssetManager *mgr, bool unreferenced) {
+  Asset *best = NULL;
+  for (int i = 0; i < mgr->capacity; i++) {
+    Asset *asset = &mgr->assets[i];
+    bool idle = asset->state != ASSET_QUEUED &&
+                asset->state != ASSET_LOADING && asset->path[0];
+    bool stale = asset->last_used + 1 < mgr->frame;
+    bool pick = unreferenced ? idle && asset->refs == 0
+                             : asset->state == ASSET_READY && stale;
+    if (pick && (!best || asset->last_used < best->last_used)) {
+      best = asset;
+    }
+  }
+  return best;
+}
+
+static Asset *lookup(AssetManager *mgr, AssetHandle handle) {
+  if (handle <= 0 || handle > mgr->capacity) {
+    return NULL;
+  }
+  Asset *asset = &mgr->assets[handle - 1];
+  return asset->path[0] ? asset : NULL;
+}
+
+// Marks the asset used and queues it when it isn't resident.
+static void touch(AssetManager *mgr, Asset *asset) {
+  asset->last_used = mgr->frame;
+  if (asset->state == ASSET_UNLOADED) {
+    int tail = (mgr->queue_head + mgr->queue_count) % mgr->capacity;
+    mgr->queue[tail] = (int)(asset - mgr->assets);
+    mgr->queue_count++;
+    asset->state = ASSET_QUEUED;
+    SDL_CondSignal(mgr->wake);
+  }
+}
+
+bool asset_manager_init(AssetManager *mgr, int capacity, size_t budget) {
+  *mgr = (AssetManager){.capacity = capacity, .budget = budget};
+  if (capacity <= 0) {
+    return false;
+  }
+  mgr->assets = calloc((size_t)capacity, sizeof(Asset));
+  // Each asset is queued at most once, so the ring never fills.
+  mgr->queue = malloc((size_t)capacity * sizeof(int));
+  mgr->fallback = (Texture){.w = FALLBACK_SIZE,
+                            .h = FALLBACK_SIZE,
+                            .wrap = TEXTURE_REPEAT};
+  mgr->fallback.pixels = malloc(FALLBACK_SIZE * FALLBACK_SIZE * sizeof(u32));
+  mgr->lock = SDL_CreateMutex();
+  mgr->wake = SDL_CreateCond();
+  if (!mgr->assets || !mgr->queue || !mgr->fallback.pixels || !mgr->lock ||
+      !mgr->wake) {
+    SDL_Log("Failed to create asset manager");
+    asset_manager_destroy(mgr);
+    return false;
+  }
+  for (int y = 0; y < FALLBACK_SIZE; y++) {
+    for (int x = 0; x < FALLBACK_SIZE; x++) {
+      bool odd = ((x / FALLBACK_SQUARE) ^ (y / FALLBACK_SQUARE)) & 1;
+      mgr->fallback.pixels[y * FALLBACK_SIZE + x] =
+          odd ? 0xFFFF00FF : 0xFF202020;
+    }
+  }
+  mgr->thread = SDL_CreateThread(io_main, "soft3d-io", mgr);
+  if (!mgr->thread) {
+    SDL_Log("Failed to create asset thread: %s", SDL_GetError());
+    asset_manager_destroy(mgr);
+    return false;
+  }
+  return true;
+}
+
+void asset_manager_destroy(AssetManager *mgr) {
+  if (mgr->thread) {
+    SDL_LockMutex(mgr->lock);
+    mgr->quit = true;
+    SDL_CondSignal(mgr->wake);
+    SDL_UnlockMutex(mgr->lock);
+    SDL_WaitThread(mgr->thread, NULL);
+  }
+  for (int i = 0; mgr->assets && i < mgr->capacity; i++) {
+    unload(mgr, &mgr->assets[i]);
+  }
+  free(mgr->assets);
+  free(mgr->queue);
+  texture_destroy(&mgr->fallback);
+  if (mgr->wake)
+    SDL_DestroyCond(mgr->wake);
+  if (mgr->lock)
+    SDL_DestroyMutex(mgr->lock);
+  *mgr = (AssetManager){0};
+}
+
+void asset_manager_update(AssetManager *mgr) {
+  SDL_LockMutex(mgr->lock);
+  mgr->frame++;
+  while (mgr->budget > 0 && mgr->resident > mgr->budget) {
+    Asset *asset = least_recent(mgr, false);
+    if (!asset) {
+      break; // the rest is in use: over budget rather than reloading
+    }
+    unload(mgr, asset);
+    if (asset->refs == 0) {
+      asset->path[0] = '\0';
+    }
+  }
+  SDL_UnlockMutex(mgr->lock);
+}
+
+AssetHandle asset_request(AssetManager *mgr, const char *path,
+                          AssetKind kind) {
+  if (!path[0] || strlen(path) >= sizeof(mgr->assets[0].path)) {
+    SDL_Log("Invalid asset path '%s'", path);
+    return 0;
+  }
+  SDL_LockMutex(mgr->lock);
+  Asset *asset = NULL;
+  for (int i = 0; i < mgr->capacity && !asset; i++) {
+    Asset *other = &mgr->assets[i];
+    if (other->kind == kind && strcmp(other->path, path) == 0) {
+      asset = other;
+    }
+  }
+  for (int i = 0; i < mgr->capacity && !asset; i++) {
+    if (!mgr->assets[i].path[0]) {
+      asset = &mgr->assets[i];
+    }
+  }
+  if (!asset) {
+    // Every slot is taken: drop the cached asset unused the longest.
+    asset = least_recent(mgr, true);
+    if (asset) {
+      unload(mgr, asset);
+    }
+  }
+  AssetHandle handle = 0;
+  if (asset) {
+    if (strcmp(asset->path, path) != 0) {
+      *asset = (Asset){.kind = kind, .last_used = mgr->frame};
+      memcpy(asset->path, path, strlen(path) + 1);
+    }
+    asset->refs++;
+    handle = (AssetHandle)(asset - mgr->assets) + 1;
+  } else {
+    SDL_Log("No free asset slot for '%s'", path);
+  }
+  SDL_UnlockMutex(mgr->lock);
+  return handle;
+}
+
+void asset_release(AssetManager *mgr, AssetHandle handle) {
+  SDL_LockMutex(mgr->lock);
+  Asset *asset = lookup(mgr, handle);
+  if (asset && asset->refs > 0) {
+    asset->refs--; // cached until evicted or its slot is needed
+  }
+  SDL_UnlockMutex(mgr->lock);
+}
+
+AssetState asset_state(AssetManager *mgr, AssetHandle handle) {
+  SDL_LockMutex(mgr->lock);
+  Asset *asset = lookup(mgr, handle);
+  AssetState state = asset ? asset->state : ASSET_FAILED;
+  SDL_UnlockMutex(mgr->lock);
+  return state;
+}
+
+Texture *asset_texture(AssetManager *mgr, AssetHandle handle) {
+  SDL_LockMutex(mgr->lock);
+  Asset *asset = lookup(mgr, handle);
+  Texture *tex = &mgr->fallback;
+  if (asset && asset->kind == ASSET_TEXTURE) {
+    touch(mgr, asset);
+    if (asset->state == ASSET_READY) {
+      tex = &asset->texture;
+    }
+  }
+  SDL_UnlockMutex(mgr->lock);
+  return tex;
+}
+
+ObjModel *asset_model(AssetManager *mgr, AssetHandle handle) {
+  SDL_LockMutex(mgr->lock);
+  Asset *asset = lookup(mgr, handle);
+  ObjModel *model = NULL;
+  if (asset && asset->kind == ASSET_MODEL) {
+    touch(mgr, asset);
+    if (asset->state == ASSET_READY) {
+      model = &asset->model;
+    }
+  }
+  SDL_UnlockMutex(mgr->lock);
+  return model;
+}
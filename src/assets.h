@@ -0,0 +1,79 @@
+#pragma once
+
+#include "obj_loader.h"
+#include "types.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+  ASSET_TEXTURE, // texture_load's wrap and filter, plus a mip chain
+  ASSET_MODEL,   // cooked_model_load for .s3dm, else obj_model_load
+} AssetKind;
+
+typedef enum {
+  ASSET_UNLOADED, // not resident: never used yet, or evicted
+  ASSET_QUEUED,
+  ASSET_LOADING,
+  ASSET_READY,
+  ASSET_FAILED, // not retried
+} AssetState;
+
+// Index + 1 into AssetManager.assets; 0 is no asset.
+typedef int AssetHandle;
+
+typedef struct {
+  char path[256]; // empty for a free slot
+  AssetKind kind;
+  AssetState state;
+  int refs;
+  Uint64 last_used; // AssetManager.frame when last asked for
+  size_t bytes;     // while resident
+  Texture texture;
+  ObjModel model;
+} Asset;
+
+// Loads textures and models on a background I/O thread, on first use, and
+// keeps what was used least recently out of memory once the resident assets
+// pass a budget, as far as the assets still in use allow. Handles are
+// reference counted: a released asset stays cached until it is evicted, and
+// one still referenced is reloaded when used again after eviction.
+// Everything but the I/O thread's loading runs on the caller's thread, under
+// `lock`.
+typedef struct {
+  Asset *assets;
+  int capacity;
+  int *queue; // ring of asset indices waiting for the I/O thread
+  int queue_head;
+  int queue_count;
+  size_t budget;   // bytes; 0 keeps everything
+  size_t resident; // bytes of the ready assets
+  Uint64 frame;
+  Texture fallback; // checkerboard stood in for textures not ready
+  SDL_mutex *lock;
+  SDL_cond *wake;
+  SDL_Thread *thread;
+  bool quit;
+} AssetManager;
+
+// capacity bounds the assets known at once.
+bool asset_manager_init(AssetManager *mgr, int capacity, size_t budget);
+// Waits for the load in progress, then frees every asset.
+void asset_manager_destroy(AssetManager *mgr);
+// Call once a frame, before using any asset: evicts the least recently used
+// ready assets while over budget. Assets used in the last frame are kept,
+// so a working set larger than the budget stays resident over it instead of
+// reloading every frame. Pointers from asset_texture and asset_model stay
+// valid until the next call.
+void asset_manager_update(AssetManager *mgr);
+// A handle to the asset at path, shared with earlier requests for it. Nothing
+// is loaded until it is first used. 0 when every slot is taken.
+AssetHandle asset_request(AssetManager *mgr, const char *path,
+                          AssetKind kind);
+void asset_release(AssetManager *mgr, AssetHandle handle);
+AssetState asset_state(AssetManager *mgr, AssetHandle handle);
+// Marks the asset used this frame and queues it when it isn't resident.
+// Textures not ready yet (or that failed) come back as the fallback; models
+// as NULL.
+Texture *asset_texture(AssetManager *mgr, AssetHandle handle);
+ObjModel *asset_model(AssetManager *mgr, AssetHandle handle);
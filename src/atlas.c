@@ -0,0 +1,178 @@
+#include "atlas.h"
+#include "render.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct {
+  int index;
+  int w;
+  int h;
+  int x;
+  int y;
+} AtlasItem;
+
+// Tallest first, so each shelf wastes little height.
+static int cmp_taller(const void *a, const void *b) {
+  const AtlasItem *ia = a, *ib = b;
+  if (ia->h != ib->h) {
+    return ib->h - ia->h;
+  }
+  return ia->index - ib->index;
+}
+
+// Largest power of two dividing both sides, at most the largest mip step.
+// Tiled views must start on a block; their smallest levels, which don't,
+// are dropped by view_levels rather than spreading the atlas out.
+static int item_align(const AtlasItem *item, TextureLayout layout) {
+  int align = 1;
+  while (align < (1 << (TEXTURE_MAX_LEVELS - 1)) &&
+         item->w % (align * 2) == 0 && item->h % (align * 2) == 0) {
+    align *= 2;
+  }
+  if (layout == TEXTURE_TILED && align < TEXTURE_TILE) {
+    align = TEXTURE_TILE;
+  }
+  return align;
+}
+
+static int round_up(int n, int align) {
+  return (n + align - 1) / align * align;
+}
+
+// Shelf packing into the given width. Returns the height.
+static int pack(AtlasItem *items, int count, int width,
+                TextureLayout layout) {
+  int x = 0, shelf_y = 0, bottom = 0;
+  for (int i = 0; i < count; i++) {
+    AtlasItem *item = &items[i];
+    int align = item_align(item, layout);
+    int item_x = round_up(x, align);
+    if (item_x + item->w > width) {
+      shelf_y = bottom;
+      item_x = 0;
+    }
+    item->x = item_x;
+    item->y = round_up(shelf_y, align);
+    x = item_x + item->w;
+    if (item->y + item->h > bottom) {
+      bottom = item->y + item->h;
+    }
+  }
+  return bottom;
+}
+
+// Levels where the item covers whole 2x2 blocks of the level above (so
+// filtering never reached a neighbour) and, when tiled, starts on a block.
+static int view_levels(const AtlasItem *item, const Texture *atlas) {
+  int levels = 1;
+  for (int level = 1; level < atlas->level_count; level++) {
+    int step = 1 << level;
+    if (item->x % step || item->y % step || item->w % step ||
+        item->h % step) {
+      break;
+    }
+    bool on_block = (item->x >> level) % TEXTURE_TILE == 0 &&
+                    (item->y >> level) % TEXTURE_TILE == 0;
+    if (atlas->layout == TEXTURE_TILED && !on_block) {
+      break;
+    }
+    levels++;
+  }
+  return levels;
+}
+
+bool atlas_build(TextureAtlas *atlas, const Texture *const *sources,
+                 int count, TextureLayout layout) {
+  *atlas = (TextureAtlas){0};
+  if (count <= 0) {
+    return false;
+  }
+  AtlasItem *items = malloc((size_t)count * sizeof(AtlasItem));
+  atlas->views = calloc((size_t)count, sizeof(Texture));
+  if (!items || !atlas->views) {
+    SDL_Log("Failed to allocate texture atlas");
+    free(items);
+    atlas_destroy(atlas);
+    return false;
+  }
+
+  long long area = 0;
+  int width = 1;
+  for (int i = 0; i < count; i++) {
+    items[i] = (AtlasItem){i, sources[i]->w, sources[i]->h, 0, 0};
+    area += (long long)items[i].w * items[i].h;
+    while (width < items[i].w) {
+      width *= 2;
+    }
+  }
+  qsort(items, (size_t)count, sizeof(AtlasItem), cmp_taller);
+  // Try widths up to about twice square; keep whichever wastes least.
+  int best_width = width;
+  long long best_area = (long long)width * pack(items, count, width, layout);
+  for (width *= 2; (long long)width * width <= 4 * area; width *= 2) {
+    long long packed = (long long)width * pack(items, count, width, layout);
+    if (packed < best_area) {
+      best_area = packed;
+      best_width = width;
+    }
+  }
+  width = best_width;
+  int height = pack(items, count, width, layout);
+
+  Texture *tex = &atlas->texture;
+  *tex = (Texture){.w = width, .h = height};
+  tex->pixels = calloc((size_t)width * (size_t)height, sizeof(u32));
+  if (!tex->pixels) {
+    SDL_Log("Failed to allocate texture atlas");
+    free(items);
+    atlas_destroy(atlas);
+    return false;
+  }
+  for (int i = 0; i < count; i++) {
+    const AtlasItem *item = &items[i];
+    const Texture *src = sources[item->index];
+    for (int y = 0; y < item->h; y++) {
+      u32 *row = tex->pixels + (size_t)(item->y + y) * width + item->x;
+      for (int x = 0; x < item->w; x++) {
+        row[x] = texture_texel(src, 0, x, y);
+      }
+    }
+  }
+  if (!texture_build_mips(tex) || !texture_set_layout(tex, layout)) {
+    free(items);
+    atlas_destroy(atlas);
+    return false;
+  }
+
+  for (int i = 0; i < count; i++) {
+    const AtlasItem *item = &items[i];
+    Texture *view = &atlas->views[item->index];
+    *view = (Texture){
+        .w = item->w,
+        .h = item->h,
+        .wrap = sources[item->index]->wrap,
+        .filter = sources[item->index]->filter,
+        .layout = tex->layout,
+        .stride = width,
+    };
+    int levels = view_levels(item, tex);
+    for (int level = 0; level < levels; level++) {
+      view->levels[level] =
+          tex->levels[level] + texture_texel_offset(tex, level,
+                                                    item->x >> level,
+                                                    item->y >> level);
+    }
+    view->pixels = view->levels[0];
+    view->level_count = levels > 1 ? levels : 0;
+  }
+  atlas->view_count = count;
+  free(items);
+  return true;
+}
+
+void atlas_destroy(TextureAtlas *atlas) {
+  texture_destroy(&atlas->texture);
+  free(atlas->views);
+  *atlas = (TextureAtlas){0};
+}
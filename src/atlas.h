@@ -0,0 +1,24 @@
+#pragma once
+
+#include "types.h"
+#include <stdbool.h>
+
+// Several textures packed into one. Each source is drawn through a view: a
+// Texture of the source's size, wrap mode and filter whose texels (and mip
+// levels) live inside the atlas, so materials sampling different views share
+// one block of memory and keep their neighbours' texels in cache. A view's
+// wrap and filter can be changed freely; bilinear filtering stays inside it.
+typedef struct {
+  Texture texture; // owns the texels and the mip chain
+  Texture *views;  // one per source, in the order given
+  int view_count;
+} TextureAtlas;
+
+// Copies the sources into one atlas, builds its mip chain and stores it in
+// the given layout. Each source is placed at a multiple of its largest
+// power-of-two size factor, so its views keep the mip levels that don't
+// blend in a neighbour; tiled views also lose the last few levels that don't
+// start on a block. The sources can be destroyed afterwards.
+bool atlas_build(TextureAtlas *atlas, const Texture *const *sources,
+                 int count, TextureLayout layout);
+void atlas_destroy(TextureAtlas *atlas);
@@ -0,0 +1,189 @@
+#include "binner.h"
+#include "fill.h"
+#include "shapes.h"
+#include <stdlib.h>
+
+static bool grow(void **data, int *cap, int needed, size_t elem) {
+  if (needed <= *cap) {
+    return true;
+  }
+  int new_cap = (*cap == 0) ? 64 : *cap * 2;
+  while (new_cap < needed) {
+    new_cap *= 2;
+  }
+  void *tmp = realloc(*data, (size_t)new_cap * elem);
+  if (!tmp) {
+    return false;
+  }
+  *data = tmp;
+  *cap = new_cap;
+  return true;
+}
+
+bool binner_init(Binner *binner, JobPool *jobs) {
+  *binner = (Binner){0};
+  binner->jobs = jobs;
+  return true;
+}
+
+void binner_destroy(Binner *binner) {
+  for (int i = 0; i < binner->bin_cap; i++) {
+    free(binner->bins[i].tris);
+  }
+  free(binner->bins);
+  free(binner->tris);
+  *binner = (Binner){0};
+}
+
+void binner_begin(Binner *binner, u32 *buffer, float *depth, HiZ *hiz, int w,
+                  int h) {
+  binner->buffer = buffer;
+  binner->depth = depth;
+  binner->hiz = hiz;
+  binner->w = w;
+  binner->h = h;
+  binner->tiles_x = (w + BIN_TILE_SIZE - 1) / BIN_TILE_SIZE;
+  binner->tiles_y = (h + BIN_TILE_SIZE - 1) / BIN_TILE_SIZE;
+  binner->tri_count = 0;
+  binner->counters = (RasterCounters){0};
+  binner->clear_pending = false;
+
+  int tile_count = binner->tiles_x * binner->tiles_y;
+  if (tile_count > binner->bin_cap) {
+    TileBin *bins = realloc(binner->bins, (size_t)tile_count * sizeof(TileBin));
+    if (!bins) {
+      binner->tiles_x = binner->tiles_y = 0;
+      return;
+    }
+    for (int i = binner->bin_cap; i < tile_count; i++) {
+      bins[i] = (TileBin){0};
+    }
+    binner->bins = bins;
+    binner->bin_cap = tile_count;
+  }
+  // Tile flags only carry over to the same target.
+  if (depth != binner->dirty_depth || w != binner->dirty_w ||
+      h != binner->dirty_h) {
+    binner_invalidate_depth(binner);
+  }
+  for (int i = 0; i < tile_count; i++) {
+    binner->bins[i].count = 0;
+    binner->bins[i].counters = (RasterCounters){0};
+  }
+}
+
+void binner_invalidate_depth(Binner *binner) {
+  binner->dirty_depth = NULL;
+}
+
+void binner_clear_depth(Binner *binner, float value, bool only_dirty) {
+  int tile_count = binner->tiles_x * binner->tiles_y;
+  if (tile_count == 0) {
+    // No bins to defer to.
+    fill_f32(binner->depth, (size_t)binner->w * (size_t)binner->h, value,
+             false);
+    binner->dirty_depth = NULL;
+    return;
+  }
+  if (binner->dirty_depth != binner->depth || binner->clear_value != value) {
+    for (int i = 0; i < tile_count; i++) {
+      binner->bins[i].depth_dirty = true;
+    }
+    binner->dirty_depth = binner->depth;
+    binner->dirty_w = binner->w;
+    binner->dirty_h = binner->h;
+  }
+  binner->clear_pending = true;
+  binner->clear_all = !only_dirty;
+  binner->clear_value = value;
+}
+
+void binner_textured_triangle(Binner *binner, Texture *tex, VertexPC v0,
+                              VertexPC v1, VertexPC v2) {
+  // Also drops triangles too small to reach a pixel centre.
+  v2i box_min, box_max;
+  if (!triangle_pixel_bounds(v0.pos, v1.pos, v2.pos, &box_min, &box_max)) {
+    return;
+  }
+  int min_x = box_min.x, max_x = box_max.x;
+  int min_y = box_min.y, max_y = box_max.y;
+  if (max_x < 0 || max_y < 0 || min_x >= binner->w || min_y >= binner->h) {
+    return;
+  }
+
+  if (!grow((void **)&binner->tris, &binner->tri_cap, binner->tri_count + 1,
+            sizeof(BinTriangle))) {
+    return;
+  }
+  int index = binner->tri_count++;
+  binner->tris[index] = (BinTriangle){{v0, v1, v2}, tex};
+
+  int tx0 = (min_x < 0 ? 0 : min_x) / BIN_TILE_SIZE;
+  int ty0 = (min_y < 0 ? 0 : min_y) / BIN_TILE_SIZE;
+  int tx1 = (max_x >= binner->w ? binner->w - 1 : max_x) / BIN_TILE_SIZE;
+  int ty1 = (max_y >= binner->h ? binner->h - 1 : max_y) / BIN_TILE_SIZE;
+  for (int ty = ty0; ty <= ty1; ty++) {
+    for (int tx = tx0; tx <= tx1; tx++) {
+      TileBin *bin = &binner->bins[ty * binner->tiles_x + tx];
+      if (!grow((void **)&bin->tris, &bin->cap, bin->count + 1, sizeof(int))) {
+        continue;
+      }
+      bin->tris[bin->count++] = index;
+    }
+  }
+}
+
+static void raster_tile(void *user, int tile) {
+  Binner *binner = user;
+  TileBin *bin = &binner->bins[tile];
+  int tx = tile % binner->tiles_x;
+  int ty = tile / binner->tiles_x;
+  v2i clip_min = {tx * BIN_TILE_SIZE, ty * BIN_TILE_SIZE};
+  v2i clip_max = {clip_min.x + BIN_TILE_SIZE - 1,
+                  clip_min.y + BIN_TILE_SIZE - 1};
+
+  if (binner->clear_pending && (binner->clear_all || bin->depth_dirty)) {
+    int x1 = clip_max.x < binner->w ? clip_max.x : binner->w - 1;
+    int y1 = clip_max.y < binner->h ? clip_max.y : binner->h - 1;
+    for (int y = clip_min.y; y <= y1; y++) {
+      fill_f32(&binner->depth[(size_t)y * binner->w + clip_min.x],
+               (size_t)(x1 - clip_min.x + 1), binner->clear_value, false);
+    }
+    bin->depth_dirty = false;
+  }
+  if (bin->count == 0) {
+    return;
+  }
+
+  // Counted locally so neighbouring tiles' workers don't share a cache line.
+  RasterCounters counters = {0};
+  for (int i = 0; i < bin->count; i++) {
+    const BinTriangle *tri = &binner->tris[bin->tris[i]];
+    draw_textured_triangle_rect(binner->buffer, binner->depth, binner->hiz,
+                                binner->w, binner->h, tri->tex, tri->v[0],
+                                tri->v[1], tri->v[2], clip_min, clip_max,
+                                &counters);
+  }
+  bin->counters = counters;
+  if (counters.written > 0) {
+    bin->depth_dirty = true;
+  }
+}
+
+void binner_flush(Binner *binner) {
+  if (binner->tri_count > 0 || binner->clear_pending) {
+    job_pool_parallel_for(binner->jobs, binner->tiles_x * binner->tiles_y,
+                          raster_tile, binner);
+  }
+  binner->clear_pending = false;
+  int tile_count = binner->tiles_x * binner->tiles_y;
+  for (int i = 0; i < tile_count; i++) {
+    TileBin *bin = &binner->bins[i];
+    binner->counters.tested += bin->counters.tested;
+    binner->counters.written += bin->counters.written;
+    binner->counters.hiz_rejected += bin->counters.hiz_rejected;
+    bin->counters = (RasterCounters){0};
+    bin->count = 0;
+  }
+  binner->tri_count = 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "hiz.h"
+#include "jobs.h"
+#include "shapes.h"
+#include "types.h"
+#include <stdbool.h>
+
+#define BIN_TILE_SIZE 64
+
+typedef struct {
+  VertexPC v[3];
+  Texture *tex;
+} BinTriangle;
+
+typedef struct {
+  int *tris;
+  int count;
+  int cap;
+  RasterCounters counters; // written only by the tile's worker
+  bool depth_dirty;        // drawn into since its depth was last cleared
+} TileBin;
+
+// Sorts screen-space triangles into BIN_TILE_SIZE tiles and rasterizes the
+// tiles in parallel. Each tile is owned by one worker and keeps submission
+// order, so depth testing is race-free and matches drawing serially.
+typedef struct {
+  JobPool *jobs;
+  u32 *buffer;
+  float *depth;
+  HiZ *hiz;
+  int w;
+  int h;
+  int tiles_x;
+  int tiles_y;
+  TileBin *bins;
+  int bin_cap;
+  BinTriangle *tris;
+  int tri_count;
+  int tri_cap;
+  RasterCounters counters; // every tile's work since binner_begin
+  // Depth clear deferred to the tiles' workers, see binner_clear_depth.
+  bool clear_pending;
+  bool clear_all; // false: only tiles with depth_dirty
+  float clear_value;
+  const float *dirty_depth; // target depth_dirty describes; NULL for none
+  int dirty_w;
+  int dirty_h;
+} Binner;
+
+bool binner_init(Binner *binner, JobPool *jobs);
+void binner_destroy(Binner *binner);
+// Starts a new batch targeting the given color/depth pair. hiz may be NULL;
+// BIN_TILE_SIZE is a multiple of HIZ_BLOCK so tiles own whole HiZ blocks.
+void binner_begin(Binner *binner, u32 *buffer, float *depth, HiZ *hiz, int w,
+                  int h);
+// Clears the depth target to value at the next flush, each tile by its own
+// worker just before it rasterizes, so the rows are still in cache when the
+// triangles test against them. With only_dirty, tiles nothing was drawn into
+// since they were last cleared to the same value on the same target are
+// skipped; that needs the caller to leave the depth buffer alone between
+// frames (see binner_invalidate_depth).
+void binner_clear_depth(Binner *binner, float value, bool only_dirty);
+// Forgets which tiles are clean, e.g. after the depth buffer was written
+// outside the binner or reallocated at the same address and size.
+void binner_invalidate_depth(Binner *binner);
+void binner_textured_triangle(Binner *binner, Texture *tex, VertexPC v0,
+                              VertexPC v1, VertexPC v2);
+// Runs a pending depth clear, rasterizes everything submitted since
+// binner_begin, adds the tiles' pixel counts to binner->counters and empties
+// the bins.
+void binner_flush(Binner *binner);
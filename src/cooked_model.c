@@ -0,0 +1,291 @@
+#include "cooked_model.h"
+#include "file_map.h"
+#include "render.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// File layout: the header, then positions, vertices, indices, groups,
+// materials and every texture level, each at a multiple of COOKED_ALIGN.
+typedef struct {
+  u32 magic;
+  u32 version;
+  u32 position_count;
+  u32 vertex_count;
+  u32 index_count;
+  u32 group_count;
+  u32 material_count;
+  u32 has_bounds;
+  v3f bounds_min;
+  v3f bounds_max;
+  uint64_t positions; // file offsets of the sections
+  uint64_t vertices;
+  uint64_t indices;
+  uint64_t groups;
+  uint64_t materials;
+} CookedHeader;
+
+typedef struct {
+  char name[64];
+  u32 has_diffuse;
+  u32 w;
+  u32 h;
+  u32 wrap;
+  u32 filter;
+  u32 layout;
+  u32 level_count; // as in Texture: 0 without a mip chain
+  u32 reserved;
+  uint64_t levels[TEXTURE_MAX_LEVELS]; // file offsets, level 0 first
+} CookedMaterial;
+
+// The arrays are used in place, so their layout is the file's.
+_Static_assert(sizeof(v3f) == 12, "cooked positions are 3 floats");
+_Static_assert(sizeof(MeshVertex) == 12, "cooked vertices are 12 bytes");
+_Static_assert(sizeof(MeshGroup) == 12, "cooked groups are 12 bytes");
+_Static_assert(sizeof(CookedHeader) == 96, "cooked header is 96 bytes");
+_Static_assert(sizeof(CookedMaterial) == 224, "cooked material is 224 bytes");
+
+static uint64_t align_up(uint64_t n) {
+  return (n + COOKED_ALIGN - 1) / COOKED_ALIGN * COOKED_ALIGN;
+}
+
+// Claims the next aligned section of the file.
+static uint64_t reserve(uint64_t *end, size_t size) {
+  uint64_t offset = *end;
+  *end = align_up(offset + size);
+  return offset;
+}
+
+// Zero-pads from *pos up to offset, then writes the section there.
+static bool write_section(FILE *f, uint64_t *pos, uint64_t offset,
+                          const void *data, size_t size) {
+  static const char zeros[COOKED_ALIGN];
+  while (*pos < offset) {
+    size_t pad = offset - *pos < COOKED_ALIGN ? (size_t)(offset - *pos)
+                                              : COOKED_ALIGN;
+    if (fwrite(zeros, 1, pad, f) != pad) {
+      return false;
+    }
+    *pos += pad;
+  }
+  if (size > 0 && fwrite(data, 1, size, f) != size) {
+    return false;
+  }
+  *pos += size;
+  return true;
+}
+
+static int texture_levels(const Texture *tex) {
+  return tex->level_count > 1 ? tex->level_count : 1;
+}
+
+bool cooked_model_write(const ObjModel *model, const char *path) {
+  const Mesh *mesh = &model->mesh;
+  CookedHeader header = {
+      .magic = COOKED_MAGIC,
+      .version = COOKED_VERSION,
+      .position_count = (u32)mesh->position_count,
+      .vertex_count = (u32)mesh->vertex_count,
+      .index_count = (u32)mesh->index_count,
+      .group_count = (u32)mesh->group_count,
+      .material_count = (u32)model->material_count,
+      .has_bounds = mesh->has_bounds,
+      .bounds_min = mesh->bounds_min,
+      .bounds_max = mesh->bounds_max,
+  };
+  uint64_t end = align_up(sizeof(header));
+  header.positions = reserve(&end, (size_t)mesh->position_count * sizeof(v3f));
+  header.vertices =
+      reserve(&end, (size_t)mesh->vertex_count * sizeof(MeshVertex));
+  header.indices = reserve(&end, (size_t)mesh->index_count * sizeof(u32));
+  header.groups = reserve(&end, (size_t)mesh->group_count * sizeof(MeshGroup));
+  header.materials = reserve(
+      &end, (size_t)model->material_count * sizeof(CookedMaterial));
+
+  CookedMaterial *mats = NULL;
+  if (model->material_count > 0) {
+    mats = calloc((size_t)model->material_count, sizeof(CookedMaterial));
+  }
+  if (!mats) {
+    SDL_Log("Failed to allocate cooked materials");
+    return false;
+  }
+  for (int i = 0; i < model->material_count; i++) {
+    const ObjMaterial *src = &model->materials[i];
+    const Texture *tex = &src->diffuse;
+    CookedMaterial *mat = &mats[i];
+    memcpy(mat->name, src->name, sizeof(mat->name) - 1);
+    if (!src->has_diffuse) {
+      continue;
+    }
+    if (tex->stride != 0 && tex->stride != tex->w) {
+      SDL_Log("Cannot cook material '%s': its texture is an atlas view",
+              mat->name);
+      free(mats);
+      return false;
+    }
+    mat->has_diffuse = 1;
+    mat->w = (u32)tex->w;
+    mat->h = (u32)tex->h;
+    mat->wrap = tex->wrap;
+    mat->filter = tex->filter;
+    mat->layout = tex->layout;
+    mat->level_count = (u32)tex->level_count;
+    for (int level = 0; level < texture_levels(tex); level++) {
+      mat->levels[level] =
+          reserve(&end, texture_level_size(tex, level) * sizeof(u32));
+    }
+  }
+
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    SDL_Log("Failed to open '%s' for writing", path);
+    free(mats);
+    return false;
+  }
+  uint64_t pos = 0;
+  bool ok =
+      write_section(f, &pos, 0, &header, sizeof(header)) &&
+      write_section(f, &pos, header.positions, mesh->positions,
+                    (size_t)mesh->position_count * sizeof(v3f)) &&
+      write_section(f, &pos, header.vertices, mesh->vertices,
+                    (size_t)mesh->vertex_count * sizeof(MeshVertex)) &&
+      write_section(f, &pos, header.indices, mesh->indices,
+                    (size_t)mesh->index_count * sizeof(u32)) &&
+      write_section(f, &pos, header.groups, mesh->groups,
+                    (size_t)mesh->group_count * sizeof(MeshGroup)) &&
+      write_section(f, &pos, header.materials, mats,
+                    (size_t)model->material_count * sizeof(CookedMaterial));
+  for (int i = 0; ok && i < model->material_count; i++) {
+    const Texture *tex = &model->materials[i].diffuse;
+    for (int level = 0; mats[i].has_diffuse && level < texture_levels(tex);
+         level++) {
+      const u32 *texels = level == 0 ? tex->pixels : tex->levels[level];
+      ok = ok && write_section(f, &pos, mats[i].levels[level], texels,
+                               texture_level_size(tex, level) * sizeof(u32));
+    }
+  }
+  // Pad the end too, so the last section can be read a line at a time.
+  ok = ok && write_section(f, &pos, end, NULL, 0);
+  free(mats);
+  if (fclose(f) != 0 || !ok) {
+    SDL_Log("Failed to write '%s'", path);
+    remove(path);
+    return false;
+  }
+  return true;
+}
+
+// Whether count elements at offset lie inside the file, on a section start.
+static bool section_ok(size_t file_size, uint64_t offset, size_t count,
+                       size_t elem) {
+  return offset % COOKED_ALIGN == 0 && offset <= file_size &&
+         count <= (file_size - offset) / elem;
+}
+
+static bool texture_from_file(const CookedMaterial *mat, u8 *file,
+                              size_t size, Texture *tex) {
+  if (mat->w == 0 || mat->h == 0 || mat->w > 32768 || mat->h > 32768 ||
+      mat->wrap > TEXTURE_REPEAT || mat->filter > TEXTURE_BILINEAR ||
+      mat->layout > TEXTURE_TILED || mat->level_count == 1 ||
+      mat->level_count > TEXTURE_MAX_LEVELS) {
+    return false;
+  }
+  *tex = (Texture){
+      .w = (int)mat->w,
+      .h = (int)mat->h,
+      .wrap = (TextureWrap)mat->wrap,
+      .filter = (TextureFilter)mat->filter,
+      .layout = (TextureLayout)mat->layout,
+      .stride = (int)mat->w, // the file owns the texels
+      .level_count = (int)mat->level_count,
+  };
+  for (int level = 0; level < texture_levels(tex); level++) {
+    if (!section_ok(size, mat->levels[level], texture_level_size(tex, level),
+                    sizeof(u32))) {
+      return false;
+    }
+    tex->levels[level] = (u32 *)(file + mat->levels[level]);
+  }
+  tex->pixels = tex->levels[0];
+  return true;
+}
+
+bool cooked_model_load(const char *path, ObjModel *out) {
+  *out = (ObjModel){0};
+  size_t size = 0;
+  u8 *file = file_map(path, &size);
+  if (!file) {
+    return false;
+  }
+  const CookedHeader *header = (const CookedHeader *)file;
+  if (size < sizeof(CookedHeader) || header->magic != COOKED_MAGIC ||
+      header->version != COOKED_VERSION ||
+      header->position_count > INT32_MAX || header->vertex_count > INT32_MAX ||
+      header->index_count > INT32_MAX || header->group_count > INT32_MAX ||
+      header->material_count == 0 || header->material_count > INT32_MAX ||
+      !section_ok(size, header->positions, header->position_count,
+                  sizeof(v3f)) ||
+      !section_ok(size, header->vertices, header->vertex_count,
+                  sizeof(MeshVertex)) ||
+      !section_ok(size, header->indices, header->index_count, sizeof(u32)) ||
+      !section_ok(size, header->groups, header->group_count,
+                  sizeof(MeshGroup)) ||
+      !section_ok(size, header->materials, header->material_count,
+                  sizeof(CookedMaterial))) {
+    SDL_Log("'%s' is not a cooked model of this version", path);
+    file_unmap(file, size);
+    return false;
+  }
+
+  Mesh *mesh = &out->mesh;
+  // Caps equal to the counts: the arrays can't grow in place.
+  mesh->positions = (v3f *)(file + header->positions);
+  mesh->position_count = mesh->position_cap = (int)header->position_count;
+  mesh->vertices = (MeshVertex *)(file + header->vertices);
+  mesh->vertex_count = mesh->vertex_cap = (int)header->vertex_count;
+  mesh->indices = (u32 *)(file + header->indices);
+  mesh->index_count = mesh->index_cap = (int)header->index_count;
+  mesh->groups = (MeshGroup *)(file + header->groups);
+  mesh->group_count = mesh->group_cap = (int)header->group_count;
+  mesh->bounds_min = header->bounds_min;
+  mesh->bounds_max = header->bounds_max;
+  mesh->has_bounds = header->has_bounds != 0;
+  out->file = file;
+  out->file_size = size;
+
+  int material_count = (int)header->material_count;
+  out->materials = calloc((size_t)material_count, sizeof(ObjMaterial));
+  if (!out->materials) {
+    SDL_Log("Failed to allocate materials for '%s'", path);
+    obj_model_free(out);
+    return false;
+  }
+  out->material_count = material_count;
+  const CookedMaterial *mats =
+      (const CookedMaterial *)(file + header->materials);
+  bool ok = true;
+  for (int i = 0; ok && i < material_count; i++) {
+    ObjMaterial *mat = &out->materials[i];
+    memcpy(mat->name, mats[i].name, sizeof(mat->name) - 1);
+    mat->has_diffuse = mats[i].has_diffuse != 0;
+    ok = mats[i].has_diffuse <= 1 &&
+         (!mat->has_diffuse ||
+          texture_from_file(&mats[i], file, size, &mat->diffuse));
+  }
+  for (int i = 0; ok && i < mesh->group_count; i++) {
+    const MeshGroup *group = &mesh->groups[i];
+    ok = group->first >= 0 && group->count >= 0 && group->count % 3 == 0 &&
+         group->first <= mesh->index_count - group->count &&
+         group->material >= 0 && group->material < material_count;
+  }
+  if (!ok) {
+    SDL_Log("'%s' has an invalid material or group", path);
+    obj_model_free(out);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "obj_loader.h"
+#include "types.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Cooked models: an ObjModel saved in the layout it has in memory, so
+// loading is mapping the file and pointing the mesh arrays and texels into
+// it, with no parsing or image decoding. Textures keep their mip chain and
+// memory layout. The format follows the host's byte order and struct layout;
+// a file from a different one is rejected, not converted.
+#define COOKED_MAGIC 0x4D443353u // "S3DM" in little-endian order
+#define COOKED_VERSION 1
+// Sections and texture levels start on a cache line.
+#define COOKED_ALIGN 64
+
+// Writes the model's mesh, materials and textures (with their mip levels)
+// to path. The file is meant to be regenerated with the build, not kept
+// across versions of the renderer.
+bool cooked_model_write(const ObjModel *model, const char *path);
+// Maps a cooked file (file_map) into an ObjModel that obj_model_free
+// releases. Section bounds and material fields are checked; vertex and index
+// contents are trusted, as the cooker wrote them from a validated OBJ.
+bool cooked_model_load(const char *path, ObjModel *out);
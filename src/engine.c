@@ -1,6 +1,10 @@
 #include "engine.h"
+#include "assets.h"
 #include "colors.h"
 #include "math.h"
+#include "mesh.h"
+#include "pipeline.h"
+#include "profiler.h"
 #include "render.h"
 #include "shapes.h"
 #include "text.h"
@@ -48,7 +52,13 @@ typedef struct
 {
   Game game;
   Camera camera;
-  Texture texture;
+  S3DContext s3d;
+  Profiler profiler;
+  bool show_profiler;
+  Mesh cube;
+  S3DMaterial material;
+  AssetManager assets;
+  AssetHandle texture; // the fallback stands in until it has loaded
   bool wireframe;
   float fps;
   Uint32 last_ticks;
@@ -58,12 +68,6 @@ typedef struct
   float mouse_sens;
 } Engine;
 
-typedef struct
-{
-  v3f view_pos;
-  v2f uv;
-} ClipVert;
-
 static v3f camera_forward(const Camera *cam)
 {
   float cy = cosf(cam->yaw);
@@ -73,14 +77,6 @@ static v3f camera_forward(const Camera *cam)
   return v3_normalize((v3f){sy * cp, sp, -cy * cp});
 }
 
-static void clear_depth(float *depth, size_t count)
-{
-  for (size_t i = 0; i < count; i++)
-  {
-    depth[i] = 1.0f;
-  }
-}
-
 static void resize_render(Game *game, int window_w, int window_h,
                           int render_scale)
 {
@@ -107,92 +103,6 @@ static void resize_render(Game *game, int window_w, int window_h,
   }
 }
 
-static const Vertex3D cube_vertices[] = {
-    // Front (-Z)
-    {{-0.5f, -0.5f, -0.5f}, {0.0f, 1.0f}},
-    {{0.5f, -0.5f, -0.5f}, {1.0f, 1.0f}},
-    {{0.5f, 0.5f, -0.5f}, {1.0f, 0.0f}},
-    {{-0.5f, 0.5f, -0.5f}, {0.0f, 0.0f}},
-    // Back (+Z)
-    {{0.5f, -0.5f, 0.5f}, {0.0f, 1.0f}},
-    {{-0.5f, -0.5f, 0.5f}, {1.0f, 1.0f}},
-    {{-0.5f, 0.5f, 0.5f}, {1.0f, 0.0f}},
-    {{0.5f, 0.5f, 0.5f}, {0.0f, 0.0f}},
-    // Left (-X)
-    {{-0.5f, -0.5f, 0.5f}, {0.0f, 1.0f}},
-    {{-0.5f, -0.5f, -0.5f}, {1.0f, 1.0f}},
-    {{-0.5f, 0.5f, -0.5f}, {1.0f, 0.0f}},
-    {{-0.5f, 0.5f, 0.5f}, {0.0f, 0.0f}},
-    // Right (+X)
-    {{0.5f, -0.5f, -0.5f}, {0.0f, 1.0f}},
-    {{0.5f, -0.5f, 0.5f}, {1.0f, 1.0f}},
-    {{0.5f, 0.5f, 0.5f}, {1.0f, 0.0f}},
-    {{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f}},
-    // Top (+Y)
-    {{-0.5f, 0.5f, -0.5f}, {0.0f, 1.0f}},
-    {{0.5f, 0.5f, -0.5f}, {1.0f, 1.0f}},
-    {{0.5f, 0.5f, 0.5f}, {1.0f, 0.0f}},
-    {{-0.5f, 0.5f, 0.5f}, {0.0f, 0.0f}},
-    // Bottom (-Y)
-    {{-0.5f, -0.5f, 0.5f}, {0.0f, 1.0f}},
-    {{0.5f, -0.5f, 0.5f}, {1.0f, 1.0f}},
-    {{0.5f, -0.5f, -0.5f}, {1.0f, 0.0f}},
-    {{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f}},
-};
-
-static const int cube_indices[][3] = {
-    {0, 1, 2}, {0, 2, 3}, // front
-    {4, 5, 6},
-    {4, 6, 7}, // back
-    {8, 9, 10},
-    {8, 10, 11}, // left
-    {12, 13, 14},
-    {12, 14, 15}, // right
-    {16, 17, 18},
-    {16, 18, 19}, // top
-    {20, 21, 22},
-    {20, 22, 23} // bottom
-};
-
-static const int cube_vertex_count =
-    (int)(sizeof(cube_vertices) / sizeof(cube_vertices[0]));
-static const int cube_triangle_count =
-    (int)(sizeof(cube_indices) / sizeof(cube_indices[0]));
-
-static bool project_vertex(const ClipVert *cv, const mat4 *proj, int render_w,
-                           int render_h, VertexPC *out, int *mask_out)
-{
-  v4f clip = mat4_mul_v4(
-      *proj, (v4f){cv->view_pos.x, cv->view_pos.y, cv->view_pos.z, 1.0f});
-  if (clip.w == 0.0f)
-  {
-    return false;
-  }
-
-  int mask = 0;
-  if (clip.x < -clip.w)
-    mask |= 1;
-  if (clip.x > clip.w)
-    mask |= 2;
-  if (clip.y < -clip.w)
-    mask |= 4;
-  if (clip.y > clip.w)
-    mask |= 8;
-  if (clip.z < 0.0f)
-    mask |= 16;
-  if (clip.z > clip.w)
-    mask |= 32;
-
-  float inv_w = 1.0f / clip.w;
-  v3f ndc = {clip.x * inv_w, clip.y * inv_w, clip.z * inv_w};
-  out->pos = norm_to_screen((v2f){ndc.x, ndc.y}, render_w, render_h);
-  out->uv = cv->uv;
-  out->inv_w = inv_w;
-  out->depth = 0.5f * (ndc.z + 1.0f);
-  *mask_out = mask;
-  return true;
-}
-
 static bool engine_init(Engine *eng)
 {
   *eng = (Engine){0};
@@ -218,13 +128,14 @@ static bool engine_init(Engine *eng)
     return false;
   }
 
-  const char *texture_path = "assets/brick.png";
-  if (!texture_load(&eng->texture, texture_path))
+  if (!asset_manager_init(&eng->assets, 4, 0))
   {
     IMG_Quit();
     SDL_Quit();
     return false;
   }
+  eng->texture =
+      asset_request(&eng->assets, "assets/brick.png", ASSET_TEXTURE);
 
   const char *title = "A: Hello Window";
   eng->game.window =
@@ -234,7 +145,7 @@ static bool engine_init(Engine *eng)
   if (eng->game.window == NULL)
   {
     SDL_Log("Failed to create Window: %s\n", SDL_GetError());
-    texture_destroy(&eng->texture);
+    asset_manager_destroy(&eng->assets);
     IMG_Quit();
     SDL_Quit();
     return false;
@@ -247,7 +158,7 @@ static bool engine_init(Engine *eng)
   {
     SDL_Log("Failed to create Renderer: %s\n", SDL_GetError());
     SDL_DestroyWindow(eng->game.window);
-    texture_destroy(&eng->texture);
+    asset_manager_destroy(&eng->assets);
     IMG_Quit();
     SDL_Quit();
     return false;
@@ -261,11 +172,27 @@ static bool engine_init(Engine *eng)
   eng->fps = 0.0f;
   eng->last_ticks = SDL_GetTicks();
   eng->running = true;
+  if (!mesh_build_cube(&eng->cube) || !s3d_init(&eng->s3d, 0))
+  {
+    mesh_free(&eng->cube);
+    SDL_DestroyRenderer(eng->game.renderer);
+    SDL_DestroyWindow(eng->game.window);
+    asset_manager_destroy(&eng->assets);
+    IMG_Quit();
+    SDL_Quit();
+    return false;
+  }
+  profiler_init(&eng->profiler);
+  eng->s3d.profiler = &eng->profiler;
+  eng->s3d.reuse_depth = true;
   return true;
 }
 
 static void engine_shutdown(Engine *eng)
 {
+  s3d_destroy(&eng->s3d);
+  profiler_destroy(&eng->profiler);
+  mesh_free(&eng->cube);
   if (eng->game.buffer)
   {
     free(eng->game.buffer);
@@ -276,7 +203,7 @@ static void engine_shutdown(Engine *eng)
     free(eng->game.depth);
     eng->game.depth = NULL;
   }
-  texture_destroy(&eng->texture);
+  asset_manager_destroy(&eng->assets);
   if (eng->game.texture)
   {
     SDL_DestroyTexture(eng->game.texture);
@@ -309,6 +236,7 @@ static void engine_handle_event(Engine *eng, const SDL_Event *event)
     {
       resize_render(&eng->game, event->window.data1, event->window.data2,
                     eng->render_scale);
+      s3d_invalidate_depth(&eng->s3d);
     }
     break;
   case SDL_MOUSEMOTION:
@@ -327,6 +255,14 @@ static void engine_handle_event(Engine *eng, const SDL_Event *event)
     {
       eng->wireframe = !eng->wireframe;
     }
+    if (event->key.keysym.sym == SDLK_p)
+    {
+      eng->show_profiler = !eng->show_profiler;
+    }
+    if (event->key.keysym.sym == SDLK_t)
+    {
+      profiler_start_trace(&eng->profiler, "trace.json", 120);
+    }
     if (event->key.keysym.sym == SDLK_q)
     {
       game->mouse_grabbed = !game->mouse_grabbed;
@@ -343,6 +279,7 @@ static void engine_handle_event(Engine *eng, const SDL_Event *event)
         int w, h;
         SDL_GetWindowSize(game->window, &w, &h);
         resize_render(&eng->game, w, h, eng->render_scale);
+        s3d_invalidate_depth(&eng->s3d);
       }
     }
     break;
@@ -410,8 +347,9 @@ static void engine_frame(Engine *eng, Uint32 now, float dt)
   if (eng->camera.pitch < -max_pitch)
     eng->camera.pitch = -max_pitch;
 
-  memset(game->buffer, 0, game->render_w * game->render_h * sizeof(u32));
-  clear_depth(game->depth, (size_t)game->render_w * (size_t)game->render_h);
+  s3d_begin(&eng->s3d, game->buffer, game->depth, (int)game->render_w,
+            (int)game->render_h);
+  s3d_clear(&eng->s3d, 0);
 
   float aspect = (float)game->render_w / (float)game->render_h;
   float angle = (float)now * 0.001f;
@@ -421,231 +359,32 @@ static void engine_frame(Engine *eng, Uint32 now, float dt)
       world_up);
   mat4 proj =
       mat4_perspective((float)M_PI / 3.0f, aspect, eng->near_plane, 100.0f);
-  mat4 mv = mat4_mul(view, model);
-
-  typedef struct
-  {
-    v2i screen;
-    v2f uv;
-    v3f view_pos;
-    float inv_w;
-    float depth;
-    int clip_mask;
-    bool depth_ok;
-  } CachedVertex;
-  CachedVertex cached[cube_vertex_count];
-
-  for (int i = 0; i < cube_vertex_count; i++)
-  {
-    v4f world = {cube_vertices[i].pos.x, cube_vertices[i].pos.y,
-                 cube_vertices[i].pos.z, 1.0f};
-    v4f view_pos4 = mat4_mul_v4(mv, world);
-    v4f clip = mat4_mul_v4(proj, view_pos4);
-
-    cached[i].uv = cube_vertices[i].uv;
-    cached[i].view_pos = (v3f){view_pos4.x, view_pos4.y, view_pos4.z};
-
-    int mask = 0;
-    if (clip.w == 0.0f)
-    {
-      cached[i].clip_mask = 0x3F; // force cull
-      cached[i].depth_ok = false;
-      continue;
-    }
-    if (clip.x < -clip.w)
-      mask |= 1;
-    if (clip.x > clip.w)
-      mask |= 2;
-    if (clip.y < -clip.w)
-      mask |= 4;
-    if (clip.y > clip.w)
-      mask |= 8;
-    if (clip.z < 0.0f)
-      mask |= 16;
-    if (clip.z > clip.w)
-      mask |= 32;
-    cached[i].clip_mask = mask;
+  mat4 mvp = mat4_mul(proj, mat4_mul(view, model));
 
-    float inv_w = 1.0f / clip.w;
-    cached[i].inv_w = inv_w;
-    v3f ndc = {clip.x * inv_w, clip.y * inv_w, clip.z * inv_w};
-    cached[i].depth_ok = ndc.z >= 0.0f && ndc.z <= 1.0f;
-    cached[i].screen =
-        norm_to_screen((v2f){ndc.x, ndc.y}, game->render_w, game->render_h);
-    cached[i].depth = 0.5f * (ndc.z + 1.0f);
-  }
-
-  for (int tri_idx = 0; tri_idx < cube_triangle_count; tri_idx++)
-  {
-    const int i0 = cube_indices[tri_idx][0];
-    const int i1 = cube_indices[tri_idx][1];
-    const int i2 = cube_indices[tri_idx][2];
-    const CachedVertex *v0 = &cached[i0];
-    const CachedVertex *v1 = &cached[i1];
-    const CachedVertex *v2 = &cached[i2];
-
-    if ((v0->clip_mask & v1->clip_mask & v2->clip_mask) != 0)
-    {
-      continue; // frustum culled
-    }
-
-    bool near_in[3] = {v0->view_pos.z <= -eng->near_plane,
-                       v1->view_pos.z <= -eng->near_plane,
-                       v2->view_pos.z <= -eng->near_plane};
-    bool needs_clip = !(near_in[0] && near_in[1] && near_in[2]);
-
-    if (!needs_clip)
-    {
-      if (!v0->depth_ok || !v1->depth_ok || !v2->depth_ok)
-      {
-        continue;
-      }
-      v3f edge1 = v3_sub(v1->view_pos, v0->view_pos);
-      v3f edge2 = v3_sub(v2->view_pos, v0->view_pos);
-      v3f normal = v3_cross(edge1, edge2);
-      if (normal.z >= 0.0f)
-      {
-        continue; // backface
-      }
-
-      VertexPC pv[3] = {
-          {.pos = v0->screen,
-           .uv = v0->uv,
-           .inv_w = v0->inv_w,
-           .depth = v0->depth},
-          {.pos = v1->screen,
-           .uv = v1->uv,
-           .inv_w = v1->inv_w,
-           .depth = v1->depth},
-          {.pos = v2->screen,
-           .uv = v2->uv,
-           .inv_w = v2->inv_w,
-           .depth = v2->depth},
-      };
-
-      if (eng->wireframe)
-      {
-        draw_triangle(game->buffer, game->render_w, game->render_h, pv[0].pos,
-                      pv[1].pos, pv[2].pos, WHITE, WIREFRAME);
-      }
-      else
-      {
-        draw_textured_triangle(game->buffer, game->depth, game->render_w,
-                               game->render_h, &eng->texture, pv[0], pv[1],
-                               pv[2]);
-      }
-    }
-    else
-    {
-      ClipVert in_poly[4] = {
-          {.view_pos = v0->view_pos, .uv = v0->uv},
-          {.view_pos = v1->view_pos, .uv = v1->uv},
-          {.view_pos = v2->view_pos, .uv = v2->uv},
-      };
-      int in_count = 3;
-      ClipVert out_poly[4];
-      int out_count = 0;
-
-      for (int i = 0; i < in_count; i++)
-      {
-        ClipVert a = in_poly[i];
-        ClipVert b = in_poly[(i + 1) % in_count];
-        bool a_in = a.view_pos.z <= -eng->near_plane;
-        bool b_in = b.view_pos.z <= -eng->near_plane;
-
-        if (a_in && b_in)
-        {
-          out_poly[out_count++] = b;
-        }
-        else if (a_in && !b_in)
-        {
-          float t =
-              (-eng->near_plane - a.view_pos.z) / (b.view_pos.z - a.view_pos.z);
-          ClipVert inter = {
-              .view_pos = {a.view_pos.x + (b.view_pos.x - a.view_pos.x) * t,
-                           a.view_pos.y + (b.view_pos.y - a.view_pos.y) * t,
-                           -eng->near_plane},
-              .uv = {a.uv.x + (b.uv.x - a.uv.x) * t,
-                     a.uv.y + (b.uv.y - a.uv.y) * t}};
-          out_poly[out_count++] = inter;
-        }
-        else if (!a_in && b_in)
-        {
-          float t =
-              (-eng->near_plane - a.view_pos.z) / (b.view_pos.z - a.view_pos.z);
-          ClipVert inter = {
-              .view_pos = {a.view_pos.x + (b.view_pos.x - a.view_pos.x) * t,
-                           a.view_pos.y + (b.view_pos.y - a.view_pos.y) * t,
-                           -eng->near_plane},
-              .uv = {a.uv.x + (b.uv.x - a.uv.x) * t,
-                     a.uv.y + (b.uv.y - a.uv.y) * t}};
-          out_poly[out_count++] = inter;
-          out_poly[out_count++] = b;
-        }
-      }
-
-      if (out_count < 3)
-      {
-        continue;
-      }
-
-      int tri_sets[2][3] = {{0, 1, 2}, {0, 2, 3}};
-      int tri_total = (out_count == 4) ? 2 : 1;
-
-      for (int t = 0; t < tri_total; t++)
-      {
-        ClipVert *a = &out_poly[tri_sets[t][0]];
-        ClipVert *b = &out_poly[tri_sets[t][1]];
-        ClipVert *c = &out_poly[tri_sets[t][2]];
-
-        v3f edge1 = v3_sub(b->view_pos, a->view_pos);
-        v3f edge2 = v3_sub(c->view_pos, a->view_pos);
-        v3f normal = v3_cross(edge1, edge2);
-        if (normal.z >= 0.0f)
-        {
-          continue; // backface
-        }
-
-        VertexPC pv[3];
-        int masks[3];
-        if (!project_vertex(a, &proj, game->render_w, game->render_h, &pv[0],
-                            &masks[0]) ||
-            !project_vertex(b, &proj, game->render_w, game->render_h, &pv[1],
-                            &masks[1]) ||
-            !project_vertex(c, &proj, game->render_w, game->render_h, &pv[2],
-                            &masks[2]))
-        {
-          continue;
-        }
-        if ((masks[0] & masks[1] & masks[2]) != 0)
-        {
-          continue;
-        }
-
-        if (eng->wireframe)
-        {
-          draw_triangle(game->buffer, game->render_w, game->render_h, pv[0].pos,
-                        pv[1].pos, pv[2].pos, WHITE, WIREFRAME);
-        }
-        else
-        {
-          draw_textured_triangle(game->buffer, game->depth, game->render_w,
-                                 game->render_h, &eng->texture, pv[0], pv[1],
-                                 pv[2]);
-        }
-      }
-    }
-  }
+  asset_manager_update(&eng->assets);
+  eng->material.texture = asset_texture(&eng->assets, eng->texture);
+  eng->s3d.wireframe = eng->wireframe;
+  s3d_draw_mesh(&eng->s3d, &eng->cube, mvp, &eng->material);
+  s3d_end(&eng->s3d);
 
+  Uint64 hud_start = profiler_begin(&eng->profiler);
   char fps_text[32];
   snprintf(fps_text, sizeof(fps_text), "FPS %d", (int)(eng->fps + 0.5f));
   draw_text(game->buffer, game->render_w, (v2i){5, 5}, fps_text, WHITE);
+  if (eng->show_profiler)
+  {
+    profiler_draw(&eng->profiler, game->buffer, (int)game->render_w,
+                  (int)game->render_h, (v2i){5, 20}, WHITE);
+  }
+  profiler_end(&eng->profiler, PROF_HUD, hud_start);
 
+  Uint64 present_start = profiler_begin(&eng->profiler);
   SDL_UpdateTexture(game->texture, NULL, game->buffer, game->pitch);
   SDL_RenderClear(game->renderer);
   SDL_Rect dest = {0, 0, (int)game->window_w, (int)game->window_h};
   SDL_RenderCopy(game->renderer, game->texture, NULL, &dest);
   SDL_RenderPresent(game->renderer);
+  profiler_end(&eng->profiler, PROF_PRESENT, present_start);
 }
 
 int engine_run(void)
@@ -667,12 +406,14 @@ int engine_run(void)
       eng.fps = eng.fps * 0.9f + inst * 0.1f;
     }
 
+    profiler_begin_frame(&eng.profiler);
     while (SDL_PollEvent(&eng.game.event))
     {
       engine_handle_event(&eng, &eng.game.event);
     }
 
     engine_frame(&eng, now, dt);
+    profiler_end_frame(&eng.profiler);
   }
 
   engine_shutdown(&eng);
@@ -0,0 +1,63 @@
+#include "file_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define FILE_MMAP 0
+#endif
+
+void *file_map(const char *path, size_t *size) {
+#if FILE_MMAP
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return NULL;
+  }
+  void *data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  *size = (size_t)st.st_size;
+  return data;
+#else
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return NULL;
+  }
+  long len = -1;
+  if (fseek(f, 0, SEEK_END) == 0) {
+    len = ftell(f);
+  }
+  void *data = len > 0 ? malloc((size_t)len) : NULL;
+  if (!data || fseek(f, 0, SEEK_SET) != 0 ||
+      fread(data, 1, (size_t)len, f) != (size_t)len) {
+    free(data);
+    fclose(f);
+    return NULL;
+  }
+  fclose(f);
+  *size = (size_t)len;
+  return data;
+#endif
+}
+
+void file_unmap(void *data, size_t size) {
+#if FILE_MMAP
+  munmap(data, size);
+#else
+  (void)size;
+  free(data);
+#endif
+}
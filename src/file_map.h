@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+
+// A whole file in memory: mapped private and writable where mmap exists
+// (pages load on first touch and are copied only when written), read into
+// a malloc'd buffer elsewhere. NULL for a missing or empty file.
+void *file_map(const char *path, size_t *size);
+void file_unmap(void *data, size_t size);
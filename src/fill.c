@@ -0,0 +1,67 @@
+#include "fill.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    (defined(__x86_64__) || defined(__i386__))
+#define FILL_X86 1
+#include <immintrin.h>
+#else
+#define FILL_X86 0
+#endif
+
+#if FILL_X86
+// Scalar head up to the first 16-byte boundary, 64 bytes per iteration, then
+// the scalar tail. (-O2 leaves the plain loop below scalar.)
+__attribute__((target("sse2"))) static void
+fill_sse2(u32 *dst, size_t count, u32 value, bool stream) {
+  while (count > 0 && ((uintptr_t)dst & 15) != 0) {
+    *dst++ = value;
+    count--;
+  }
+  __m128i v = _mm_set1_epi32((int)value);
+  if (stream) {
+    for (; count >= 16; dst += 16, count -= 16) {
+      _mm_stream_si128((__m128i *)dst, v);
+      _mm_stream_si128((__m128i *)(dst + 4), v);
+      _mm_stream_si128((__m128i *)(dst + 8), v);
+      _mm_stream_si128((__m128i *)(dst + 12), v);
+    }
+    // Streaming stores are weakly ordered; make them visible before anyone
+    // (another worker included) reads the buffer.
+    _mm_sfence();
+  } else {
+    for (; count >= 16; dst += 16, count -= 16) {
+      _mm_store_si128((__m128i *)dst, v);
+      _mm_store_si128((__m128i *)(dst + 4), v);
+      _mm_store_si128((__m128i *)(dst + 8), v);
+      _mm_store_si128((__m128i *)(dst + 12), v);
+    }
+  }
+  while (count > 0) {
+    *dst++ = value;
+    count--;
+  }
+}
+#endif
+
+void fill_u32(u32 *dst, size_t count, u32 value, bool stream) {
+#if FILL_X86
+  if (count >= 16 && SDL_HasSSE2()) {
+    fill_sse2(dst, count, value, stream);
+    return;
+  }
+#endif
+  (void)stream;
+  for (size_t i = 0; i < count; i++) {
+    dst[i] = value;
+  }
+}
+
+void fill_f32(float *dst, size_t count, float value, bool stream) {
+  u32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  fill_u32((u32 *)dst, count, bits, stream);
+}
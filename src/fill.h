@@ -0,0 +1,15 @@
+#pragma once
+
+#include "types.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Targets at least this big are cleared with streaming stores: they would be
+// evicted before they are drawn over anyway, and streaming skips reading them
+// in first.
+#define FILL_STREAM_BYTES (16u << 20)
+
+// Sets count elements to value, with SSE2 stores where available. stream
+// uses non-temporal stores, which bypass the cache.
+void fill_u32(u32 *dst, size_t count, u32 value, bool stream);
+void fill_f32(float *dst, size_t count, float value, bool stream);
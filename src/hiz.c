@@ -0,0 +1,32 @@
+#include "hiz.h"
+#include <stdlib.h>
+
+bool hiz_resize(HiZ *hiz, int w, int h) {
+  int bw = (w + HIZ_BLOCK - 1) / HIZ_BLOCK;
+  int bh = (h + HIZ_BLOCK - 1) / HIZ_BLOCK;
+  if (bw * bh > hiz->cap) {
+    HiZBlock *blocks =
+        realloc(hiz->blocks, (size_t)(bw * bh) * sizeof(HiZBlock));
+    if (!blocks) {
+      hiz->bw = hiz->bh = 0;
+      return false;
+    }
+    hiz->blocks = blocks;
+    hiz->cap = bw * bh;
+  }
+  hiz->bw = bw;
+  hiz->bh = bh;
+  return true;
+}
+
+void hiz_clear(HiZ *hiz, float depth) {
+  int count = hiz->bw * hiz->bh;
+  for (int i = 0; i < count; i++) {
+    hiz->blocks[i] = (HiZBlock){depth, depth};
+  }
+}
+
+void hiz_destroy(HiZ *hiz) {
+  free(hiz->blocks);
+  *hiz = (HiZ){0};
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "types.h"
+#include <stdbool.h>
+
+#define HIZ_BLOCK 8
+
+typedef struct {
+  float zmin;
+  float zmax;
+} HiZBlock;
+
+// Coarse min/max depth per HIZ_BLOCK x HIZ_BLOCK block of a depth buffer.
+// The bounds are conservative: zmin never exceeds and zmax is never below any
+// depth in the block. The rasterizer uses them to skip blocks a triangle
+// can't win a depth test in and to drop the depth test where it can't lose
+// one, and tightens them as it draws.
+typedef struct {
+  HiZBlock *blocks;
+  int bw; // blocks per row
+  int bh; // blocks per column
+  int cap;
+} HiZ;
+
+// Leaves the HiZ empty (bw == 0) if it runs out of memory.
+bool hiz_resize(HiZ *hiz, int w, int h);
+// Resets every block to match a depth buffer cleared to `depth`.
+void hiz_clear(HiZ *hiz, float depth);
+void hiz_destroy(HiZ *hiz);
@@ -0,0 +1,265 @@
+#include "jobs.h"
+#include <stdlib.h>
+
+#define JOB_POOL_MAX_THREADS 63
+
+static void run_indices(JobPool *pool) {
+  for (;;) {
+    int i = SDL_AtomicAdd(&pool->next, 1);
+    if (i >= pool->count) {
+      break;
+    }
+    pool->fn(pool->user, i);
+  }
+}
+
+static int worker_main(void *data) {
+  JobPool *pool = data;
+  int seen = 0;
+  for (;;) {
+    SDL_LockMutex(pool->lock);
+    while (!pool->quit && pool->generation == seen) {
+      SDL_CondWait(pool->wake, pool->lock);
+    }
+    if (pool->quit) {
+      SDL_UnlockMutex(pool->lock);
+      return 0;
+    }
+    seen = pool->generation;
+    SDL_UnlockMutex(pool->lock);
+
+    run_indices(pool);
+
+    SDL_LockMutex(pool->lock);
+    if (--pool->active == 0) {
+      SDL_CondSignal(pool->done);
+    }
+    SDL_UnlockMutex(pool->lock);
+  }
+}
+
+bool job_pool_init(JobPool *pool, int thread_count) {
+  *pool = (JobPool){0};
+  if (thread_count <= 0) {
+    thread_count = SDL_GetCPUCount() - 1;
+  }
+  if (thread_count < 0)
+    thread_count = 0;
+  if (thread_count > JOB_POOL_MAX_THREADS)
+    thread_count = JOB_POOL_MAX_THREADS;
+
+  pool->lock = SDL_CreateMutex();
+  pool->wake = SDL_CreateCond();
+  pool->done = SDL_CreateCond();
+  if (!pool->lock || !pool->wake || !pool->done) {
+    SDL_Log("Failed to create job pool primitives: %s", SDL_GetError());
+    job_pool_destroy(pool);
+    return false;
+  }
+  if (thread_count == 0) {
+    return true;
+  }
+
+  pool->threads = calloc((size_t)thread_count, sizeof(SDL_Thread *));
+  if (!pool->threads) {
+    job_pool_destroy(pool);
+    return false;
+  }
+  for (int i = 0; i < thread_count; i++) {
+    pool->threads[i] = SDL_CreateThread(worker_main, "soft3d-worker", pool);
+    if (!pool->threads[i]) {
+      SDL_Log("Failed to create worker thread: %s", SDL_GetError());
+      break;
+    }
+    pool->thread_count++;
+  }
+  return true;
+}
+
+void job_pool_destroy(JobPool *pool) {
+  if (pool->lock) {
+    SDL_LockMutex(pool->lock);
+    pool->quit = true;
+    SDL_CondBroadcast(pool->wake);
+    SDL_UnlockMutex(pool->lock);
+  }
+  for (int i = 0; i < pool->thread_count; i++) {
+    SDL_WaitThread(pool->threads[i], NULL);
+  }
+  free(pool->threads);
+  if (pool->done)
+    SDL_DestroyCond(pool->done);
+  if (pool->wake)
+    SDL_DestroyCond(pool->wake);
+  if (pool->lock)
+    SDL_DestroyMutex(pool->lock);
+  *pool = (JobPool){0};
+}
+
+void job_pool_parallel_for(JobPool *pool, int count, JobFn fn, void *user) {
+  if (count <= 0) {
+    return;
+  }
+  if (!pool || pool->thread_count == 0 || count == 1) {
+    for (int i = 0; i < count; i++) {
+      fn(user, i);
+    }
+    return;
+  }
+
+  SDL_LockMutex(pool->lock);
+  pool->fn = fn;
+  pool->user = user;
+  pool->count = count;
+  SDL_AtomicSet(&pool->next, 0);
+  pool->active = pool->thread_count;
+  pool->generation++;
+  SDL_CondBroadcast(pool->wake);
+  SDL_UnlockMutex(pool->lock);
+
+  run_indices(pool);
+
+  SDL_LockMutex(pool->lock);
+  while (pool->active > 0) {
+    SDL_CondWait(pool->done, pool->lock);
+  }
+  SDL_UnlockMutex(pool->lock);
+}
+
+// Bounded MPMC ring after Dmitry Vyukov's design: each slot's sequence says
+// whether it is free for the push of ticket `pos` (sequence == pos) or holds
+// that push's task (sequence == pos + 1). Tickets are compared as unsigned
+// differences so the counters may wrap.
+static bool task_pop(TaskQueue *queue, TaskFn *fn, void **user) {
+  unsigned pos = (unsigned)SDL_AtomicGet(&queue->tail);
+  for (;;) {
+    TaskSlot *slot = &queue->slots[pos & queue->mask];
+    unsigned seq = (unsigned)SDL_AtomicGet(&slot->sequence);
+    int diff = (int)(seq - (pos + 1));
+    if (diff == 0) {
+      if (SDL_AtomicCAS(&queue->tail, (int)pos, (int)(pos + 1))) {
+        *fn = slot->fn;
+        *user = slot->user;
+        SDL_AtomicSet(&slot->sequence, (int)(pos + queue->mask + 1));
+        return true;
+      }
+      pos = (unsigned)SDL_AtomicGet(&queue->tail);
+    } else if (diff < 0) {
+      // Empty, unless a producer has claimed this ticket and not published
+      // it yet. A later producer's count may be what woke us, so wait for
+      // the slot rather than drop the wake-up and strand a task.
+      if ((unsigned)SDL_AtomicGet(&queue->head) == pos) {
+        return false;
+      }
+      SDL_Delay(0);
+      pos = (unsigned)SDL_AtomicGet(&queue->tail);
+    } else {
+      pos = (unsigned)SDL_AtomicGet(&queue->tail);
+    }
+  }
+}
+
+static int task_worker_main(void *data) {
+  TaskQueue *queue = data;
+  for (;;) {
+    SDL_SemWait(queue->ready);
+    TaskFn fn;
+    void *user;
+    if (task_pop(queue, &fn, &user)) {
+      fn(user);
+    } else if (SDL_AtomicGet(&queue->quit)) {
+      return 0;
+    }
+  }
+}
+
+bool task_queue_init(TaskQueue *queue, int capacity, int thread_count) {
+  *queue = (TaskQueue){0};
+  if (thread_count <= 0) {
+    thread_count = SDL_GetCPUCount() - 1;
+  }
+  if (thread_count < 0)
+    thread_count = 0;
+  if (thread_count > JOB_POOL_MAX_THREADS)
+    thread_count = JOB_POOL_MAX_THREADS;
+  unsigned size = 2;
+  while (size < (unsigned)capacity) {
+    size *= 2;
+  }
+
+  queue->slots = calloc(size, sizeof(TaskSlot));
+  queue->ready = SDL_CreateSemaphore(0);
+  if (!queue->slots || !queue->ready) {
+    SDL_Log("Failed to create task queue");
+    task_queue_destroy(queue);
+    return false;
+  }
+  queue->mask = size - 1;
+  for (unsigned i = 0; i < size; i++) {
+    SDL_AtomicSet(&queue->slots[i].sequence, (int)i);
+  }
+  if (thread_count == 0) {
+    return true;
+  }
+
+  queue->threads = calloc((size_t)thread_count, sizeof(SDL_Thread *));
+  if (!queue->threads) {
+    task_queue_destroy(queue);
+    return false;
+  }
+  for (int i = 0; i < thread_count; i++) {
+    queue->threads[i] =
+        SDL_CreateThread(task_worker_main, "soft3d-task", queue);
+    if (!queue->threads[i]) {
+      SDL_Log("Failed to create task thread: %s", SDL_GetError());
+      break;
+    }
+    queue->thread_count++;
+  }
+  return true;
+}
+
+void task_queue_destroy(TaskQueue *queue) {
+  // Each worker exits on the first wake-up that finds the ring empty, with
+  // no push still being published, so the extra counts only stop them once
+  // every queued task has been taken. Pushes must have returned by now.
+  SDL_AtomicSet(&queue->quit, 1);
+  for (int i = 0; i < queue->thread_count; i++) {
+    SDL_SemPost(queue->ready);
+  }
+  for (int i = 0; i < queue->thread_count; i++) {
+    SDL_WaitThread(queue->threads[i], NULL);
+  }
+  free(queue->threads);
+  free(queue->slots);
+  if (queue->ready)
+    SDL_DestroySemaphore(queue->ready);
+  *queue = (TaskQueue){0};
+}
+
+bool task_queue_push(TaskQueue *queue, TaskFn fn, void *user) {
+  if (queue->thread_count == 0) {
+    fn(user);
+    return true;
+  }
+  unsigned pos = (unsigned)SDL_AtomicGet(&queue->head);
+  for (;;) {
+    TaskSlot *slot = &queue->slots[pos & queue->mask];
+    unsigned seq = (unsigned)SDL_AtomicGet(&slot->sequence);
+    int diff = (int)(seq - pos);
+    if (diff == 0) {
+      if (SDL_AtomicCAS(&queue->head, (int)pos, (int)(pos + 1))) {
+        slot->fn = fn;
+        slot->user = user;
+        SDL_AtomicSet(&slot->sequence, (int)(pos + 1));
+        SDL_SemPost(queue->ready);
+        return true;
+      }
+      pos = (unsigned)SDL_AtomicGet(&queue->head);
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = (unsigned)SDL_AtomicGet(&queue->head);
+    }
+  }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+typedef void (*JobFn)(void *user, int index);
+
+// Persistent worker threads that split index ranges between them. The calling
+// thread always takes part, so a pool with no workers runs jobs inline.
+typedef struct {
+  SDL_Thread **threads;
+  int thread_count;
+  SDL_mutex *lock;
+  SDL_cond *wake;
+  SDL_cond *done;
+  JobFn fn;
+  void *user;
+  int count;
+  SDL_atomic_t next;
+  int generation;
+  int active;
+  bool quit;
+} JobPool;
+
+// thread_count <= 0 picks one worker per extra CPU core.
+bool job_pool_init(JobPool *pool, int thread_count);
+void job_pool_destroy(JobPool *pool);
+// Calls fn(user, i) for every i in [0, count) across the pool and returns
+// once all of them have finished.
+void job_pool_parallel_for(JobPool *pool, int count, JobFn fn, void *user);
+
+typedef void (*TaskFn)(void *user);
+
+typedef struct {
+  SDL_atomic_t sequence;
+  TaskFn fn;
+  void *user;
+} TaskSlot;
+
+// Fire-and-forget tasks run by background threads, for work that must not
+// hold up a frame. Tasks go through a bounded lock-free multi-producer,
+// multi-consumer ring; idle workers sleep on a semaphore.
+typedef struct {
+  TaskSlot *slots;
+  unsigned mask;     // capacity - 1
+  SDL_atomic_t head; // next slot to push
+  SDL_atomic_t tail; // next slot to pop
+  SDL_sem *ready;    // one count per pushed task, plus one per worker on quit
+  SDL_Thread **threads;
+  int thread_count;
+  SDL_atomic_t quit;
+} TaskQueue;
+
+// capacity is rounded up to a power of two. thread_count <= 0 picks one
+// worker per extra CPU core; with no workers tasks run inside push.
+bool task_queue_init(TaskQueue *queue, int capacity, int thread_count);
+// Runs every task still queued, then stops the workers.
+void task_queue_destroy(TaskQueue *queue);
+// False when the ring is full; the task is then not queued.
+bool task_queue_push(TaskQueue *queue, TaskFn fn, void *user);
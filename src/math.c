@@ -113,3 +113,30 @@ mat4 mat4_rotate_y(float angle) {
   m.m[2][2] = c;
   return m;
 }
+
+Frustum frustum_from_matrix(mat4 m) {
+  // Each plane is row 3 plus or minus row 0..2, matching the clip tests
+  // -w <= x, y, z <= w.
+  Frustum f;
+  for (int i = 0; i < 3; i++) {
+    f.planes[i * 2] = (v4f){m.m[3][0] + m.m[i][0], m.m[3][1] + m.m[i][1],
+                            m.m[3][2] + m.m[i][2], m.m[3][3] + m.m[i][3]};
+    f.planes[i * 2 + 1] = (v4f){m.m[3][0] - m.m[i][0], m.m[3][1] - m.m[i][1],
+                                m.m[3][2] - m.m[i][2], m.m[3][3] - m.m[i][3]};
+  }
+  return f;
+}
+
+bool frustum_test_aabb(const Frustum *f, v3f min, v3f max) {
+  for (int i = 0; i < 6; i++) {
+    v4f p = f->planes[i];
+    // The box corner furthest along the plane normal.
+    float x = (p.x >= 0.0f) ? max.x : min.x;
+    float y = (p.y >= 0.0f) ? max.y : min.y;
+    float z = (p.z >= 0.0f) ? max.z : min.z;
+    if (p.x * x + p.y * y + p.z * z + p.w < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
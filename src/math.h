@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.h"
+#include <stdbool.h>
 
 float v3_dot(v3f a, v3f b);
 v3f v3_cross(v3f a, v3f b);
@@ -17,3 +18,14 @@ mat4 mat4_perspective(float fov_radians, float aspect, float znear, float zfar);
 mat4 mat4_look_at(v3f eye, v3f target, v3f up);
 mat4 mat4_rotate_x(float angle);
 mat4 mat4_rotate_y(float angle);
+
+// Planes (a, b, c, d) of the clip volume, a*x + b*y + c*z + d >= 0 inside.
+// Taken from proj * view they are in world space; from a full mvp, in the
+// model's own space.
+typedef struct {
+  v4f planes[6];
+} Frustum;
+
+Frustum frustum_from_matrix(mat4 m);
+// Conservative: false only when the box is entirely outside one plane.
+bool frustum_test_aabb(const Frustum *f, v3f min, v3f max);
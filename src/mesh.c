@@ -0,0 +1,224 @@
+#include "mesh.h"
+#include "render.h"
+#include <stdlib.h>
+
+static bool grow(void **data, int *cap, int needed, size_t elem) {
+  if (needed <= *cap) {
+    return true;
+  }
+  int new_cap = (*cap == 0) ? 256 : *cap * 2;
+  while (new_cap < needed) {
+    new_cap *= 2;
+  }
+  void *tmp = realloc(*data, (size_t)new_cap * elem);
+  if (!tmp) {
+    return false;
+  }
+  *data = tmp;
+  *cap = new_cap;
+  return true;
+}
+
+void mesh_clear(Mesh *mesh) {
+  mesh->position_count = 0;
+  mesh->vertex_count = 0;
+  mesh->index_count = 0;
+  mesh->group_count = 0;
+  mesh->bounds_min = (v3f){0};
+  mesh->bounds_max = (v3f){0};
+  mesh->has_bounds = false;
+}
+
+void mesh_free(Mesh *mesh) {
+  free(mesh->positions);
+  free(mesh->vertices);
+  free(mesh->indices);
+  free(mesh->groups);
+  *mesh = (Mesh){0};
+}
+
+bool mesh_add_position(Mesh *mesh, v3f pos) {
+  if (!grow((void **)&mesh->positions, &mesh->position_cap,
+            mesh->position_count + 1, sizeof(v3f))) {
+    return false;
+  }
+  mesh->positions[mesh->position_count++] = pos;
+  if (!mesh->has_bounds) {
+    mesh->bounds_min = mesh->bounds_max = pos;
+    mesh->has_bounds = true;
+    return true;
+  }
+  if (pos.x < mesh->bounds_min.x)
+    mesh->bounds_min.x = pos.x;
+  if (pos.y < mesh->bounds_min.y)
+    mesh->bounds_min.y = pos.y;
+  if (pos.z < mesh->bounds_min.z)
+    mesh->bounds_min.z = pos.z;
+  if (pos.x > mesh->bounds_max.x)
+    mesh->bounds_max.x = pos.x;
+  if (pos.y > mesh->bounds_max.y)
+    mesh->bounds_max.y = pos.y;
+  if (pos.z > mesh->bounds_max.z)
+    mesh->bounds_max.z = pos.z;
+  return true;
+}
+
+bool mesh_add_vertex(Mesh *mesh, u32 pos, v2f uv) {
+  if (!grow((void **)&mesh->vertices, &mesh->vertex_cap,
+            mesh->vertex_count + 1, sizeof(MeshVertex))) {
+    return false;
+  }
+  mesh->vertices[mesh->vertex_count++] = (MeshVertex){pos, uv};
+  return true;
+}
+
+bool mesh_add_triangle(Mesh *mesh, u32 v0, u32 v1, u32 v2, int material) {
+  if (!grow((void **)&mesh->indices, &mesh->index_cap, mesh->index_count + 3,
+            sizeof(u32))) {
+    return false;
+  }
+  MeshGroup *group =
+      mesh->group_count > 0 ? &mesh->groups[mesh->group_count - 1] : NULL;
+  if (!group || group->material != material) {
+    if (!grow((void **)&mesh->groups, &mesh->group_cap, mesh->group_count + 1,
+              sizeof(MeshGroup))) {
+      return false;
+    }
+    group = &mesh->groups[mesh->group_count++];
+    *group = (MeshGroup){mesh->index_count, 0, material};
+  }
+  mesh->indices[mesh->index_count++] = v0;
+  mesh->indices[mesh->index_count++] = v1;
+  mesh->indices[mesh->index_count++] = v2;
+  group->count += 3;
+  return true;
+}
+
+static const Vertex3D cube_vertices[] = {
+    // Front (-Z)
+    {{-0.5f, -0.5f, -0.5f}, {0.0f, 1.0f}},
+    {{0.5f, -0.5f, -0.5f}, {1.0f, 1.0f}},
+    {{0.5f, 0.5f, -0.5f}, {1.0f, 0.0f}},
+    {{-0.5f, 0.5f, -0.5f}, {0.0f, 0.0f}},
+    // Back (+Z)
+    {{0.5f, -0.5f, 0.5f}, {0.0f, 1.0f}},
+    {{-0.5f, -0.5f, 0.5f}, {1.0f, 1.0f}},
+    {{-0.5f, 0.5f, 0.5f}, {1.0f, 0.0f}},
+    {{0.5f, 0.5f, 0.5f}, {0.0f, 0.0f}},
+    // Left (-X)
+    {{-0.5f, -0.5f, 0.5f}, {0.0f, 1.0f}},
+    {{-0.5f, -0.5f, -0.5f}, {1.0f, 1.0f}},
+    {{-0.5f, 0.5f, -0.5f}, {1.0f, 0.0f}},
+    {{-0.5f, 0.5f, 0.5f}, {0.0f, 0.0f}},
+    // Right (+X)
+    {{0.5f, -0.5f, -0.5f}, {0.0f, 1.0f}},
+    {{0.5f, -0.5f, 0.5f}, {1.0f, 1.0f}},
+    {{0.5f, 0.5f, 0.5f}, {1.0f, 0.0f}},
+    {{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f}},
+    // Top (+Y)
+    {{-0.5f, 0.5f, -0.5f}, {0.0f, 1.0f}},
+    {{0.5f, 0.5f, -0.5f}, {1.0f, 1.0f}},
+    {{0.5f, 0.5f, 0.5f}, {1.0f, 0.0f}},
+    {{-0.5f, 0.5f, 0.5f}, {0.0f, 0.0f}},
+    // Bottom (-Y)
+    {{-0.5f, -0.5f, 0.5f}, {0.0f, 1.0f}},
+    {{0.5f, -0.5f, 0.5f}, {1.0f, 1.0f}},
+    {{0.5f, -0.5f, -0.5f}, {1.0f, 0.0f}},
+    {{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f}},
+};
+
+static const int cube_indices[][3] = {
+    {0, 1, 2}, {0, 2, 3}, // front
+    {4, 5, 6},
+    {4, 6, 7}, // back
+    {8, 9, 10},
+    {8, 10, 11}, // left
+    {12, 13, 14},
+    {12, 14, 15}, // right
+    {16, 17, 18},
+    {16, 18, 19}, // top
+    {20, 21, 22},
+    {20, 22, 23} // bottom
+};
+
+bool mesh_build_cube(Mesh *mesh) {
+  // The table winds clockwise and the pipeline culls clockwise, so each
+  // triangle is flipped. Face corners are welded onto the 8 positions.
+  int vertex_count = (int)(sizeof(cube_vertices) / sizeof(cube_vertices[0]));
+  int triangle_count = (int)(sizeof(cube_indices) / sizeof(cube_indices[0]));
+  u32 base = (u32)mesh->vertex_count;
+  int first_pos = mesh->position_count;
+  for (int i = 0; i < vertex_count; i++) {
+    v3f p = cube_vertices[i].pos;
+    int pos = first_pos;
+    while (pos < mesh->position_count &&
+           (mesh->positions[pos].x != p.x || mesh->positions[pos].y != p.y ||
+            mesh->positions[pos].z != p.z)) {
+      pos++;
+    }
+    if ((pos == mesh->position_count && !mesh_add_position(mesh, p)) ||
+        !mesh_add_vertex(mesh, (u32)pos, cube_vertices[i].uv)) {
+      return false;
+    }
+  }
+  for (int i = 0; i < triangle_count; i++) {
+    if (!mesh_add_triangle(mesh, base + (u32)cube_indices[i][0],
+                           base + (u32)cube_indices[i][2],
+                           base + (u32)cube_indices[i][1], 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool mesh_transform(const Mesh *mesh, mat4 mvp, int w, int h,
+                    TransformCache *cache) {
+  if (!grow((void **)&cache->verts, &cache->cap, mesh->position_count,
+            sizeof(TransformedVertex))) {
+    return false;
+  }
+  // Same arithmetic as mat4_mul_v4 with w = 1, kept inline so the matrix
+  // stays in registers across the whole batch.
+  const float(*m)[4] = mvp.m;
+  for (int i = 0; i < mesh->position_count; i++) {
+    v3f p = mesh->positions[i];
+    TransformedVertex *out = &cache->verts[i];
+    v4f clip = {
+        m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+        m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+        m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3],
+        m[3][0] * p.x + m[3][1] * p.y + m[3][2] * p.z + m[3][3],
+    };
+    out->clip = clip;
+
+    int mask = 0;
+    if (clip.x < -clip.w)
+      mask |= CLIP_LEFT;
+    if (clip.x > clip.w)
+      mask |= CLIP_RIGHT;
+    if (clip.y < -clip.w)
+      mask |= CLIP_BOTTOM;
+    if (clip.y > clip.w)
+      mask |= CLIP_TOP;
+    if (clip.z < -clip.w)
+      mask |= CLIP_NEAR;
+    if (clip.z > clip.w)
+      mask |= CLIP_FAR;
+    out->clip_mask = mask;
+    if (clip.w == 0.0f) {
+      continue;
+    }
+
+    float inv_w = 1.0f / clip.w;
+    v3f ndc = {clip.x * inv_w, clip.y * inv_w, clip.z * inv_w};
+    out->screen = norm_to_subpixel((v2f){ndc.x, ndc.y}, w, h);
+    out->inv_w = inv_w;
+    out->depth = 0.5f * (ndc.z + 1.0f);
+  }
+  return true;
+}
+
+void transform_cache_free(TransformCache *cache) {
+  free(cache->verts);
+  *cache = (TransformCache){0};
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "types.h"
+#include <stdbool.h>
+
+// Clip-space outcodes of a transformed position.
+#define CLIP_LEFT 1
+#define CLIP_RIGHT 2
+#define CLIP_BOTTOM 4
+#define CLIP_TOP 8
+#define CLIP_NEAR 16
+#define CLIP_FAR 32
+
+typedef struct {
+  u32 pos; // index into Mesh.positions
+  v2f uv;
+} MeshVertex;
+
+// A run of triangles drawn with the same material.
+typedef struct {
+  int first; // first entry in Mesh.indices
+  int count; // index count, a multiple of 3
+  int material;
+} MeshGroup;
+
+// Indexed triangle mesh. Positions are stored once and shared by every vertex
+// sitting on them, so the transform stage visits each corner once however
+// many faces meet there.
+typedef struct {
+  v3f *positions;
+  int position_count;
+  int position_cap;
+  MeshVertex *vertices;
+  int vertex_count;
+  int vertex_cap;
+  u32 *indices;
+  int index_count;
+  int index_cap;
+  MeshGroup *groups;
+  int group_count;
+  int group_cap;
+  v3f bounds_min;
+  v3f bounds_max;
+  bool has_bounds;
+} Mesh;
+
+// Empties the mesh but keeps its storage for the next rebuild.
+void mesh_clear(Mesh *mesh);
+void mesh_free(Mesh *mesh);
+// The new element's index is the matching count minus one.
+bool mesh_add_position(Mesh *mesh, v3f pos);
+bool mesh_add_vertex(Mesh *mesh, u32 pos, v2f uv);
+// Appends to the last group when it uses the same material.
+bool mesh_add_triangle(Mesh *mesh, u32 v0, u32 v1, u32 v2, int material);
+// Appends a unit cube centred on the origin, material 0, with the whole
+// texture on every face.
+bool mesh_build_cube(Mesh *mesh);
+
+// Post-transform data of one mesh position. screen, inv_w and depth are only
+// meaningful without CLIP_NEAR.
+typedef struct {
+  v4f clip;
+  v2i screen; // fixed point, like VertexPC.pos
+  float inv_w;
+  float depth;
+  int clip_mask; // CLIP_* bits
+} TransformedVertex;
+
+typedef struct {
+  TransformedVertex *verts;
+  int cap;
+} TransformCache;
+
+// Transforms every position of the mesh once and projects it to a w x h
+// target. cache->verts[i] then belongs to mesh->positions[i].
+bool mesh_transform(const Mesh *mesh, mat4 mvp, int w, int h,
+                    TransformCache *cache);
+void transform_cache_free(TransformCache *cache);
@@ -1,7 +1,11 @@
 #include "obj_loader.h"
+#include "file_map.h"
+#include "jobs.h"
 #include "render.h"
-#include <ctype.h>
+#include <limits.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,13 +19,7 @@ static void model_reset(ObjModel *model) {
   if (!model) {
     return;
   }
-  model->faces = NULL;
-  model->face_count = 0;
-  model->materials = NULL;
-  model->material_count = 0;
-  model->bounds_min = (v3f){0};
-  model->bounds_max = (v3f){0};
-  model->has_bounds = false;
+  *model = (ObjModel){0};
 }
 
 static bool ensure_capacity(void **data, int *cap, int needed, size_t elem) {
@@ -68,261 +66,873 @@ static void join_path(char *out, size_t out_size, const char *base,
   snprintf(out, out_size, "%s/%s", base, rel);
 }
 
-static ObjMaterial *find_material(ObjModel *model, const char *name) {
+static int find_material(ObjModel *model, const char *name) {
   for (int i = 0; i < model->material_count; i++) {
     if (strcmp(model->materials[i].name, name) == 0) {
-      return &model->materials[i];
+      return i;
+    }
+  }
+  return -1;
+}
+
+// The parser works on the whole file in memory (file_map) and never calls
+// into the C library per line: no fgets, sscanf or strtod, so it is also
+// independent of the locale's decimal separator.
+static bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && is_blank(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static const char *token_end(const char *p, const char *end) {
+  while (p < end && !is_blank(*p) && *p != '\n') {
+    p++;
+  }
+  return p;
+}
+
+static const char *next_line(const char *p, const char *end) {
+  // Eight bytes at a time while none of them is a newline: a zero byte in
+  // x sets its high bit in (x - ones) & ~x.
+  const uint64_t ones = 0x0101010101010101ull;
+  while (end - p >= 8) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    x ^= ones * '\n';
+    if ((x - ones) & ~x & (ones << 7)) {
+      break;
+    }
+    p += 8;
+  }
+  while (p < end && *p != '\n') {
+    p++;
+  }
+  return p < end ? p + 1 : end;
+}
+
+// Whether the line at p starts with word followed by a blank.
+static bool keyword(const char *p, const char *end, const char *word) {
+  for (; *word; word++, p++) {
+    if (p == end || *p != *word) {
+      return false;
+    }
+  }
+  return p < end && is_blank(*p);
+}
+
+// Copies the token at p, truncated to out_size - 1 characters like "%63s".
+// False when the line has no token left.
+static bool copy_token(const char *p, const char *end, char *out,
+                       size_t out_size) {
+  p = skip_blanks(p, end);
+  const char *stop = token_end(p, end);
+  if (stop == p) {
+    return false;
+  }
+  size_t len = (size_t)(stop - p);
+  if (len >= out_size) {
+    len = out_size - 1;
+  }
+  memcpy(out, p, len);
+  out[len] = '\0';
+  return true;
+}
+
+static const double powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Decimal float ([sign] digits [. digits] [e [sign] digits]) after any
+// blanks. Up to 19 significant digits are kept exactly and scaled once by an
+// exact power of ten in double precision, so the float is correctly rounded
+// but for the rare case the double rounding touches.
+static bool parse_float(const char **cursor, const char *end, float *out) {
+  const char *p = skip_blanks(*cursor, end);
+  bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    p++;
+  }
+  unsigned long long mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any = false;
+  for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (unsigned)(*p - '0');
+      digits += mantissa != 0;
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (unsigned)(*p - '0');
+        digits += mantissa != 0;
+        exponent--;
+      }
+    }
+  }
+  if (!any) {
+    return false;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool exp_negative = q < end && *q == '-';
+    if (q < end && (*q == '-' || *q == '+')) {
+      q++;
+    }
+    if (q < end && *q >= '0' && *q <= '9') {
+      int e = 0;
+      for (; q < end && *q >= '0' && *q <= '9'; q++) {
+        if (e < 10000) {
+          e = e * 10 + (*q - '0');
+        }
+      }
+      exponent += exp_negative ? -e : e;
+      p = q;
+    }
+  }
+  double value = (double)mantissa;
+  if (value != 0.0) {
+    for (; exponent > 22; exponent -= 22) {
+      value *= 1e22;
+    }
+    for (; exponent < -22; exponent += 22) {
+      value /= 1e22;
+    }
+    value = exponent >= 0 ? value * powers_of_ten[exponent]
+                          : value / powers_of_ten[-exponent];
+  }
+  *out = (float)(negative ? -value : value);
+  *cursor = p;
+  return true;
+}
+
+static bool parse_int(const char **cursor, const char *end, int *out) {
+  const char *p = *cursor;
+  bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    p++;
+  }
+  if (p == end || *p < '0' || *p > '9') {
+    return false;
+  }
+  long long value = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    if (value < INT_MAX) {
+      value = value * 10 + (*p - '0');
+    }
+  }
+  if (value > INT_MAX) {
+    value = INT_MAX;
+  }
+  *out = (int)(negative ? -value : value);
+  *cursor = p;
+  return true;
+}
+
+// One face corner, "v", "v/t", "v//n" or "v/t/n", at p. Missing indices are
+// 0; false when there is no position index.
+static bool parse_corner(const char *p, const char *end, int *vi, int *ti,
+                         int *ni) {
+  *vi = *ti = *ni = 0;
+  if (!parse_int(&p, end, vi)) {
+    return false;
+  }
+  if (p < end && *p == '/') {
+    p++;
+    if (p < end && *p != '/') {
+      parse_int(&p, end, ti);
+    }
+    if (p < end && *p == '/') {
+      p++;
+      parse_int(&p, end, ni);
     }
   }
-  return NULL;
+  return true;
 }
 
-static bool parse_mtl(const char *mtl_path, ObjModel *model, int *mat_cap) {
-  FILE *f = fopen(mtl_path, "r");
-  if (!f) {
+// A map_Kd texture to decode for a material. Decoding runs on a task queue
+// while the faces are parsed (start_decoding); the texture is handed to the
+// material once all of them are done (finish_decoding).
+typedef struct {
+  char path[512];
+  int material;
+  Texture texture;
+  bool loaded;
+} TextureJob;
+
+typedef struct {
+  TextureJob *jobs;
+  int count;
+  int cap;
+} TextureJobs;
+
+static bool parse_mtl(const char *mtl_path, ObjModel *model, int *mat_cap,
+                      TextureJobs *textures) {
+  size_t size = 0;
+  const char *data = file_map(mtl_path, &size);
+  if (!data) {
     return false;
   }
+  const char *end = data + size;
 
   char base_dir[256];
   dirname_of(mtl_path, base_dir, sizeof(base_dir));
 
   ObjMaterial *current = NULL;
-  char line[512];
-  while (fgets(line, sizeof(line), f)) {
-    if (line[0] == '#') {
-      continue;
-    }
-    if (strncmp(line, "newmtl", 6) == 0) {
+  bool ok = true;
+  for (const char *p = data; ok && p < end; p = next_line(p, end)) {
+    p = skip_blanks(p, end);
+    if (keyword(p, end, "newmtl")) {
       char name[64];
-      if (sscanf(line + 6, "%63s", name) == 1) {
+      if (copy_token(p + 6, end, name, sizeof(name))) {
         if (!ensure_capacity((void **)&model->materials, mat_cap,
                              model->material_count + 1,
                              sizeof(ObjMaterial))) {
-          fclose(f);
-          return false;
+          ok = false;
+          break;
         }
         current = &model->materials[model->material_count++];
         memset(current, 0, sizeof(*current));
         strncpy(current->name, name, sizeof(current->name) - 1);
       }
-      continue;
-    }
-    if (strncmp(line, "map_Kd", 6) == 0 && current) {
+    } else if (keyword(p, end, "map_Kd") && current) {
       char tex_rel[256];
-      if (sscanf(line + 6, "%255s", tex_rel) == 1) {
-        char tex_path[512];
-        join_path(tex_path, sizeof(tex_path), base_dir, tex_rel);
-        if (texture_load(&current->diffuse, tex_path)) {
-          current->has_diffuse = true;
+      if (copy_token(p + 6, end, tex_rel, sizeof(tex_rel))) {
+        if (!ensure_capacity((void **)&textures->jobs, &textures->cap,
+                             textures->count + 1, sizeof(TextureJob))) {
+          ok = false;
+          break;
         }
+        TextureJob *job = &textures->jobs[textures->count++];
+        *job = (TextureJob){.material = (int)(current - model->materials)};
+        join_path(job->path, sizeof(job->path), base_dir, tex_rel);
       }
     }
   }
 
-  fclose(f);
-  return true;
+  file_unmap((void *)data, size);
+  return ok;
 }
 
-static bool parse_index_triplet(const char *token, int *vi, int *ti, int *ni) {
-  *vi = *ti = *ni = 0;
-  const char *p = token;
-  if (!*p) {
+#define FACE_MAX_CORNERS 16 // corners past this are ignored
+// Files are split into chunks of at least this many bytes, up to a few per
+// thread so uneven chunks still balance.
+#define CHUNK_MIN_BYTES (1 << 20)
+#define CHUNKS_PER_THREAD 4
+
+// Open-addressing hash set of a mesh's vertices, so face corners with the
+// same position and UV share one vertex. Slots hold a vertex index plus one;
+// zero is empty.
+typedef struct {
+  u32 *slots;
+  u32 mask; // slot count - 1
+} VertexTable;
+
+// Faces mostly use positions near each other, so the position index sets
+// the slot and keeps lookups local; the UV picks one of four neighbouring
+// slots for the few UVs a position has.
+static u32 hash_vertex(MeshVertex v) {
+  u32 u, w;
+  memcpy(&u, &v.uv.x, sizeof(u));
+  memcpy(&w, &v.uv.y, sizeof(w));
+  u32 mix = (u ^ (w * 0x9E3779B1u)) * 0x85EBCA77u;
+  return (v.pos << 2) + (mix >> 30);
+}
+
+// Bitwise, so -0 and 0 or two NaNs are told apart like any other UVs.
+static bool same_vertex(MeshVertex a, MeshVertex b) {
+  return a.pos == b.pos && memcmp(&a.uv, &b.uv, sizeof(v2f)) == 0;
+}
+
+// Rebuilds the table with cap slots, a power of two.
+static bool resize_table(VertexTable *table, const Mesh *mesh, u32 cap) {
+  u32 *slots = calloc(cap, sizeof(u32));
+  if (!slots) {
     return false;
   }
-  char *end = NULL;
-  *vi = (int)strtol(p, &end, 10);
-  if (end == p) {
+  for (int i = 0; i < mesh->vertex_count; i++) {
+    u32 h = hash_vertex(mesh->vertices[i]) & (cap - 1);
+    while (slots[h]) {
+      h = (h + 1) & (cap - 1);
+    }
+    slots[h] = (u32)i + 1;
+  }
+  free(table->slots);
+  table->slots = slots;
+  table->mask = cap - 1;
+  return true;
+}
+
+// The index of the mesh vertex equal to v, which is added when new. The
+// table must hold every vertex of the mesh.
+static bool find_vertex(VertexTable *table, Mesh *mesh, MeshVertex v,
+                        u32 *index) {
+  // Doubled at half load.
+  if ((!table->slots || (u32)mesh->vertex_count >= (table->mask + 1) / 2) &&
+      !resize_table(table, mesh,
+                    table->slots ? (table->mask + 1) * 2 : 1024)) {
     return false;
   }
-  p = end;
-  if (*p == '/') {
-    p++;
-    if (*p != '/' && *p != '\0') {
-      *ti = (int)strtol(p, &end, 10);
-      p = end;
-    }
-    if (*p == '/') {
-      p++;
-      if (*p != '\0') {
-        *ni = (int)strtol(p, &end, 10);
-      }
+  u32 h = hash_vertex(v) & table->mask;
+  for (; table->slots[h]; h = (h + 1) & table->mask) {
+    u32 found = table->slots[h] - 1;
+    if (same_vertex(mesh->vertices[found], v)) {
+      *index = found;
+      return true;
     }
   }
+  if (!mesh_add_vertex(mesh, v.pos, v.uv)) {
+    return false;
+  }
+  table->slots[h] = (u32)mesh->vertex_count;
+  *index = (u32)mesh->vertex_count - 1;
   return true;
 }
 
-bool obj_model_load(const char *obj_path, ObjModel *out) {
-  if (!obj_path || !out) {
+// A run of whole lines, parsed in two passes. The scan pass reads its `v`
+// and `vt` lines; once every chunk's counts are known the face pass resolves
+// its `f` lines, relative indices included, against everything before it.
+typedef struct {
+  const char *begin;
+  const char *end;
+  // Positions, then this chunk's vertices and triangles. Vertices are
+  // unique within the chunk and indices local to it; groups before the
+  // chunk's first `usemtl` have material -1 and continue the material of
+  // the chunks before.
+  Mesh mesh;
+  v2f *uvs;
+  int uv_count;
+  int uv_cap;
+  // `v` and `vt` lines that failed to parse, in file order; they are not
+  // counted by the face pass either.
+  const char **skipped;
+  int skipped_count;
+  int skipped_cap;
+  VertexTable table; // over mesh.vertices, during the face pass
+  u32 *remap;        // chunk vertex to mesh vertex, with several chunks
+  int position_base; // entries in the chunks before
+  int uv_base;
+  int index_base;
+  int end_material; // current at the chunk's end, -1 when inherited
+  bool has_mtllib;
+  bool failed; // out of memory
+} ObjChunk;
+
+typedef struct {
+  ObjModel *model;
+  ObjChunk *chunks;
+  int chunk_count;
+  v2f *uvs; // every chunk's, in file order
+  TextureJobs textures;
+  TaskQueue decoder;
+  bool decoding; // decoder was started
+} ObjParse;
+
+static bool add_skipped(ObjChunk *chunk, const char *line) {
+  if (!ensure_capacity((void **)&chunk->skipped, &chunk->skipped_cap,
+                       chunk->skipped_count + 1, sizeof(const char *))) {
     return false;
   }
+  chunk->skipped[chunk->skipped_count++] = line;
+  return true;
+}
 
-  model_reset(out);
+static void scan_chunk(void *user, int index) {
+  ObjChunk *chunk = &((ObjParse *)user)->chunks[index];
+  const char *end = chunk->end;
+  bool ok = true;
+  for (const char *p = chunk->begin; ok && p < end; p = next_line(p, end)) {
+    p = skip_blanks(p, end);
+    const char *line = p;
+    if (p + 1 >= end) {
+      continue;
+    }
+    if (p[0] == 'v' && is_blank(p[1])) {
+      v3f v;
+      p += 2;
+      ok = (parse_float(&p, end, &v.x) && parse_float(&p, end, &v.y) &&
+            parse_float(&p, end, &v.z))
+               ? mesh_add_position(&chunk->mesh, v)
+               : add_skipped(chunk, line);
+    } else if (p[0] == 'v' && p[1] == 't') {
+      v2f uv;
+      p += 2;
+      if (parse_float(&p, end, &uv.x) && parse_float(&p, end, &uv.y)) {
+        ok = ensure_capacity((void **)&chunk->uvs, &chunk->uv_cap,
+                             chunk->uv_count + 1, sizeof(v2f));
+        if (ok) {
+          chunk->uvs[chunk->uv_count++] = uv;
+        }
+      } else {
+        ok = add_skipped(chunk, line);
+      }
+    } else if (keyword(p, end, "mtllib")) {
+      chunk->has_mtllib = true;
+    }
+  }
+  chunk->failed = !ok;
+}
 
-  FILE *f = fopen(obj_path, "r");
-  if (!f) {
-    return false;
+// Loads the chunk's `mtllib` files, in order.
+static void load_mtllibs(const ObjChunk *chunk, const char *base_dir,
+                         ObjModel *model, int *material_cap,
+                         TextureJobs *textures) {
+  const char *end = chunk->end;
+  for (const char *p = chunk->begin; p < end; p = next_line(p, end)) {
+    p = skip_blanks(p, end);
+    char mtl_rel[256];
+    if (keyword(p, end, "mtllib") &&
+        copy_token(p + 6, end, mtl_rel, sizeof(mtl_rel))) {
+      char mtl_path[512];
+      join_path(mtl_path, sizeof(mtl_path), base_dir, mtl_rel);
+      parse_mtl(mtl_path, model, material_cap, textures);
+    }
   }
+}
 
-  char base_dir[256];
-  dirname_of(obj_path, base_dir, sizeof(base_dir));
+// Moves the chunk's positions and UVs to their place in the whole file's.
+static void place_chunk(void *user, int index) {
+  ObjParse *parse = user;
+  ObjChunk *chunk = &parse->chunks[index];
+  Mesh *mesh = &parse->model->mesh;
+  if (chunk->mesh.position_count > 0) {
+    memcpy(mesh->positions + chunk->position_base, chunk->mesh.positions,
+           (size_t)chunk->mesh.position_count * sizeof(v3f));
+  }
+  if (chunk->uv_count > 0) {
+    memcpy(parse->uvs + chunk->uv_base, chunk->uvs,
+           (size_t)chunk->uv_count * sizeof(v2f));
+  }
+  free(chunk->mesh.positions);
+  free(chunk->uvs);
+  chunk->mesh.positions = NULL;
+  chunk->uvs = NULL;
+}
 
-  v3f *positions = NULL;
-  int pos_count = 0, pos_cap = 0;
-  v2f *uvs = NULL;
-  int uv_count = 0, uv_cap = 0;
-  ObjFace *faces = NULL;
-  int face_count = 0, face_cap = 0;
-  int material_cap = 0;
-  bool success = true;
+// Adds the face on the line at p, fanned into triangles. position_count and
+// uv_count are the entries before the line. Faces with a missing or
+// out-of-range position index are skipped; a bad UV index reads as (0, 0).
+// False only when memory runs out.
+static bool parse_face(ObjChunk *chunk, const v2f *uvs, int position_count,
+                       int uv_count, int material, const char *p,
+                       const char *end) {
+  Mesh *mesh = &chunk->mesh;
+  int pos[FACE_MAX_CORNERS];
+  v2f uv[FACE_MAX_CORNERS];
+  int count = 0;
+  for (p = skip_blanks(p, end); p < end && *p != '\n';
+       p = skip_blanks(token_end(p, end), end)) {
+    if (count == FACE_MAX_CORNERS) {
+      break;
+    }
+    int vi, ti, ni;
+    if (!parse_corner(p, end, &vi, &ti, &ni)) {
+      return true;
+    }
+    int pos_idx = (vi < 0) ? position_count + vi : vi - 1;
+    int uv_idx = (ti < 0) ? uv_count + ti : ti - 1;
+    if (pos_idx < 0 || pos_idx >= position_count) {
+      return true;
+    }
+    pos[count] = pos_idx;
+    uv[count] = (uv_idx >= 0 && uv_idx < uv_count) ? uvs[uv_idx] : (v2f){0};
+    count++;
+  }
+  if (count < 3) {
+    return true;
+  }
 
-  ObjMaterial *current_mat = NULL;
+  // Corners repeating a position and UV seen before (the `vn` index doesn't
+  // count: the renderer has no normals) reuse that mesh vertex.
+  u32 corners[FACE_MAX_CORNERS];
+  for (int i = 0; i < count; i++) {
+    MeshVertex v = {(u32)pos[i], uv[i]};
+    if (!find_vertex(&chunk->table, mesh, v, &corners[i])) {
+      return false;
+    }
+  }
+  for (int i = 1; i < count - 1; i++) {
+    if (!mesh_add_triangle(mesh, corners[0], corners[i], corners[i + 1],
+                           material)) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  char line[512];
-  while (fgets(line, sizeof(line), f)) {
-    if (line[0] == '#') {
+static void parse_faces(void *user, int index) {
+  ObjParse *parse = user;
+  ObjChunk *chunk = &parse->chunks[index];
+  const char *end = chunk->end;
+  int position_count = chunk->position_base;
+  int uv_count = chunk->uv_base;
+  int skipped = 0;
+  int material = -1;
+  // Sized for about one vertex per position of the chunk's share of the
+  // file, at the spacing hash_vertex gives positions.
+  u32 share = (u32)parse->model->mesh.position_count / (u32)parse->chunk_count;
+  u32 cap = 1024;
+  while (cap < 1u << 30 && cap / 4 < share) {
+    cap *= 2;
+  }
+  bool ok = resize_table(&chunk->table, &chunk->mesh, cap);
+  for (const char *p = chunk->begin; ok && p < end; p = next_line(p, end)) {
+    p = skip_blanks(p, end);
+    if (p + 1 >= end) {
       continue;
     }
-    if (strncmp(line, "mtllib", 6) == 0) {
-      char mtl_rel[256];
-      if (sscanf(line + 6, "%255s", mtl_rel) == 1) {
-        char mtl_path[512];
-        join_path(mtl_path, sizeof(mtl_path), base_dir, mtl_rel);
-        parse_mtl(mtl_path, out, &material_cap);
+    bool is_v = p[0] == 'v' && is_blank(p[1]);
+    if (is_v || (p[0] == 'v' && p[1] == 't')) {
+      if (skipped < chunk->skipped_count && chunk->skipped[skipped] == p) {
+        skipped++;
+      } else if (is_v) {
+        position_count++;
+      } else {
+        uv_count++;
       }
-      continue;
-    }
-    if (strncmp(line, "usemtl", 6) == 0) {
+    } else if (p[0] == 'f' && is_blank(p[1])) {
+      ok = parse_face(chunk, parse->uvs, position_count, uv_count, material,
+                      p + 2, end);
+    } else if (keyword(p, end, "usemtl")) {
       char mat_name[64];
-      if (sscanf(line + 6, "%63s", mat_name) == 1) {
-        current_mat = find_material(out, mat_name);
+      if (copy_token(p + 6, end, mat_name, sizeof(mat_name))) {
+        int found = find_material(parse->model, mat_name);
+        material = (found >= 0) ? found : 0;
       }
-      continue;
     }
-    if (line[0] == 'v' && isspace((unsigned char)line[1])) {
-      float x, y, z;
-      if (sscanf(line + 1, "%f %f %f", &x, &y, &z) == 3) {
-        if (!ensure_capacity((void **)&positions, &pos_cap, pos_count + 1,
-                             sizeof(v3f))) {
-          success = false;
-          goto cleanup;
-        }
-        positions[pos_count++] = (v3f){x, y, z};
-        if (!out->has_bounds) {
-          out->bounds_min = out->bounds_max = (v3f){x, y, z};
-          out->has_bounds = true;
-        } else {
-          if (x < out->bounds_min.x)
-            out->bounds_min.x = x;
-          if (y < out->bounds_min.y)
-            out->bounds_min.y = y;
-          if (z < out->bounds_min.z)
-            out->bounds_min.z = z;
-          if (x > out->bounds_max.x)
-            out->bounds_max.x = x;
-          if (y > out->bounds_max.y)
-            out->bounds_max.y = y;
-          if (z > out->bounds_max.z)
-            out->bounds_max.z = z;
-        }
-      }
+  }
+  chunk->end_material = material;
+  chunk->failed = !ok;
+  free(chunk->table.slots);
+  chunk->table = (VertexTable){0};
+}
+
+// Moves the chunk's indices to their place in the mesh, as mesh vertices.
+static void place_faces(void *user, int index) {
+  ObjParse *parse = user;
+  ObjChunk *chunk = &parse->chunks[index];
+  const Mesh *part = &chunk->mesh;
+  u32 *indices = parse->model->mesh.indices + chunk->index_base;
+  for (int i = 0; i < part->index_count; i++) {
+    indices[i] = chunk->remap[part->indices[i]];
+  }
+}
+
+static void run_chunks(JobPool *pool, ObjParse *parse, JobFn fn) {
+  if (pool) {
+    job_pool_parallel_for(pool, parse->chunk_count, fn, parse);
+    return;
+  }
+  for (int i = 0; i < parse->chunk_count; i++) {
+    fn(parse, i);
+  }
+}
+
+static bool any_failed(const ObjParse *parse) {
+  for (int i = 0; i < parse->chunk_count; i++) {
+    if (parse->chunks[i].failed) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Splits the file into chunks of whole lines, about equal in size.
+static void split_chunks(ObjParse *parse, const char *data, size_t size) {
+  const char *end = data + size;
+  for (int i = 0; i < parse->chunk_count; i++) {
+    ObjChunk *chunk = &parse->chunks[i];
+    chunk->begin =
+        i == 0 ? data
+               : next_line(data + size * (size_t)i / (size_t)parse->chunk_count,
+                           end);
+    if (i > 0) {
+      parse->chunks[i - 1].end = chunk->begin;
+    }
+  }
+  parse->chunks[parse->chunk_count - 1].end = end;
+}
+
+static void merge_bounds(Mesh *mesh, const Mesh *part) {
+  if (!part->has_bounds) {
+    return;
+  }
+  if (!mesh->has_bounds) {
+    mesh->bounds_min = part->bounds_min;
+    mesh->bounds_max = part->bounds_max;
+    mesh->has_bounds = true;
+    return;
+  }
+  mesh->bounds_min.x = fminf(mesh->bounds_min.x, part->bounds_min.x);
+  mesh->bounds_min.y = fminf(mesh->bounds_min.y, part->bounds_min.y);
+  mesh->bounds_min.z = fminf(mesh->bounds_min.z, part->bounds_min.z);
+  mesh->bounds_max.x = fmaxf(mesh->bounds_max.x, part->bounds_max.x);
+  mesh->bounds_max.y = fmaxf(mesh->bounds_max.y, part->bounds_max.y);
+  mesh->bounds_max.z = fmaxf(mesh->bounds_max.z, part->bounds_max.z);
+}
+
+// NULL, without failing, for an empty array.
+static bool alloc_array(void **data, int count, size_t elem) {
+  *data = count > 0 ? malloc((size_t)count * elem) : NULL;
+  return count == 0 || *data;
+}
+
+// After the scan pass: loads the MTL files in file order, gives each chunk
+// its position and UV base and allocates the whole file's arrays.
+static bool finish_scan(ObjParse *parse, const char *base_dir,
+                        int *material_cap) {
+  Mesh *mesh = &parse->model->mesh;
+  int positions = 0, uvs = 0;
+  for (int i = 0; i < parse->chunk_count; i++) {
+    ObjChunk *chunk = &parse->chunks[i];
+    if (chunk->has_mtllib) {
+      load_mtllibs(chunk, base_dir, parse->model, material_cap,
+                   &parse->textures);
+    }
+    chunk->position_base = positions;
+    chunk->uv_base = uvs;
+    positions += chunk->mesh.position_count;
+    uvs += chunk->uv_count;
+    merge_bounds(mesh, &chunk->mesh);
+  }
+  if (parse->chunk_count == 1) {
+    // A lone chunk's arrays are the file's already; place_chunk then has
+    // nothing to move.
+    ObjChunk *chunk = &parse->chunks[0];
+    mesh->positions = chunk->mesh.positions;
+    mesh->position_cap = chunk->mesh.position_cap;
+    mesh->position_count = positions;
+    parse->uvs = chunk->uvs;
+    chunk->mesh.positions = NULL;
+    chunk->mesh.position_count = 0;
+    chunk->uvs = NULL;
+    chunk->uv_count = 0;
+    return true;
+  }
+  if (!alloc_array((void **)&mesh->positions, positions, sizeof(v3f)) ||
+      !alloc_array((void **)&parse->uvs, uvs, sizeof(v2f))) {
+    return false;
+  }
+  mesh->position_count = mesh->position_cap = positions;
+  return true;
+}
+
+static void decode_texture(void *user) {
+  TextureJob *job = user;
+  job->loaded = texture_load(&job->texture, job->path);
+  if (job->loaded) {
+    // Both are optimisations; the texture works without either.
+    texture_build_mips(&job->texture);
+    texture_set_layout(&job->texture, TEXTURE_TILED);
+  }
+}
+
+// Queues the MTL files' textures on up to thread_count workers, no more
+// than there are textures. Without workers they decode right away, as the
+// queue then runs tasks inside push.
+static void start_decoding(ObjParse *parse, int thread_count) {
+  TextureJobs *textures = &parse->textures;
+  if (textures->count == 0) {
+    return;
+  }
+  if (thread_count > textures->count) {
+    thread_count = textures->count;
+  }
+  parse->decoding =
+      thread_count > 0 &&
+      task_queue_init(&parse->decoder, textures->count, thread_count);
+  for (int i = 0; i < textures->count; i++) {
+    TextureJob *job = &textures->jobs[i];
+    if (!parse->decoding ||
+        !task_queue_push(&parse->decoder, decode_texture, job)) {
+      decode_texture(job);
+    }
+  }
+}
+
+// Waits for the decodes and gives each material its texture; with several
+// map_Kd lines the last one wins, as when they were decoded in order.
+static void finish_decoding(ObjParse *parse) {
+  if (parse->decoding) {
+    task_queue_destroy(&parse->decoder);
+  }
+  for (int i = 0; i < parse->textures.count; i++) {
+    TextureJob *job = &parse->textures.jobs[i];
+    if (!job->loaded) {
       continue;
     }
-    if (line[0] == 'v' && line[1] == 't') {
-      float u, v;
-      if (sscanf(line + 2, "%f %f", &u, &v) == 2) {
-        if (!ensure_capacity((void **)&uvs, &uv_cap, uv_count + 1,
-                             sizeof(v2f))) {
-          success = false;
-          goto cleanup;
-        }
-        uvs[uv_count++] = (v2f){u, v};
+    ObjMaterial *mat = &parse->model->materials[job->material];
+    if (mat->has_diffuse) {
+      texture_destroy(&mat->diffuse);
+    }
+    mat->diffuse = job->texture;
+    mat->has_diffuse = true;
+  }
+  free(parse->textures.jobs);
+}
+
+// After the face pass: gives each chunk its index base, merges the chunks'
+// vertices (one used by faces in several chunks is kept once, where it is
+// first used) and joins their groups, resolving the material each chunk
+// starts with.
+static bool finish_faces(ObjParse *parse) {
+  Mesh *mesh = &parse->model->mesh;
+  int indices = 0;
+  for (int i = 0; i < parse->chunk_count; i++) {
+    ObjChunk *chunk = &parse->chunks[i];
+    chunk->index_base = indices;
+    indices += chunk->mesh.index_count;
+  }
+  if (parse->chunk_count == 1) {
+    // As in finish_scan, for place_faces.
+    Mesh *part = &parse->chunks[0].mesh;
+    mesh->vertices = part->vertices;
+    mesh->vertex_count = part->vertex_count;
+    mesh->vertex_cap = part->vertex_cap;
+    mesh->indices = part->indices;
+    mesh->index_cap = part->index_cap;
+    part->vertices = NULL;
+    part->vertex_count = 0;
+    part->indices = NULL;
+    part->index_count = 0;
+  } else {
+    VertexTable table = {0};
+    bool ok = alloc_array((void **)&mesh->indices, indices, sizeof(u32));
+    for (int i = 0; ok && i < parse->chunk_count; i++) {
+      ObjChunk *chunk = &parse->chunks[i];
+      const Mesh *part = &chunk->mesh;
+      ok = alloc_array((void **)&chunk->remap, part->vertex_count,
+                       sizeof(u32));
+      for (int v = 0; ok && v < part->vertex_count; v++) {
+        ok = find_vertex(&table, mesh, part->vertices[v], &chunk->remap[v]);
       }
-      continue;
     }
-    if (line[0] == 'f' && isspace((unsigned char)line[1])) {
-      char *cursor = line + 1;
-      char *tokens[16];
-      int tcount = 0;
-      while (*cursor) {
-        while (isspace((unsigned char)*cursor)) {
-          cursor++;
-        }
-        if (*cursor == '\0' || *cursor == '\n') {
-          break;
-        }
-        if (tcount >= (int)(sizeof(tokens) / sizeof(tokens[0]))) {
-          break;
-        }
-        tokens[tcount++] = cursor;
-        while (*cursor && !isspace((unsigned char)*cursor)) {
-          cursor++;
-        }
-        if (*cursor) {
-          *cursor++ = '\0';
-        }
+    free(table.slots);
+    if (!ok) {
+      return false;
+    }
+    mesh->index_cap = indices;
+  }
+  mesh->index_count = indices;
+
+  int material = 0;
+  for (int i = 0; i < parse->chunk_count; i++) {
+    const ObjChunk *chunk = &parse->chunks[i];
+    for (int g = 0; g < chunk->mesh.group_count; g++) {
+      MeshGroup group = chunk->mesh.groups[g];
+      group.first += chunk->index_base;
+      if (group.material < 0) {
+        group.material = material;
       }
-      if (tcount < 3) {
+      // As mesh_add_triangle: runs of one material share a group.
+      MeshGroup *last =
+          mesh->group_count > 0 ? &mesh->groups[mesh->group_count - 1] : NULL;
+      if (last && last->material == group.material) {
+        last->count += group.count;
         continue;
       }
-
-      int base_vi[16], base_ti[16];
-      for (int i = 0; i < tcount; i++) {
-        base_vi[i] = -1;
-        base_ti[i] = -1;
-      }
-      for (int i = 0; i < tcount; i++) {
-        int vi, ti, ni;
-        if (!parse_index_triplet(tokens[i], &vi, &ti, &ni)) {
-          continue;
-        }
-        int pos_idx = (vi < 0) ? pos_count + vi : vi - 1;
-        int uv_idx = (ti < 0) ? uv_count + ti : ti - 1;
-        base_vi[i] = pos_idx;
-        base_ti[i] = uv_idx;
+      if (!ensure_capacity((void **)&mesh->groups, &mesh->group_cap,
+                           mesh->group_count + 1, sizeof(MeshGroup))) {
+        return false;
       }
+      mesh->groups[mesh->group_count++] = group;
+    }
+    if (chunk->end_material >= 0) {
+      material = chunk->end_material;
+    }
+  }
+  return true;
+}
 
-      for (int i = 1; i < tcount - 1; i++) {
-        if (!ensure_capacity((void **)&faces, &face_cap, face_count + 1,
-                             sizeof(ObjFace))) {
-          success = false;
-          goto cleanup;
-        }
-        ObjFace *face = &faces[face_count++];
-        memset(face, 0, sizeof(*face));
-        face->mat = current_mat;
-        int idx0 = base_vi[0], idx1 = base_vi[i], idx2 = base_vi[i + 1];
-        int uv0 = base_ti[0], uv1 = base_ti[i], uv2 = base_ti[i + 1];
-
-        face->v[0].pos = (idx0 >= 0 && idx0 < pos_count) ? positions[idx0]
-                                                         : (v3f){0};
-        face->v[1].pos = (idx1 >= 0 && idx1 < pos_count) ? positions[idx1]
-                                                         : (v3f){0};
-        face->v[2].pos = (idx2 >= 0 && idx2 < pos_count) ? positions[idx2]
-                                                         : (v3f){0};
-
-        face->v[0].uv = (uv0 >= 0 && uv0 < uv_count) ? uvs[uv0] : (v2f){0};
-        face->v[1].uv = (uv1 >= 0 && uv1 < uv_count) ? uvs[uv1] : (v2f){0};
-        face->v[2].uv = (uv2 >= 0 && uv2 < uv_count) ? uvs[uv2] : (v2f){0};
-      }
+bool obj_model_load(const char *obj_path, ObjModel *out) {
+  return obj_model_load_threads(obj_path, out, 0);
+}
+
+bool obj_model_load_threads(const char *obj_path, ObjModel *out,
+                            int thread_count) {
+  if (!obj_path || !out) {
+    return false;
+  }
+
+  model_reset(out);
+
+  size_t size = 0;
+  const char *data = file_map(obj_path, &size);
+  if (!data) {
+    return false;
+  }
+
+  char base_dir[256];
+  dirname_of(obj_path, base_dir, sizeof(base_dir));
+
+  int material_cap = 0;
+  if (!ensure_capacity((void **)&out->materials, &material_cap, 1,
+                       sizeof(ObjMaterial))) {
+    file_unmap((void *)data, size);
+    return false;
+  }
+  out->materials[out->material_count++] = (ObjMaterial){0};
+
+  // Small files, or a pool without workers, get one chunk on this thread.
+  int workers = thread_count > 0 ? thread_count - 1 : SDL_GetCPUCount() - 1;
+  JobPool pool;
+  bool threaded = size >= 2 * CHUNK_MIN_BYTES && workers > 0 &&
+                  job_pool_init(&pool, workers);
+  if (threaded && pool.thread_count == 0) {
+    job_pool_destroy(&pool);
+    threaded = false;
+  }
+  ObjParse parse = {.model = out, .chunk_count = 1};
+  if (threaded) {
+    size_t most = size / CHUNK_MIN_BYTES;
+    parse.chunk_count = (pool.thread_count + 1) * CHUNKS_PER_THREAD;
+    if ((size_t)parse.chunk_count > most) {
+      parse.chunk_count = (int)most;
     }
   }
+  JobPool *jobs = threaded ? &pool : NULL;
 
-cleanup:
-  fclose(f);
+  parse.chunks = calloc((size_t)parse.chunk_count, sizeof(ObjChunk));
+  bool success = parse.chunks != NULL;
+  if (success) {
+    split_chunks(&parse, data, size);
+    run_chunks(jobs, &parse, scan_chunk);
+    success = !any_failed(&parse) &&
+              finish_scan(&parse, base_dir, &material_cap);
+  }
+  if (success) {
+    // Textures decode while the faces are parsed.
+    start_decoding(&parse, workers);
+    run_chunks(jobs, &parse, place_chunk);
+    run_chunks(jobs, &parse, parse_faces);
+    success = !any_failed(&parse) && finish_faces(&parse);
+  }
+  if (success) {
+    run_chunks(jobs, &parse, place_faces);
+  }
 
+  finish_decoding(&parse);
+  for (int i = 0; parse.chunks && i < parse.chunk_count; i++) {
+    mesh_free(&parse.chunks[i].mesh);
+    free(parse.chunks[i].uvs);
+    free(parse.chunks[i].skipped);
+    free(parse.chunks[i].remap);
+  }
+  free(parse.chunks);
+  free(parse.uvs);
+  if (threaded) {
+    job_pool_destroy(&pool);
+  }
+  file_unmap((void *)data, size);
   if (!success) {
-    free(positions);
-    free(uvs);
-    free(faces);
     obj_model_free(out);
     return false;
   }
-
-  free(positions);
-  free(uvs);
-
-  out->faces = faces;
-  out->face_count = face_count;
   return true;
 }
 
@@ -330,10 +940,14 @@ void obj_model_free(ObjModel *model) {
   if (!model) {
     return;
   }
-  if (model->faces) {
-    free(model->faces);
-    model->faces = NULL;
+  if (model->file) {
+    // Nothing but the material array was allocated apart from the file.
+    free(model->materials);
+    file_unmap(model->file, model->file_size);
+    *model = (ObjModel){0};
+    return;
   }
+  mesh_free(&model->mesh);
   for (int i = 0; i < model->material_count; i++) {
     if (model->materials[i].has_diffuse) {
       texture_destroy(&model->materials[i].diffuse);
@@ -343,7 +957,5 @@ void obj_model_free(ObjModel *model) {
     free(model->materials);
     model->materials = NULL;
   }
-  model->face_count = 0;
   model->material_count = 0;
-  model->has_bounds = false;
 }
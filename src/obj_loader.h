@@ -1,7 +1,9 @@
 #pragma once
 
+#include "mesh.h"
 #include "types.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct {
   char name[64];
@@ -9,20 +11,32 @@ typedef struct {
   bool has_diffuse;
 } ObjMaterial;
 
+// mesh group materials index `materials`. Entry 0 is an unnamed material
+// without a texture used by faces before (or without) a known `usemtl`.
+// The mesh positions are the file's `v` entries, so its bounds cover them.
+// Face corners with the same position and UV share one mesh vertex.
 typedef struct {
-  Vertex3D v[3];
-  ObjMaterial *mat;
-} ObjFace;
-
-typedef struct {
-  ObjFace *faces;
-  int face_count;
+  Mesh mesh;
   ObjMaterial *materials;
   int material_count;
-  v3f bounds_min;
-  v3f bounds_max;
-  bool has_bounds;
+  // Set by cooked_model_load (cooked_model.h): the file the mesh arrays and
+  // texels point into, which obj_model_free releases. The mesh must not be
+  // grown then. NULL for a parsed model.
+  void *file;
+  size_t file_size;
 } ObjModel;
 
+// Files of a few MB and up are split at line boundaries and parsed on a
+// temporary job pool; the result is the same as parsing them in one piece.
+// Every `mtllib` is loaded before faces are read, so a `usemtl` may name a
+// material from a later `mtllib`.
+// Their `map_Kd` textures decode on background threads while the faces are
+// parsed and are all in place when the call returns.
 bool obj_model_load(const char *obj_path, ObjModel *out);
+// thread_count counts the threads parsing and decoding textures, this one
+// included: 1 loads everything on the calling thread, in one chunk, and 0
+// uses every core.
+bool obj_model_load_threads(const char *obj_path, ObjModel *out,
+                            int thread_count);
+// Frees a parsed or a cooked model.
 void obj_model_free(ObjModel *model);
@@ -0,0 +1,292 @@
+#include "pipeline.h"
+#include "colors.h"
+#include "fill.h"
+#include "math.h"
+#include "render.h"
+#include "shapes.h"
+#include <SDL2/SDL.h>
+#include <stddef.h>
+
+typedef struct {
+  v4f clip;
+  v2f uv;
+} ClipVert;
+
+bool s3d_init(S3DContext *ctx, int thread_count) {
+  *ctx = (S3DContext){0};
+  if (!job_pool_init(&ctx->jobs, thread_count)) {
+    return false;
+  }
+  if (!binner_init(&ctx->binner, &ctx->jobs)) {
+    job_pool_destroy(&ctx->jobs);
+    return false;
+  }
+  return true;
+}
+
+void s3d_destroy(S3DContext *ctx) {
+  binner_destroy(&ctx->binner);
+  job_pool_destroy(&ctx->jobs);
+  transform_cache_free(&ctx->xform);
+  hiz_destroy(&ctx->hiz);
+}
+
+void s3d_begin(S3DContext *ctx, u32 *color, float *depth, int w, int h) {
+  ctx->color = color;
+  ctx->depth = depth;
+  ctx->w = w;
+  ctx->h = h;
+  ctx->stats = (S3DStats){0};
+
+  Uint64 start = profiler_begin(ctx->profiler);
+  // Without HiZ storage the rasterizer just skips the coarse tests.
+  HiZ *hiz = NULL;
+  if (hiz_resize(&ctx->hiz, w, h)) {
+    hiz_clear(&ctx->hiz, 1.0f);
+    hiz = &ctx->hiz;
+  } else {
+    SDL_Log("Failed to allocate HiZ buffer");
+  }
+  binner_begin(&ctx->binner, color, depth, hiz, w, h);
+  binner_clear_depth(&ctx->binner, 1.0f, ctx->reuse_depth);
+  profiler_end(ctx->profiler, PROF_CLEAR, start);
+}
+
+void s3d_invalidate_depth(S3DContext *ctx) {
+  binner_invalidate_depth(&ctx->binner);
+}
+
+typedef struct {
+  S3DContext *ctx;
+  u32 value;
+  bool stream;
+} ClearJob;
+
+static void clear_band(void *user, int band) {
+  ClearJob *job = user;
+  S3DContext *ctx = job->ctx;
+  int y0 = band * BIN_TILE_SIZE;
+  int y1 = y0 + BIN_TILE_SIZE < ctx->h ? y0 + BIN_TILE_SIZE : ctx->h;
+  size_t w = (size_t)ctx->w;
+  fill_u32(&ctx->color[(size_t)y0 * w], (size_t)(y1 - y0) * w, job->value,
+           job->stream);
+}
+
+void s3d_clear(S3DContext *ctx, u32 color) {
+  Uint64 start = profiler_begin(ctx->profiler);
+  // Whether the target stays cached depends on all of it, not the band.
+  size_t bytes = (size_t)ctx->w * (size_t)ctx->h * sizeof(u32);
+  ClearJob job = {ctx, color, bytes >= FILL_STREAM_BYTES};
+  int bands = (ctx->h + BIN_TILE_SIZE - 1) / BIN_TILE_SIZE;
+  job_pool_parallel_for(&ctx->jobs, bands, clear_band, &job);
+  profiler_end(ctx->profiler, PROF_CLEAR, start);
+}
+
+static bool project_vertex(const ClipVert *cv, int w, int h, VertexPC *out,
+                           int *mask_out) {
+  v4f clip = cv->clip;
+  if (clip.w == 0.0f) {
+    return false;
+  }
+
+  int mask = 0;
+  if (clip.x < -clip.w)
+    mask |= CLIP_LEFT;
+  if (clip.x > clip.w)
+    mask |= CLIP_RIGHT;
+  if (clip.y < -clip.w)
+    mask |= CLIP_BOTTOM;
+  if (clip.y > clip.w)
+    mask |= CLIP_TOP;
+  if (clip.z < -clip.w)
+    mask |= CLIP_NEAR;
+  if (clip.z > clip.w)
+    mask |= CLIP_FAR;
+
+  float inv_w = 1.0f / clip.w;
+  v3f ndc = {clip.x * inv_w, clip.y * inv_w, clip.z * inv_w};
+  out->pos = norm_to_subpixel((v2f){ndc.x, ndc.y}, w, h);
+  out->uv = cv->uv;
+  out->inv_w = inv_w;
+  out->depth = 0.5f * (ndc.z + 1.0f);
+  *mask_out = mask;
+  return true;
+}
+
+// Counter-clockwise on screen means front facing. Uses the homogeneous
+// determinant, so it needs no divide but does need every w positive.
+static bool front_facing(v4f a, v4f b, v4f c) {
+  float det = a.x * (b.y * c.w - b.w * c.y) - a.y * (b.x * c.w - b.w * c.x) +
+              a.w * (b.x * c.y - b.y * c.x);
+  return det > 0.0f;
+}
+
+// Point where edge a-b crosses the near plane z == -w.
+static ClipVert clip_near(const ClipVert *a, const ClipVert *b) {
+  float da = a->clip.z + a->clip.w;
+  float db = b->clip.z + b->clip.w;
+  float t = da / (da - db);
+  return (ClipVert){
+      .clip = {a->clip.x + (b->clip.x - a->clip.x) * t,
+               a->clip.y + (b->clip.y - a->clip.y) * t,
+               a->clip.z + (b->clip.z - a->clip.z) * t,
+               a->clip.w + (b->clip.w - a->clip.w) * t},
+      .uv = {a->uv.x + (b->uv.x - a->uv.x) * t,
+             a->uv.y + (b->uv.y - a->uv.y) * t}};
+}
+
+static void emit_triangle(S3DContext *ctx, Texture *tex, const VertexPC *pv) {
+  if (ctx->wireframe) {
+    draw_triangle(ctx->color, ctx->w, ctx->h, subpixel_to_screen(pv[0].pos),
+                  subpixel_to_screen(pv[1].pos), subpixel_to_screen(pv[2].pos),
+                  WHITE, WIREFRAME);
+  } else {
+    binner_textured_triangle(&ctx->binner, tex, pv[0], pv[1], pv[2]);
+  }
+  ctx->stats.drawn++;
+}
+
+// Sutherland-Hodgman against the near plane only; the other planes are left
+// to the rasterizer's screen clipping.
+static void draw_clipped(S3DContext *ctx, Texture *tex, const ClipVert *cv,
+                         const bool *near_in) {
+  ClipVert poly[4];
+  int count = 0;
+  for (int v = 0; v < 3; v++) {
+    const ClipVert *a = &cv[v];
+    const ClipVert *b = &cv[(v + 1) % 3];
+    bool a_in = near_in[v];
+    bool b_in = near_in[(v + 1) % 3];
+
+    if (a_in && b_in) {
+      poly[count++] = *b;
+    } else if (a_in && !b_in) {
+      poly[count++] = clip_near(a, b);
+    } else if (!a_in && b_in) {
+      poly[count++] = clip_near(a, b);
+      poly[count++] = *b;
+    }
+  }
+  if (count < 3) {
+    return;
+  }
+
+  int tri_sets[2][3] = {{0, 1, 2}, {0, 2, 3}};
+  int tri_total = (count == 4) ? 2 : 1;
+  for (int t = 0; t < tri_total; t++) {
+    const ClipVert *a = &poly[tri_sets[t][0]];
+    const ClipVert *b = &poly[tri_sets[t][1]];
+    const ClipVert *c = &poly[tri_sets[t][2]];
+    if (!front_facing(a->clip, b->clip, c->clip)) {
+      continue;
+    }
+
+    VertexPC pv[3];
+    int masks[3];
+    if (!project_vertex(a, ctx->w, ctx->h, &pv[0], &masks[0]) ||
+        !project_vertex(b, ctx->w, ctx->h, &pv[1], &masks[1]) ||
+        !project_vertex(c, ctx->w, ctx->h, &pv[2], &masks[2])) {
+      continue;
+    }
+    if ((masks[0] & masks[1] & masks[2]) != 0) {
+      continue;
+    }
+    emit_triangle(ctx, tex, pv);
+  }
+}
+
+void s3d_draw_mesh(S3DContext *ctx, const Mesh *mesh, mat4 mvp,
+                   const S3DMaterial *materials) {
+  ctx->stats.meshes++;
+  Uint64 start = profiler_begin(ctx->profiler);
+  // mvp's planes are in the mesh's own space, so its bounds are tested as
+  // stored and an off-screen mesh is dropped before any vertex work.
+  Frustum frustum = frustum_from_matrix(mvp);
+  if (!mesh->has_bounds ||
+      !frustum_test_aabb(&frustum, mesh->bounds_min, mesh->bounds_max)) {
+    ctx->stats.meshes_culled++;
+    profiler_end(ctx->profiler, PROF_TRANSFORM, start);
+    return;
+  }
+
+  // Every shared position is transformed once up front; triangles below
+  // only look up their three corners.
+  bool transformed = mesh_transform(mesh, mvp, ctx->w, ctx->h, &ctx->xform);
+  profiler_end(ctx->profiler, PROF_TRANSFORM, start);
+  if (!transformed) {
+    SDL_Log("Failed to allocate transform cache");
+    return;
+  }
+  const TransformedVertex *xf = ctx->xform.verts;
+
+  // Culling, near clipping, projection and binning.
+  start = profiler_begin(ctx->profiler);
+  for (int g = 0; g < mesh->group_count; g++) {
+    const MeshGroup *group = &mesh->groups[g];
+    Texture *tex = materials[group->material].texture;
+    if (!tex) {
+      continue;
+    }
+    ctx->stats.triangles += group->count / 3;
+
+    for (int i = group->first; i < group->first + group->count; i += 3) {
+      const TransformedVertex *tv[3];
+      ClipVert cv[3];
+      for (int j = 0; j < 3; j++) {
+        const MeshVertex *vert = &mesh->vertices[mesh->indices[i + j]];
+        tv[j] = &xf[vert->pos];
+        cv[j] = (ClipVert){tv[j]->clip, vert->uv};
+      }
+
+      int mask_and = tv[0]->clip_mask & tv[1]->clip_mask & tv[2]->clip_mask;
+      int mask_or = tv[0]->clip_mask | tv[1]->clip_mask | tv[2]->clip_mask;
+      if (mask_and != 0) {
+        ctx->stats.culled++;
+        continue;
+      }
+
+      if (mask_or & CLIP_NEAR) {
+        bool near_in[3] = {!(tv[0]->clip_mask & CLIP_NEAR),
+                           !(tv[1]->clip_mask & CLIP_NEAR),
+                           !(tv[2]->clip_mask & CLIP_NEAR)};
+        draw_clipped(ctx, tex, cv, near_in);
+        continue;
+      }
+
+      if ((mask_or & CLIP_FAR) ||
+          !front_facing(cv[0].clip, cv[1].clip, cv[2].clip)) {
+        continue;
+      }
+      VertexPC pv[3];
+      for (int j = 0; j < 3; j++) {
+        pv[j] = (VertexPC){.pos = tv[j]->screen,
+                           .uv = cv[j].uv,
+                           .inv_w = tv[j]->inv_w,
+                           .depth = tv[j]->depth};
+      }
+      emit_triangle(ctx, tex, pv);
+    }
+  }
+  profiler_end(ctx->profiler, PROF_CLIP, start);
+}
+
+void s3d_end(S3DContext *ctx) {
+  Uint64 start = profiler_begin(ctx->profiler);
+  binner_flush(&ctx->binner);
+  profiler_end(ctx->profiler, PROF_RASTER, start);
+
+  S3DStats *stats = &ctx->stats;
+  stats->pixels_tested = ctx->binner.counters.tested;
+  stats->pixels_written = ctx->binner.counters.written;
+  stats->pixels_hiz_rejected = ctx->binner.counters.hiz_rejected;
+
+  Profiler *prof = ctx->profiler;
+  profiler_count(prof, PROF_TRIANGLES_IN, stats->triangles);
+  profiler_count(prof, PROF_TRIANGLES_OUT, stats->drawn);
+  profiler_count(prof, PROF_PIXELS_TESTED, (double)stats->pixels_tested);
+  profiler_count(prof, PROF_PIXELS_WRITTEN, (double)stats->pixels_written);
+  profiler_count(prof, PROF_DEPTH_REJECTED,
+                 (double)(stats->pixels_tested - stats->pixels_written));
+  profiler_count(prof, PROF_OVERDRAW,
+                 (double)stats->pixels_written / ((double)ctx->w * ctx->h));
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "binner.h"
+#include "hiz.h"
+#include "jobs.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "types.h"
+#include <stdbool.h>
+
+typedef struct {
+  Texture *texture; // groups with no texture are skipped
+} S3DMaterial;
+
+typedef struct {
+  int meshes;        // s3d_draw_mesh calls
+  int meshes_culled; // bounds outside the frustum, skipped before transform
+  int triangles;     // submitted by the meshes that were not skipped
+  int culled;        // triangles rejected by the frustum test
+  int drawn;         // sent to the rasterizer, near-clipped pieces apart
+  // Filled by s3d_end. Tested counts every covered pixel, including those
+  // HiZ rejected a block at a time; tested - written were depth-rejected.
+  long long pixels_tested;
+  long long pixels_written;
+  long long pixels_hiz_rejected;
+} S3DStats;
+
+// Renderer state shared by every draw: the worker pool and binner, the
+// post-transform cache and the HiZ mirroring the current depth target.
+// Targets are plain caller-owned buffers and nothing here opens a window or
+// needs SDL video, so the same calls render offscreen (see bench/bench.c).
+typedef struct {
+  JobPool jobs;
+  Binner binner;
+  TransformCache xform;
+  HiZ hiz;
+  u32 *color;
+  float *depth;
+  int w;
+  int h;
+  bool wireframe; // outline triangles straight into `color` instead
+  S3DStats stats;
+  Profiler *profiler; // optional: times the stages, s3d_end adds the counters
+  // Only re-clear depth where the last frame drew. Set it when nothing else
+  // writes the depth target between frames; see s3d_invalidate_depth.
+  bool reuse_depth;
+} S3DContext;
+
+// thread_count as for job_pool_init.
+bool s3d_init(S3DContext *ctx, int thread_count);
+void s3d_destroy(S3DContext *ctx);
+// Starts a frame on a caller-owned w x h target and resets the stats. Depth
+// is cleared to 1 by s3d_end, tile by tile as the tiles are rasterized, so
+// it must not be read in between; color is left alone, see s3d_clear.
+void s3d_begin(S3DContext *ctx, u32 *color, float *depth, int w, int h);
+// With reuse_depth, makes the next frame clear all of depth: call it after
+// writing the depth target yourself or reallocating it. A different address
+// or size is noticed without it.
+void s3d_invalidate_depth(S3DContext *ctx);
+// Fills the color target given to s3d_begin, in bands across the workers.
+void s3d_clear(S3DContext *ctx, u32 color);
+// Skips the mesh when its bounds are outside the frustum, otherwise
+// transforms, culls, near-clips and projects it, then queues its triangles.
+// Each group uses materials[group->material].
+void s3d_draw_mesh(S3DContext *ctx, const Mesh *mesh, mat4 mvp,
+                   const S3DMaterial *materials);
+// Rasterizes everything queued since s3d_begin.
+void s3d_end(S3DContext *ctx);
@@ -0,0 +1,206 @@
+#include "profiler.h"
+#include "text.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *stage_names[PROF_STAGE_COUNT] = {
+    "clear", "transform", "clip", "raster", "hud", "present",
+};
+
+static const char *counter_names[PROF_COUNTER_COUNT] = {
+    "triangles in",   "triangles out",  "pixels tested",
+    "pixels written", "depth rejected", "overdraw",
+};
+
+static double ticks_to_ms(Uint64 ticks) {
+  return (double)ticks * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+bool profiler_init(Profiler *prof) {
+  *prof = (Profiler){0};
+  prof->frame_start = SDL_GetPerformanceCounter();
+  return true;
+}
+
+void profiler_destroy(Profiler *prof) {
+  free(prof->events);
+  free(prof->frames);
+  *prof = (Profiler){0};
+}
+
+void profiler_begin_frame(Profiler *prof) {
+  prof->frame_start = SDL_GetPerformanceCounter();
+  memset(prof->stage_ms, 0, sizeof(prof->stage_ms));
+  memset(prof->counters, 0, sizeof(prof->counters));
+}
+
+Uint64 profiler_begin(Profiler *prof) {
+  return prof ? SDL_GetPerformanceCounter() : 0;
+}
+
+void profiler_end(Profiler *prof, ProfStage stage, Uint64 start) {
+  if (!prof) {
+    return;
+  }
+  Uint64 end = SDL_GetPerformanceCounter();
+  prof->stage_ms[stage] += ticks_to_ms(end - start);
+  if (!profiler_tracing(prof)) {
+    return;
+  }
+  if (prof->event_count == prof->event_cap) {
+    int new_cap = prof->event_cap == 0 ? 1024 : prof->event_cap * 2;
+    ProfEvent *events =
+        realloc(prof->events, (size_t)new_cap * sizeof(ProfEvent));
+    if (!events) {
+      return; // the trace just misses this scope
+    }
+    prof->events = events;
+    prof->event_cap = new_cap;
+  }
+  prof->events[prof->event_count++] = (ProfEvent){stage, start, end};
+}
+
+void profiler_count(Profiler *prof, ProfCounter counter, double value) {
+  if (prof) {
+    prof->counters[counter] += value;
+  }
+}
+
+bool profiler_tracing(const Profiler *prof) { return prof->frame_cap > 0; }
+
+bool profiler_start_trace(Profiler *prof, const char *path, int frames) {
+  if (profiler_tracing(prof) || frames <= 0) {
+    return false;
+  }
+  prof->frames = malloc((size_t)frames * sizeof(ProfFrame));
+  if (!prof->frames) {
+    return false;
+  }
+  prof->frame_cap = frames;
+  prof->frame_count = 0;
+  prof->event_count = 0;
+  snprintf(prof->trace_path, sizeof(prof->trace_path), "%s", path);
+  return true;
+}
+
+// Chrome's trace-event format: "X" complete events with microsecond
+// timestamps for the scopes, "C" counter events once per frame.
+static bool write_trace(const Profiler *prof) {
+  FILE *file = fopen(prof->trace_path, "w");
+  if (!file) {
+    SDL_Log("Failed to open trace file: %s", prof->trace_path);
+    return false;
+  }
+  Uint64 origin = prof->frames[0].start;
+  double us = 1e6 / (double)SDL_GetPerformanceFrequency();
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                "\"args\":{\"name\":\"frame\"}}");
+  for (int i = 0; i < prof->frame_count; i++) {
+    const ProfFrame *frame = &prof->frames[i];
+    double ts = (double)(frame->start - origin) * us;
+    fprintf(file,
+            ",\n{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"index\":%d}}",
+            ts, (double)(frame->end - frame->start) * us, i);
+    for (int c = 0; c < PROF_COUNTER_COUNT; c++) {
+      fprintf(file,
+              ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,"
+              "\"args\":{\"value\":%.6g}}",
+              counter_names[c], ts, frame->counters[c]);
+    }
+  }
+  for (int i = 0; i < prof->event_count; i++) {
+    const ProfEvent *event = &prof->events[i];
+    fprintf(file,
+            ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+            "\"ts\":%.3f,\"dur\":%.3f}",
+            stage_names[event->stage], (double)(event->start - origin) * us,
+            (double)(event->end - event->start) * us);
+  }
+  fprintf(file, "\n]}\n");
+
+  bool ok = !ferror(file);
+  if (fclose(file) != 0 || !ok) {
+    SDL_Log("Failed to write trace file: %s", prof->trace_path);
+    return false;
+  }
+  SDL_Log("Wrote %d frames to %s", prof->frame_count, prof->trace_path);
+  return true;
+}
+
+void profiler_end_frame(Profiler *prof) {
+  Uint64 end = SDL_GetPerformanceCounter();
+  double frame_ms = ticks_to_ms(end - prof->frame_start);
+  // Same smoothing as the demos' fps readout.
+  prof->avg_frame_ms = prof->avg_frame_ms * 0.9 + frame_ms * 0.1;
+  for (int i = 0; i < PROF_STAGE_COUNT; i++) {
+    prof->avg_stage_ms[i] =
+        prof->avg_stage_ms[i] * 0.9 + prof->stage_ms[i] * 0.1;
+  }
+  memcpy(prof->last_counters, prof->counters, sizeof(prof->counters));
+
+  if (!profiler_tracing(prof)) {
+    return;
+  }
+  ProfFrame *frame = &prof->frames[prof->frame_count++];
+  frame->start = prof->frame_start;
+  frame->end = end;
+  memcpy(frame->counters, prof->counters, sizeof(prof->counters));
+  if (prof->frame_count == prof->frame_cap) {
+    write_trace(prof);
+    free(prof->frames);
+    prof->frames = NULL;
+    prof->frame_cap = 0;
+    prof->frame_count = 0;
+    prof->event_count = 0;
+  }
+}
+
+const char *profiler_stage_name(ProfStage stage) { return stage_names[stage]; }
+
+const char *profiler_counter_name(ProfCounter counter) {
+  return counter_names[counter];
+}
+
+// The HUD font only has capitals, and draw_text doesn't clip.
+static void draw_line(u32 *buffer, int w, int h, v2i pos, u32 color,
+                      const char *name, long long value, const char *unit) {
+  char text[64];
+  snprintf(text, sizeof(text), "%s: %lld%s", name, value, unit);
+  int len = (int)strlen(text);
+  if (pos.x < 0 || pos.y < 0 || pos.x + len * 6 > w || pos.y + 7 > h) {
+    return;
+  }
+  for (int i = 0; i < len; i++) {
+    text[i] = (char)toupper((unsigned char)text[i]);
+  }
+  draw_text(buffer, w, pos, text, color);
+}
+
+void profiler_draw(const Profiler *prof, u32 *buffer, int w, int h, v2i pos,
+                   u32 color) {
+  const int line = 10;
+  draw_line(buffer, w, h, pos, color, "frame",
+            (long long)(prof->avg_frame_ms * 1000.0), " us");
+  pos.y += line;
+  for (int i = 0; i < PROF_STAGE_COUNT; i++) {
+    draw_line(buffer, w, h, pos, color, stage_names[i],
+              (long long)(prof->avg_stage_ms[i] * 1000.0), " us");
+    pos.y += line;
+  }
+  for (int i = 0; i < PROF_COUNTER_COUNT; i++) {
+    bool percent = i == PROF_OVERDRAW;
+    double value = prof->last_counters[i] * (percent ? 100.0 : 1.0);
+    draw_line(buffer, w, h, pos, color, counter_names[i], (long long)value,
+              percent ? " pct" : "");
+    pos.y += line;
+  }
+  if (profiler_tracing(prof)) {
+    draw_line(buffer, w, h, pos, color, "tracing frame",
+              (long long)prof->frame_count, "");
+  }
+}
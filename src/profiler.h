@@ -0,0 +1,82 @@
+#pragma once
+
+#include "types.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+typedef enum {
+  PROF_CLEAR, // color and HiZ; depth is cleared per tile during raster
+  PROF_TRANSFORM,
+  PROF_CLIP,
+  PROF_RASTER,
+  PROF_HUD,
+  PROF_PRESENT,
+  PROF_STAGE_COUNT,
+} ProfStage;
+
+typedef enum {
+  PROF_TRIANGLES_IN,  // submitted by meshes that passed the bounds test
+  PROF_TRIANGLES_OUT, // sent to the rasterizer
+  PROF_PIXELS_TESTED,
+  PROF_PIXELS_WRITTEN,
+  PROF_DEPTH_REJECTED,
+  PROF_OVERDRAW, // pixels written per target pixel
+  PROF_COUNTER_COUNT,
+} ProfCounter;
+
+// One timed scope, kept only while a trace is being captured.
+typedef struct {
+  ProfStage stage;
+  Uint64 start;
+  Uint64 end;
+} ProfEvent;
+
+typedef struct {
+  Uint64 start;
+  Uint64 end;
+  double counters[PROF_COUNTER_COUNT];
+} ProfFrame;
+
+// Frame profiler: stage times and counters of the frame in progress, smoothed
+// copies of the finished ones for display, and an optional capture of the
+// next few frames written out as Chrome trace-event JSON (chrome://tracing,
+// ui.perfetto.dev). Timers run on the thread driving the frame; stages that
+// fan out to workers (raster) are timed as a whole.
+typedef struct {
+  Uint64 frame_start;
+  double stage_ms[PROF_STAGE_COUNT];
+  double counters[PROF_COUNTER_COUNT];
+  double avg_stage_ms[PROF_STAGE_COUNT];
+  double avg_frame_ms;
+  double last_counters[PROF_COUNTER_COUNT];
+  ProfEvent *events;
+  int event_count;
+  int event_cap;
+  ProfFrame *frames;
+  int frame_count;
+  int frame_cap;
+  char trace_path[256];
+} Profiler;
+
+bool profiler_init(Profiler *prof);
+void profiler_destroy(Profiler *prof);
+void profiler_begin_frame(Profiler *prof);
+// Folds the frame into the averages and, once a capture has all its frames,
+// writes the trace file.
+void profiler_end_frame(Profiler *prof);
+// Scoped timer: pass the returned timestamp to profiler_end. Both accept a
+// NULL profiler and do nothing, so callers needn't check.
+Uint64 profiler_begin(Profiler *prof);
+void profiler_end(Profiler *prof, ProfStage stage, Uint64 start);
+// Adds to one of the frame's counters.
+void profiler_count(Profiler *prof, ProfCounter counter, double value);
+// Captures the next `frames` frames and writes them to path when done.
+// Returns false if a capture is already running or memory is short.
+bool profiler_start_trace(Profiler *prof, const char *path, int frames);
+bool profiler_tracing(const Profiler *prof);
+const char *profiler_stage_name(ProfStage stage);
+const char *profiler_counter_name(ProfCounter counter);
+// Draws the averaged stage times and last frame's counters as a text panel
+// into a w x h buffer, leaving out lines that don't fit.
+void profiler_draw(const Profiler *prof, u32 *buffer, int w, int h, v2i pos,
+                   u32 color);
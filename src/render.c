@@ -1,6 +1,7 @@
 #include "render.h"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,10 +20,35 @@ v2f screen_to_norm(v2i screen, int w, int h) {
   return norm;
 }
 
+// Far enough outside any target that no visible pixel is affected, close
+// enough that edge function products stay well inside 64 bits.
+#define SUBPIXEL_GUARD (float)(1 << 26)
+
+static int to_subpixel(float v) {
+  if (v < -SUBPIXEL_GUARD)
+    v = -SUBPIXEL_GUARD;
+  if (v > SUBPIXEL_GUARD)
+    v = SUBPIXEL_GUARD;
+  return (int)floorf(v + 0.5f);
+}
+
+v2i norm_to_subpixel(v2f norm, int w, int h) {
+  v2i pos;
+  pos.x = to_subpixel((norm.x * 0.5f + 0.5f) * (float)(w * SUBPIXEL_ONE));
+  pos.y = to_subpixel((-norm.y * 0.5f + 0.5f) * (float)(h * SUBPIXEL_ONE));
+  return pos;
+}
+
+v2i subpixel_to_screen(v2i pos) {
+  return (v2i){pos.x >> SUBPIXEL_BITS, pos.y >> SUBPIXEL_BITS};
+}
+
 bool texture_load(Texture *tex, const char *path) {
   tex->pixels = NULL;
   tex->w = 0;
   tex->h = 0;
+  tex->level_count = 0;
+  tex->layout = TEXTURE_LINEAR;
 
   SDL_Surface *loaded = IMG_Load(path);
   if (!loaded) {
@@ -52,13 +78,187 @@ bool texture_load(Texture *tex, const char *path) {
   return true;
 }
 
+// Box filter; an odd last row or column is left out, like the sizes.
+static void downsample(const u32 *src, int sw, int sh, u32 *dst, int dw,
+                       int dh) {
+  for (int y = 0; y < dh; y++) {
+    const u32 *row0 = src + (size_t)(2 * y < sh ? 2 * y : sh - 1) * sw;
+    const u32 *row1 = src + (size_t)(2 * y + 1 < sh ? 2 * y + 1 : sh - 1) * sw;
+    for (int x = 0; x < dw; x++) {
+      int x0 = 2 * x < sw ? 2 * x : sw - 1;
+      int x1 = 2 * x + 1 < sw ? 2 * x + 1 : sw - 1;
+      u32 out = 0;
+      for (int shift = 0; shift < 32; shift += 8) {
+        u32 sum = ((row0[x0] >> shift) & 0xFF) + ((row0[x1] >> shift) & 0xFF) +
+                  ((row1[x0] >> shift) & 0xFF) + ((row1[x1] >> shift) & 0xFF);
+        out |= ((sum + 2) >> 2) << shift;
+      }
+      dst[(size_t)y * dw + x] = out;
+    }
+  }
+}
+
+static void free_mips(Texture *tex) {
+  if (tex->level_count > 1) {
+    free(tex->levels[1]); // levels 1 and up share one block
+  }
+  tex->level_count = 0;
+}
+
+bool texture_build_mips(Texture *tex) {
+  // Filter in rows, then store the chain like level 0.
+  TextureLayout layout = tex->layout;
+  if (tex->stride != 0 || !texture_set_layout(tex, TEXTURE_LINEAR)) {
+    return false;
+  }
+  free_mips(tex);
+  int count = 1;
+  size_t total = 0;
+  for (int w = tex->w, h = tex->h;
+       (w > 1 || h > 1) && count < TEXTURE_MAX_LEVELS; count++) {
+    w = w > 1 ? w / 2 : 1;
+    h = h > 1 ? h / 2 : 1;
+    total += (size_t)w * (size_t)h;
+  }
+
+  u32 *storage = NULL;
+  if (total > 0) {
+    storage = malloc(total * sizeof(u32));
+    if (!storage) {
+      SDL_Log("Failed to allocate mip levels");
+      return false;
+    }
+  }
+  tex->levels[0] = tex->pixels;
+  int w = tex->w, h = tex->h;
+  for (int i = 1; i < count; i++) {
+    int lw = w > 1 ? w / 2 : 1;
+    int lh = h > 1 ? h / 2 : 1;
+    tex->levels[i] = storage;
+    downsample(tex->levels[i - 1], w, h, storage, lw, lh);
+    storage += (size_t)lw * (size_t)lh;
+    w = lw;
+    h = lh;
+  }
+  tex->level_count = count;
+  return texture_set_layout(tex, layout);
+}
+
+static int level_w(const Texture *tex, int level) {
+  return tex->w >> level > 1 ? tex->w >> level : 1;
+}
+
+static int level_h(const Texture *tex, int level) {
+  return tex->h >> level > 1 ? tex->h >> level : 1;
+}
+
+static int level_stride(const Texture *tex, int level) {
+  if (tex->stride == 0) {
+    return level_w(tex, level);
+  }
+  return tex->stride >> level > 1 ? tex->stride >> level : 1;
+}
+
+static int pad_to_tile(int n) {
+  return (n + TEXTURE_TILE - 1) / TEXTURE_TILE * TEXTURE_TILE;
+}
+
+static size_t level_size(TextureLayout layout, int w, int h) {
+  if (layout == TEXTURE_TILED) {
+    return (size_t)pad_to_tile(w) * (size_t)pad_to_tile(h);
+  }
+  return (size_t)w * (size_t)h;
+}
+
+// Same addressing as the span shaders.
+static size_t texel_index(TextureLayout layout, int w, int x, int y) {
+  if (layout == TEXTURE_TILED) {
+    size_t tiles_x = (size_t)pad_to_tile(w) / TEXTURE_TILE;
+    size_t tile = (size_t)(y / TEXTURE_TILE) * tiles_x +
+                  (size_t)(x / TEXTURE_TILE);
+    return (tile * TEXTURE_TILE + (size_t)(y % TEXTURE_TILE)) * TEXTURE_TILE +
+           (size_t)(x % TEXTURE_TILE);
+  }
+  return (size_t)y * (size_t)w + (size_t)x;
+}
+
+bool texture_set_layout(Texture *tex, TextureLayout layout) {
+  if (tex->stride != 0) {
+    return tex->layout == layout;
+  }
+  if (tex->layout == layout || !tex->pixels) {
+    tex->layout = layout;
+    return true;
+  }
+  size_t base = level_size(layout, tex->w, tex->h);
+  size_t chain = 0;
+  for (int i = 1; i < tex->level_count; i++) {
+    chain += level_size(layout, level_w(tex, i), level_h(tex, i));
+  }
+  // Padding texels are never sampled; zero them so the buffers are defined.
+  u32 *pixels = calloc(base, sizeof(u32));
+  u32 *storage = chain > 0 ? calloc(chain, sizeof(u32)) : NULL;
+  if (!pixels || (chain > 0 && !storage)) {
+    free(pixels);
+    free(storage);
+    SDL_Log("Failed to allocate texture memory for the new layout");
+    return false;
+  }
+
+  int count = tex->level_count > 1 ? tex->level_count : 1;
+  u32 *levels[TEXTURE_MAX_LEVELS] = {pixels};
+  for (int i = 1; i < count; i++) {
+    levels[i] = storage;
+    storage += level_size(layout, level_w(tex, i), level_h(tex, i));
+  }
+  for (int i = 0; i < count; i++) {
+    const u32 *src = i == 0 ? tex->pixels : tex->levels[i];
+    int w = level_w(tex, i), h = level_h(tex, i);
+    for (int y = 0; y < h; y++) {
+      for (int x = 0; x < w; x++) {
+        levels[i][texel_index(layout, w, x, y)] =
+            src[texel_index(tex->layout, w, x, y)];
+      }
+    }
+  }
+
+  free(tex->pixels);
+  if (tex->level_count > 1) {
+    free(tex->levels[1]);
+  }
+  tex->pixels = pixels;
+  for (int i = 0; i < count; i++) {
+    tex->levels[i] = levels[i];
+  }
+  tex->layout = layout;
+  return true;
+}
+
+size_t texture_texel_offset(const Texture *tex, int level, int x, int y) {
+  return texel_index(tex->layout, level_stride(tex, level), x, y);
+}
+
+size_t texture_level_size(const Texture *tex, int level) {
+  return level_size(tex->layout, level_w(tex, level), level_h(tex, level));
+}
+
+u32 texture_texel(const Texture *tex, int level, int x, int y) {
+  const u32 *texels = level == 0 ? tex->pixels : tex->levels[level];
+  return texels[texture_texel_offset(tex, level, x, y)];
+}
+
 void texture_destroy(Texture *tex) {
+  if (tex->stride != 0) {
+    return; // an atlas or a cooked model file owns the texels
+  }
+  free_mips(tex);
   if (tex->pixels) {
     free(tex->pixels);
     tex->pixels = NULL;
   }
   tex->w = 0;
   tex->h = 0;
+  tex->layout = TEXTURE_LINEAR;
 }
 
 void set_pixel(u32 *buffer, int w, v2i pos, u32 color) {
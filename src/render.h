@@ -2,10 +2,35 @@
 
 #include "types.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 v2i norm_to_screen(v2f norm, int w, int h);
 v2f screen_to_norm(v2i screen, int w, int h);
+// NDC to the rasterizer's fixed-point screen space, [-1, 1] spanning the
+// whole target edge to edge.
+v2i norm_to_subpixel(v2f norm, int w, int h);
+// Pixel containing a fixed-point position.
+v2i subpixel_to_screen(v2i pos);
 void set_pixel(u32 *buffer, int w, v2i pos, u32 color);
 void draw_linei(u32 *buffer, int w, int h, v2i p1, v2i p2, u32 color);
 bool texture_load(Texture *tex, const char *path);
+// Builds the mip chain down to 1x1 by averaging 2x2 texels, so the
+// rasterizer can sample minified triangles from a smaller level. Rebuilds it
+// if there already is one. Neither this nor texture_set_layout works on
+// textures that don't own their texels (atlas views, cooked models).
+bool texture_build_mips(Texture *tex);
+// Converts every level to the given layout in place (new buffers, same
+// texels). The rasterizer samples either; TEXTURE_TILED suits textures that
+// are large or seen at steep angles. Call it after texture_build_mips or
+// before, the chain keeps the layout.
+bool texture_set_layout(Texture *tex, TextureLayout layout);
+// Texel (x, y) of a level, whatever the layout, and where it is stored
+// relative to the level's first texel.
+u32 texture_texel(const Texture *tex, int level, int x, int y);
+size_t texture_texel_offset(const Texture *tex, int level, int x, int y);
+// Texels stored for a level of a texture that owns its texels, padding
+// included.
+size_t texture_level_size(const Texture *tex, int level);
+// Frees the pixels and any mip chain; textures that don't own their texels
+// (stride set) are left alone.
 void texture_destroy(Texture *tex);
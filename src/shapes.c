@@ -1,9 +1,13 @@
 #include "shapes.h"
 #include "colors.h"
+#include "hiz.h"
 #include "render.h"
+#include "span.h"
 #include "types.h"
 #include "utils.h"
 #include <math.h>
+#include <stddef.h>
+#include <string.h>
 
 void draw_triangle(u32 *buffer, int w, int h, v2i p1, v2i p2, v2i p3, u32 color,
                    u32 mode) {
@@ -109,84 +113,502 @@ void draw_triangle_dots(u32 *buffer, int w, int h, v2i p1, v2i p2, v2i p3,
   }
 }
 
-static inline float edge_func(v2i a, v2i b, float x, float y) {
-  return (y - (float)a.y) * ((float)b.x - (float)a.x) -
-         (x - (float)a.x) * ((float)b.y - (float)a.y);
+// Edge function in 28.4 units sampled at pixel centres, so every value is
+// an exact integer and stepping it can't drift.
+typedef struct {
+  long long row;  // value at (min_x, y)
+  long long dx;   // step for x + 1
+  long long dy;   // step for y + 1
+  long long bias; // subtracted before the coverage test, see edge_setup
+} EdgeStep;
+
+static inline EdgeStep edge_setup(v2i a, v2i b, int x, int y, int sign) {
+  long long ex = (long long)b.x - a.x;
+  long long ey = (long long)b.y - a.y;
+  long long px = (long long)x * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+  long long py = (long long)y * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+  EdgeStep e;
+  e.row = ((py - a.y) * ex - (px - a.x) * ey) * sign;
+  e.dx = -ey * SUBPIXEL_ONE * sign;
+  e.dy = ex * SUBPIXEL_ONE * sign;
+  // Top-left rule: a centre exactly on the edge is covered only when the
+  // inside lies to the edge's right, or below a horizontal edge. The other
+  // triangle sharing the edge sees it flipped, so the pixel is drawn once.
+  e.bias = (e.dx > 0 || (e.dx == 0 && e.dy > 0)) ? 0 : 1;
+  return e;
+}
+
+// Narrows [*lo, *hi] (offsets from the row start) to where e + k * dx >= 0.
+static inline void edge_span(long long e, long long dx, int *lo, int *hi) {
+  if (dx == 0) {
+    if (e < 0) {
+      *hi = -1;
+    }
+    return;
+  }
+  if (dx > 0) {
+    if (e < 0) {
+      long long k = (-e + dx - 1) / dx;
+      if (k > *lo) {
+        *lo = k > *hi ? *hi + 1 : (int)k;
+      }
+    }
+  } else {
+    if (e < 0) {
+      *hi = -1;
+      return;
+    }
+    long long k = e / -dx;
+    if (k < *hi) {
+      *hi = (int)k;
+    }
+  }
+}
+
+bool triangle_pixel_bounds(v2i p0, v2i p1, v2i p2, v2i *min, v2i *max) {
+  int x0 = p0.x < p1.x ? p0.x : p1.x;
+  int x1 = p0.x > p1.x ? p0.x : p1.x;
+  int y0 = p0.y < p1.y ? p0.y : p1.y;
+  int y1 = p0.y > p1.y ? p0.y : p1.y;
+  x0 = p2.x < x0 ? p2.x : x0;
+  x1 = p2.x > x1 ? p2.x : x1;
+  y0 = p2.y < y0 ? p2.y : y0;
+  y1 = p2.y > y1 ? p2.y : y1;
+  // First and last centre (SUBPIXEL_ONE * x + SUBPIXEL_ONE / 2) inside.
+  min->x = (x0 + SUBPIXEL_ONE / 2 - 1) >> SUBPIXEL_BITS;
+  min->y = (y0 + SUBPIXEL_ONE / 2 - 1) >> SUBPIXEL_BITS;
+  max->x = (x1 - SUBPIXEL_ONE / 2) >> SUBPIXEL_BITS;
+  max->y = (y1 - SUBPIXEL_ONE / 2) >> SUBPIXEL_BITS;
+  return min->x <= max->x && min->y <= max->y;
 }
 
 void draw_textured_triangle(u32 *buffer, float *depth, int w, int h, Texture *tex,
                             VertexPC v0, VertexPC v1, VertexPC v2) {
-  // Bounding box
-  int min_x = fminf(fminf(v0.pos.x, v1.pos.x), v2.pos.x);
-  int max_x = fmaxf(fmaxf(v0.pos.x, v1.pos.x), v2.pos.x);
-  int min_y = fminf(fminf(v0.pos.y, v1.pos.y), v2.pos.y);
-  int max_y = fmaxf(fmaxf(v0.pos.y, v1.pos.y), v2.pos.y);
+  draw_textured_triangle_rect(buffer, depth, NULL, w, h, tex, v0, v1, v2,
+                              (v2i){0, 0}, (v2i){w - 1, h - 1}, NULL);
+}
 
-  if (max_x < 0 || max_y < 0 || min_x >= w || min_y >= h) {
-    return;
+// Interpolated depth can land a few ulps outside the exact plane, so HiZ
+// bounds derived from vertex or corner depths are widened by this much.
+#define HIZ_EPSILON 1e-5f
+
+// Rows of one HIZ_BLOCK tall band of the bounding box: each row's covered
+// span [lo, hi] (relative to min_x) and its edge values at min_x.
+typedef struct {
+  int y;
+  int rows;
+  int min_x;
+  int lo[HIZ_BLOCK];
+  int hi[HIZ_BLOCK];
+  long long e[HIZ_BLOCK][3];
+} SpanBand;
+
+// Per-triangle terms for picking mip levels: the x and y gradients of
+// u/w, v/w and 1/w per unit of edge value. The level only depends on their
+// ratios, so the edge values needn't be scaled.
+typedef struct {
+  const Texture *tex;
+  float uw[3], vw[3], qw[3];
+  float ux, uy, vx, vy, qx, qy;
+  long long dx[3], dy[3]; // edge steps
+} MipSelect;
+
+// Large triangles pick a level per MIP_BLOCK square of pixels. Bands, bin
+// tiles and HiZ blocks are aligned to it too, so a pixel's level doesn't
+// depend on how the triangle was split up.
+#define MIP_BLOCK HIZ_BLOCK
+
+static void setup_level(SpanSetup *setup, const Texture *tex, int level) {
+  int w = tex->w >> level > 1 ? tex->w >> level : 1;
+  int h = tex->h >> level > 1 ? tex->h >> level : 1;
+  setup->texels = level == 0 ? tex->pixels : tex->levels[level];
+  setup->tiled = tex->layout == TEXTURE_TILED;
+  int stride = w;
+  if (tex->stride != 0) {
+    stride = tex->stride >> level > 1 ? tex->stride >> level : 1;
   }
+  int blocks_x = (stride + TEXTURE_TILE - 1) / TEXTURE_TILE;
+  setup->tex_pitch =
+      setup->tiled ? blocks_x * TEXTURE_TILE * TEXTURE_TILE : stride;
+  setup->tex_w = (float)(setup->repeat ? w : w - 1);
+  setup->tex_h = (float)(setup->repeat ? h : h - 1);
+  setup->tex_max_x = (float)(w - 1);
+  setup->tex_max_y = (float)(h - 1);
+  setup->tex_bias_x = setup->repeat ? (float)w - 0.5f : 0.0f;
+  setup->tex_bias_y = setup->repeat ? (float)h - 0.5f : 0.0f;
+}
 
-  if (min_x < 0)
-    min_x = 0;
-  if (min_y < 0)
-    min_y = 0;
-  if (max_x >= w)
-    max_x = w - 1;
-  if (max_y >= h)
-    max_y = h - 1;
+// Level whose texels come closest to one per pixel at the pixel with edge
+// values e: log2 of the larger of the texel footprints along x and y.
+static int mip_level(const MipSelect *mip, const long long e[3]) {
+  float f[3] = {(float)e[0], (float)e[1], (float)e[2]};
+  float q = f[0] * mip->qw[0] + f[1] * mip->qw[1] + f[2] * mip->qw[2];
+  if (!(q > 0.0f)) {
+    return 0;
+  }
+  float inv_q = 1.0f / q;
+  float u = (f[0] * mip->uw[0] + f[1] * mip->uw[1] + f[2] * mip->uw[2]) * inv_q;
+  float v = (f[0] * mip->vw[0] + f[1] * mip->vw[1] + f[2] * mip->vw[2]) * inv_q;
+  float tw = (float)mip->tex->w * inv_q;
+  float th = (float)mip->tex->h * inv_q;
+  float dudx = (mip->ux - u * mip->qx) * tw;
+  float dvdx = (mip->vx - v * mip->qx) * th;
+  float dudy = (mip->uy - u * mip->qy) * tw;
+  float dvdy = (mip->vy - v * mip->qy) * th;
+  float rho2 = fmaxf(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+  if (!(rho2 >= 4.0f)) {
+    return 0;
+  }
+  // Half the exponent of rho^2: floor(log2(rho)), rho2 being normal here.
+  u32 bits;
+  memcpy(&bits, &rho2, sizeof(bits));
+  int level = (int)((bits >> 23) - 127) / 2;
+  int last = mip->tex->level_count - 1;
+  return level < last ? level : last;
+}
 
-  float area = edge_func(v0.pos, v1.pos, (float)v2.pos.x, (float)v2.pos.y);
-  if (area == 0.0f) {
-    return;
+// True when no pixel of the triangle can need more than level 0. The
+// derivatives' numerators are linear in the edge values and 1/w is smallest
+// at a vertex, so bounding them at the vertices bounds every covered pixel.
+// The margin absorbs the rounding of the per-pixel estimate.
+static bool mip_magnified(const MipSelect *mip, long long area) {
+  float q_min = fminf(fminf(mip->qw[0], mip->qw[1]), mip->qw[2]);
+  if (!(q_min > 0.0f)) {
+    return false;
   }
-  float inv_area = 1.0f / area;
+  float dx = 0.0f, dy = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    float ux = fabsf(mip->ux * mip->qw[i] - mip->uw[i] * mip->qx);
+    float vx = fabsf(mip->vx * mip->qw[i] - mip->vw[i] * mip->qx);
+    float uy = fabsf(mip->uy * mip->qw[i] - mip->uw[i] * mip->qy);
+    float vy = fabsf(mip->vy * mip->qw[i] - mip->vw[i] * mip->qy);
+    dx = fmaxf(dx, fmaxf(ux * (float)mip->tex->w, vx * (float)mip->tex->h));
+    dy = fmaxf(dy, fmaxf(uy * (float)mip->tex->w, vy * (float)mip->tex->h));
+  }
+  float scale = 1.0f / (q_min * q_min * (float)area);
+  dx *= scale;
+  dy *= scale;
+  return 2.0f * fmaxf(dx * dx, dy * dy) < 3.0f;
+}
 
-  for (int y = min_y; y <= max_y; y++) {
-    for (int x = min_x; x <= max_x; x++) {
-      float px = (float)x + 0.5f;
-      float py = (float)y + 0.5f;
-      float w0 = edge_func(v1.pos, v2.pos, px, py) * inv_area;
-      float w1 = edge_func(v2.pos, v0.pos, px, py) * inv_area;
-      float w2 = edge_func(v0.pos, v1.pos, px, py) * inv_area;
+// Shades the covered pixels of columns [x0, x1] in every row of the band.
+static void shade_rows(SpanFn shade, const SpanSetup *setup, u32 *buffer,
+                       float *depth, int w, const SpanBand *band, int x0,
+                       int x1, RasterCounters *counters) {
+  for (int r = 0; r < band->rows; r++) {
+    int lo = band->min_x + band->lo[r] > x0 ? band->lo[r] : x0 - band->min_x;
+    int hi = band->min_x + band->hi[r] < x1 ? band->hi[r] : x1 - band->min_x;
+    if (lo > hi) {
+      continue;
+    }
+    long long a[3];
+    for (int i = 0; i < 3; i++) {
+      a[i] = band->e[r][i] + setup->dx[i] * lo;
+    }
+    size_t row = (size_t)(band->y + r) * (size_t)w;
+    int count = hi - lo + 1;
+    counters->tested += count;
+    counters->written +=
+        shade(setup, buffer + row, depth + row, band->min_x + lo, count, a);
+  }
+}
 
-      if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
-        continue;
+// Level of the block containing column x of the band, taken at the block's
+// centre pixel whether or not the triangle covers it.
+static int block_level(const MipSelect *mip, const SpanBand *band, int x) {
+  int cx = x / MIP_BLOCK * MIP_BLOCK + MIP_BLOCK / 2;
+  int cy = band->y / MIP_BLOCK * MIP_BLOCK + MIP_BLOCK / 2;
+  long long e[3];
+  for (int i = 0; i < 3; i++) {
+    e[i] = band->e[0][i] + mip->dx[i] * (cx - band->min_x) +
+           mip->dy[i] * (cy - band->y);
+  }
+  return mip_level(mip, e);
+}
+
+// As shade_rows, switching the setup's mip level between blocks and keeping
+// neighbouring blocks of the same level in one span.
+static void shade_band(SpanFn shade, SpanSetup *setup, const MipSelect *mip,
+                       u32 *buffer, float *depth, int w, const SpanBand *band,
+                       int x0, int x1, RasterCounters *counters) {
+  if (!mip) {
+    shade_rows(shade, setup, buffer, depth, w, band, x0, x1, counters);
+    return;
+  }
+  int run_x0 = x0;
+  int run_level = -1;
+  for (int x = x0;; x = (x / MIP_BLOCK + 1) * MIP_BLOCK) {
+    int level = x <= x1 ? block_level(mip, band, x) : -1;
+    if (level != run_level) {
+      if (run_level >= 0) {
+        setup_level(setup, mip->tex, run_level);
+        shade_rows(shade, setup, buffer, depth, w, band, run_x0, x - 1,
+                   counters);
       }
+      run_level = level;
+      run_x0 = x;
+    }
+    if (x > x1) {
+      return;
+    }
+  }
+}
 
-      float inv_w_interp = w0 * v0.inv_w + w1 * v1.inv_w + w2 * v2.inv_w;
-      if (inv_w_interp == 0.0f) {
-        continue;
+// Covered pixels of columns [x0, x1] over the whole band.
+static int band_coverage(const SpanBand *band, int x0, int x1) {
+  int total = 0;
+  for (int r = 0; r < band->rows; r++) {
+    int lo = band->min_x + band->lo[r];
+    int hi = band->min_x + band->hi[r];
+    lo = lo > x0 ? lo : x0;
+    hi = hi < x1 ? hi : x1;
+    if (lo <= hi) {
+      total += hi - lo + 1;
+    }
+  }
+  return total;
+}
+
+// Depth of the triangle's plane at column x of band row r, computed exactly
+// like the span shaders do.
+static float band_depth(const SpanSetup *setup, const SpanBand *band, int r,
+                        int x) {
+  float z = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    long long e = band->e[r][i] + setup->dx[i] * (x - band->min_x);
+    z += (float)e * setup->scale * setup->depth[i];
+  }
+  return z;
+}
+
+enum { BLOCK_SKIP, BLOCK_TEST, BLOCK_NO_TEST };
+
+// Classifies each HiZ block the band touches: blocks the triangle is entirely
+// behind are skipped, fully covered blocks it is entirely in front of are
+// drawn without depth tests. Neighbouring blocks of the same kind are shaded
+// as one span so the SIMD paths keep long runs.
+static void shade_band_hiz(SpanFn shade, SpanSetup *setup,
+                           const MipSelect *mip, u32 *buffer, float *depth,
+                           HiZ *hiz, int w, int h, const SpanBand *band,
+                           int max_x, float tri_zmin, bool accept_ok,
+                           RasterCounters *counters) {
+  int by = band->y / HIZ_BLOCK;
+  int block_y0 = by * HIZ_BLOCK;
+  int block_rows = (block_y0 + HIZ_BLOCK > h) ? h - block_y0 : HIZ_BLOCK;
+  bool full_height = band->y == block_y0 && band->rows == block_rows;
+
+  int run_kind = BLOCK_SKIP;
+  int run_x0 = 0;
+  int bx1 = max_x / HIZ_BLOCK;
+  for (int bx = band->min_x / HIZ_BLOCK; bx <= bx1 + 1; bx++) {
+    int x0 = bx * HIZ_BLOCK;
+    int kind = BLOCK_SKIP;
+    if (bx <= bx1) {
+      int x1 = (x0 + HIZ_BLOCK > w) ? w - 1 : x0 + HIZ_BLOCK - 1;
+      HiZBlock *block = &hiz->blocks[by * hiz->bw + bx];
+      bool touched = false;
+      bool covered = accept_ok && full_height;
+      for (int r = 0; r < band->rows; r++) {
+        int lo = band->min_x + band->lo[r];
+        int hi = band->min_x + band->hi[r];
+        touched = touched || (lo <= hi && lo <= x1 && hi >= x0);
+        covered = covered && lo <= x0 && hi >= x1;
       }
 
-      float u_over_w =
-          w0 * (v0.uv.x * v0.inv_w) + w1 * (v1.uv.x * v1.inv_w) + w2 * (v2.uv.x * v2.inv_w);
-      float v_over_w =
-          w0 * (v0.uv.y * v0.inv_w) + w1 * (v1.uv.y * v1.inv_w) + w2 * (v2.uv.y * v2.inv_w);
-      float u = u_over_w / inv_w_interp;
-      float v = v_over_w / inv_w_interp;
+      if (touched && tri_zmin >= block->zmax) {
+        // Hidden: its covered pixels all count as depth-rejected.
+        int rejected = band_coverage(band, x0, x1);
+        counters->tested += rejected;
+        counters->hiz_rejected += rejected;
+      } else if (touched) {
+        kind = BLOCK_TEST;
+        if (covered) {
+          // The plane's extremes over the block lie on its corners.
+          int last = band->rows - 1;
+          float z00 = band_depth(setup, band, 0, x0);
+          float z01 = band_depth(setup, band, 0, x1);
+          float z10 = band_depth(setup, band, last, x0);
+          float z11 = band_depth(setup, band, last, x1);
+          float zmin =
+              fminf(fminf(z00, z01), fminf(z10, z11)) - HIZ_EPSILON;
+          float zmax =
+              fmaxf(fmaxf(z00, z01), fmaxf(z10, z11)) + HIZ_EPSILON;
+          if (zmax < block->zmin) {
+            kind = BLOCK_NO_TEST;
+          }
+          // Every pixel ends up at or below the triangle's depth.
+          if (zmax < block->zmax) {
+            block->zmax = zmax;
+          }
+          if (zmin < block->zmin) {
+            block->zmin = zmin;
+          }
+        } else if (tri_zmin < block->zmin) {
+          block->zmin = tri_zmin;
+        }
+      }
+    }
 
-      float depth_interp = w0 * v0.depth + w1 * v1.depth + w2 * v2.depth;
-      int idx = y * w + x;
-      if (depth_interp >= depth[idx]) {
-        continue;
+    if (kind != run_kind) {
+      if (run_kind != BLOCK_SKIP) {
+        setup->depth_test = run_kind == BLOCK_TEST;
+        shade_band(shade, setup, mip, buffer, depth, w, band, run_x0, x0 - 1,
+                   counters);
       }
-      depth[idx] = depth_interp;
-
-      if (u < 0.0f)
-        u = 0.0f;
-      if (u > 1.0f)
-        u = 1.0f;
-      if (v < 0.0f)
-        v = 0.0f;
-      if (v > 1.0f)
-        v = 1.0f;
-
-      int tx = (int)(u * (float)(tex->w - 1));
-      int ty = (int)(v * (float)(tex->h - 1));
-      u32 sample = tex->pixels[ty * tex->w + tx];
-      set_pixel(buffer, w, (v2i){x, y}, sample);
+      run_kind = kind;
+      run_x0 = x0;
+    }
+  }
+  setup->depth_test = true;
+}
+
+void draw_textured_triangle_rect(u32 *buffer, float *depth, HiZ *hiz, int w,
+                                 int h, Texture *tex, VertexPC v0, VertexPC v1,
+                                 VertexPC v2, v2i clip_min, v2i clip_max,
+                                 RasterCounters *counters) {
+  v2i box_min, box_max;
+  if (!triangle_pixel_bounds(v0.pos, v1.pos, v2.pos, &box_min, &box_max)) {
+    return;
+  }
+  int min_x = box_min.x, max_x = box_max.x;
+  int min_y = box_min.y, max_y = box_max.y;
+
+  if (clip_min.x < 0)
+    clip_min.x = 0;
+  if (clip_min.y < 0)
+    clip_min.y = 0;
+  if (clip_max.x >= w)
+    clip_max.x = w - 1;
+  if (clip_max.y >= h)
+    clip_max.y = h - 1;
+
+  if (max_x < clip_min.x || max_y < clip_min.y || min_x > clip_max.x ||
+      min_y > clip_max.y) {
+    return;
+  }
+
+  if (min_x < clip_min.x)
+    min_x = clip_min.x;
+  if (min_y < clip_min.y)
+    min_y = clip_min.y;
+  if (max_x > clip_max.x)
+    max_x = clip_max.x;
+  if (max_y > clip_max.y)
+    max_y = clip_max.y;
+
+  // Twice the signed area, in the same units as the edge values; the three
+  // edge values always sum to it.
+  long long area =
+      ((long long)v2.pos.y - v0.pos.y) * ((long long)v1.pos.x - v0.pos.x) -
+      ((long long)v2.pos.x - v0.pos.x) * ((long long)v1.pos.y - v0.pos.y);
+  if (area == 0) {
+    return;
+  }
+  float inv_area = 1.0f / (float)area;
+
+  // Flip the edges of clockwise triangles so "inside" is always e >= 0; the
+  // weights then use |inv_area|, which gives the same products bit for bit.
+  int sign = (area < 0) ? -1 : 1;
+  EdgeStep e0 = edge_setup(v1.pos, v2.pos, min_x, min_y, sign);
+  EdgeStep e1 = edge_setup(v2.pos, v0.pos, min_x, min_y, sign);
+  EdgeStep e2 = edge_setup(v0.pos, v1.pos, min_x, min_y, sign);
+
+  // Per-vertex perspective attributes, hoisted out of the pixel loop.
+  bool repeat = tex->wrap == TEXTURE_REPEAT;
+  SpanSetup setup = {
+      .dx = {e0.dx, e1.dx, e2.dx},
+      .scale = fabsf(inv_area),
+      .inv_w = {v0.inv_w, v1.inv_w, v2.inv_w},
+      .depth = {v0.depth, v1.depth, v2.depth},
+      .uw = {v0.uv.x * v0.inv_w, v1.uv.x * v1.inv_w, v2.uv.x * v2.inv_w},
+      .vw = {v0.uv.y * v0.inv_w, v1.uv.y * v1.inv_w, v2.uv.y * v2.inv_w},
+      .repeat = repeat,
+      .bilinear = tex->filter == TEXTURE_BILINEAR,
+      .depth_test = true,
+  };
+  setup_level(&setup, tex, 0);
+  SpanFn shade = span_shader();
+
+  MipSelect mip_select;
+  const MipSelect *mip = NULL;
+  if (tex->level_count > 1) {
+    mip_select = (MipSelect){
+        .tex = tex,
+        .uw = {setup.uw[0], setup.uw[1], setup.uw[2]},
+        .vw = {setup.vw[0], setup.vw[1], setup.vw[2]},
+        .qw = {v0.inv_w, v1.inv_w, v2.inv_w},
+        .dx = {e0.dx, e1.dx, e2.dx},
+        .dy = {e0.dy, e1.dy, e2.dy},
+    };
+    for (int i = 0; i < 3; i++) {
+      float dx = (float)mip_select.dx[i];
+      float dy = (float)mip_select.dy[i];
+      mip_select.ux += dx * mip_select.uw[i];
+      mip_select.uy += dy * mip_select.uw[i];
+      mip_select.vx += dx * mip_select.vw[i];
+      mip_select.vy += dy * mip_select.vw[i];
+      mip_select.qx += dx * mip_select.qw[i];
+      mip_select.qy += dy * mip_select.qw[i];
+    }
+    long long abs_area = area < 0 ? -area : area;
+    if (box_max.x - box_min.x < 2 * MIP_BLOCK &&
+        box_max.y - box_min.y < 2 * MIP_BLOCK) {
+      // Small triangles barely change scale across their pixels: use the
+      // level at the centroid, from the whole box so every tile agrees.
+      long long third = abs_area / 3;
+      long long centroid[3] = {third, third, third};
+      setup_level(&setup, tex, mip_level(&mip_select, centroid));
+    } else if (!mip_magnified(&mip_select, abs_area)) {
+      mip = &mip_select; // otherwise level 0 throughout
     }
   }
+
+  float tri_zmin = fminf(fminf(v0.depth, v1.depth), v2.depth) - HIZ_EPSILON;
+  // With every 1/w positive no covered pixel is dropped for 1/w == 0, which
+  // HiZ relies on when it treats a block as fully covered.
+  bool accept_ok = v0.inv_w > 0.0f && v1.inv_w > 0.0f && v2.inv_w > 0.0f;
+
+  // Walk the box one block row at a time so HiZ can be consulted per block.
+  RasterCounters counted = {0};
+  SpanBand band = {.min_x = min_x};
+  for (band.y = min_y; band.y <= max_y; band.y += band.rows) {
+    band.rows = (band.y / HIZ_BLOCK + 1) * HIZ_BLOCK - band.y;
+    if (band.y + band.rows > max_y + 1) {
+      band.rows = max_y + 1 - band.y;
+    }
+
+    // Solve for the covered span of each row instead of testing every pixel.
+    bool any = false;
+    for (int r = 0; r < band.rows;
+         r++, e0.row += e0.dy, e1.row += e1.dy, e2.row += e2.dy) {
+      band.lo[r] = 0;
+      band.hi[r] = max_x - min_x;
+      edge_span(e0.row - e0.bias, e0.dx, &band.lo[r], &band.hi[r]);
+      edge_span(e1.row - e1.bias, e1.dx, &band.lo[r], &band.hi[r]);
+      edge_span(e2.row - e2.bias, e2.dx, &band.lo[r], &band.hi[r]);
+      band.e[r][0] = e0.row;
+      band.e[r][1] = e1.row;
+      band.e[r][2] = e2.row;
+      any = any || band.lo[r] <= band.hi[r];
+    }
+    if (!any) {
+      continue;
+    }
+
+    if (hiz) {
+      shade_band_hiz(shade, &setup, mip, buffer, depth, hiz, w, h, &band,
+                     max_x, tri_zmin, accept_ok, &counted);
+    } else {
+      shade_band(shade, &setup, mip, buffer, depth, w, &band, min_x, max_x,
+                 &counted);
+    }
+  }
+
+  if (counters) {
+    counters->tested += counted.tested;
+    counters->written += counted.written;
+    counters->hiz_rejected += counted.hiz_rejected;
+  }
 }
 
 void draw_cirlcei(u32 *buffer, int w, v2i pos, int r, u32 color) {
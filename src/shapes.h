@@ -1,6 +1,8 @@
 #pragma once
 
+#include "hiz.h"
 #include "types.h"
+#include <stdbool.h>
 
 #define WIREFRAME 0
 #define FILLED 1
@@ -10,5 +12,29 @@ void draw_triangle(u32 *buffer, int w, int h, v2i p1, v2i p2, v2i p3, u32 color,
 void draw_triangle_dots(u32 *buffer, int w, int h, v2i p1, v2i p2, v2i p3,
                         u32 color, u32 mode);
 void draw_cirlcei(u32 *buffer, int w, v2i pos, int r, u32 color);
+// Pixel work done by the textured rasterizer. tested counts every covered
+// pixel inside the clip rectangle, including the ones HiZ rejected a block at
+// a time; tested - written were depth-rejected.
+typedef struct {
+  long long tested;
+  long long written;
+  long long hiz_rejected;
+} RasterCounters;
+
+// Inclusive range of pixels whose centres lie in the bounding box of three
+// fixed-point positions. False when the box falls between centres, so the
+// triangle can't cover any pixel.
+bool triangle_pixel_bounds(v2i p0, v2i p1, v2i p2, v2i *min, v2i *max);
+// Fills the pixels whose centres the triangle covers, with the top-left rule
+// deciding centres exactly on an edge: triangles sharing an edge never both
+// draw a pixel, nor leave a gap.
 void draw_textured_triangle(u32 *buffer, float *depth, int w, int h, Texture *tex,
                             VertexPC v0, VertexPC v1, VertexPC v2);
+// Same as draw_textured_triangle, but only touches pixels inside the
+// inclusive rectangle [clip_min, clip_max]. A non-NULL hiz mirroring `depth`
+// is used to skip hidden blocks and is kept up to date. A non-NULL counters
+// is added to.
+void draw_textured_triangle_rect(u32 *buffer, float *depth, HiZ *hiz, int w,
+                                 int h, Texture *tex, VertexPC v0, VertexPC v1,
+                                 VertexPC v2, v2i clip_min, v2i clip_max,
+                                 RasterCounters *counters);
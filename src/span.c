@@ -0,0 +1,662 @@
+#include "span.h"
+#include <SDL2/SDL.h>
+#include <limits.h>
+#include <stdbool.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    (defined(__x86_64__) || defined(__i386__))
+#define SPAN_X86 1
+#include <immintrin.h>
+#else
+#define SPAN_X86 0
+#endif
+
+// Fractional part for TEXTURE_REPEAT, floor built from truncation so SSE2
+// (which has no floor instruction) can repeat it exactly.
+static inline float wrap_coord(float t) {
+  float whole = (float)(int)t;
+  return t - (whole > t ? whole - 1.0f : whole);
+}
+
+// Offset of texel (tx, ty) in the level being sampled. Tiled levels store
+// rows of 4x4 blocks (TEXTURE_TILE), each block row by row.
+static inline int texel_index(const SpanSetup *s, int tx, int ty) {
+  if (s->tiled) {
+    return (ty >> 2) * s->tex_pitch + ((tx >> 2) << 4) + ((ty & 3) << 2) +
+           (tx & 3);
+  }
+  return ty * s->tex_pitch + tx;
+}
+
+// Blends two ARGB8888 texels by an 8-bit weight f of b: each channel is
+// (a * (256 - f) + b * f) >> 8. Red/blue and alpha/green each share one
+// multiply, the byte between them taking the carries; the vector paths do the
+// same sums in 16-bit lanes.
+static inline u32 lerp_texel(u32 a, u32 b, u32 f) {
+  u32 rb = ((a & 0xFF00FFu) * (256 - f) + (b & 0xFF00FFu) * f) >> 8;
+  u32 ag = ((a >> 8) & 0xFF00FFu) * (256 - f) + ((b >> 8) & 0xFF00FFu) * f;
+  return (rb & 0xFF00FFu) | (ag & 0xFF00FF00u);
+}
+
+// One axis of a bilinear sample. t is the biased texel coordinate (>= 0),
+// split into the texel at or before it, the one after and the 8-bit weight of
+// the second. A repeated texture's bias can push t one image further.
+static inline int bilinear_axis(float t, int max, bool repeat, int *next,
+                                int *weight) {
+  int fixed = (int)(t * 256.0f);
+  int i = fixed >> 8;
+  if (i > max) {
+    i -= max + 1;
+  }
+  *next = i < max ? i + 1 : (repeat ? 0 : max);
+  *weight = fixed & 255;
+  return i;
+}
+
+static u32 sample_bilinear(const SpanSetup *s, float u, float v) {
+  if (s->repeat) {
+    u = wrap_coord(u);
+    v = wrap_coord(v);
+  } else {
+    if (u < 0.0f)
+      u = 0.0f;
+    if (u > 1.0f)
+      u = 1.0f;
+    if (v < 0.0f)
+      v = 0.0f;
+    if (v > 1.0f)
+      v = 1.0f;
+  }
+  int x1, y1, wx, wy;
+  int x0 = bilinear_axis(u * s->tex_w + s->tex_bias_x, (int)s->tex_max_x,
+                         s->repeat, &x1, &wx);
+  int y0 = bilinear_axis(v * s->tex_h + s->tex_bias_y, (int)s->tex_max_y,
+                         s->repeat, &y1, &wy);
+  u32 top = lerp_texel(s->texels[texel_index(s, x0, y0)],
+                       s->texels[texel_index(s, x1, y0)], (u32)wx);
+  u32 bottom = lerp_texel(s->texels[texel_index(s, x0, y1)],
+                          s->texels[texel_index(s, x1, y1)], (u32)wx);
+  return lerp_texel(top, bottom, (u32)wy);
+}
+
+// All SIMD paths evaluate the same float operations in the same order as the
+// scalar loop, so every path writes identical pixels.
+static int span_scalar(const SpanSetup *s, u32 *color_row, float *depth_row,
+                       int x, int count, const long long a[3]) {
+  long long a0 = a[0], a1 = a[1], a2 = a[2];
+  int written = 0;
+  for (int end = x + count; x < end;
+       x++, a0 += s->dx[0], a1 += s->dx[1], a2 += s->dx[2]) {
+    float w0 = (float)a0 * s->scale;
+    float w1 = (float)a1 * s->scale;
+    float w2 = (float)a2 * s->scale;
+
+    float inv_w_interp =
+        w0 * s->inv_w[0] + w1 * s->inv_w[1] + w2 * s->inv_w[2];
+    if (inv_w_interp == 0.0f) {
+      continue;
+    }
+
+    float depth_interp =
+        w0 * s->depth[0] + w1 * s->depth[1] + w2 * s->depth[2];
+    if (s->depth_test && depth_interp >= depth_row[x]) {
+      continue;
+    }
+    depth_row[x] = depth_interp;
+
+    float u = (w0 * s->uw[0] + w1 * s->uw[1] + w2 * s->uw[2]) / inv_w_interp;
+    float v = (w0 * s->vw[0] + w1 * s->vw[1] + w2 * s->vw[2]) / inv_w_interp;
+    written++;
+    if (s->bilinear) {
+      color_row[x] = sample_bilinear(s, u, v);
+      continue;
+    }
+
+    int tx, ty;
+    if (s->repeat) {
+      // The fraction can round up to 1, so cap the texel like the clamp does.
+      float fx = wrap_coord(u) * s->tex_w;
+      float fy = wrap_coord(v) * s->tex_h;
+      tx = (int)(fx < s->tex_max_x ? fx : s->tex_max_x);
+      ty = (int)(fy < s->tex_max_y ? fy : s->tex_max_y);
+    } else {
+      if (u < 0.0f)
+        u = 0.0f;
+      if (u > 1.0f)
+        u = 1.0f;
+      if (v < 0.0f)
+        v = 0.0f;
+      if (v > 1.0f)
+        v = 1.0f;
+      tx = (int)(u * s->tex_w);
+      ty = (int)(v * s->tex_h);
+    }
+    color_row[x] = s->texels[texel_index(s, tx, ty)];
+  }
+  return written;
+}
+
+#if SPAN_X86
+__attribute__((target("sse2"))) static inline __m128
+wrap_coord_sse2(__m128 t) {
+  __m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+  __m128 below = _mm_and_ps(_mm_cmpgt_ps(whole, t), _mm_set1_ps(1.0f));
+  return _mm_sub_ps(t, _mm_sub_ps(whole, below));
+}
+
+__attribute__((target("avx2"))) static inline __m256
+wrap_coord_avx2(__m256 t) {
+  __m256 whole = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(t));
+  __m256 below = _mm256_and_ps(_mm256_cmp_ps(whole, t, _CMP_GT_OQ),
+                               _mm256_set1_ps(1.0f));
+  return _mm256_sub_ps(t, _mm256_sub_ps(whole, below));
+}
+
+// Vector bilinear_axis for four lanes; max is w - 1 (or h - 1) and edge the
+// texel after the last one, 0 repeated or max clamped.
+__attribute__((target("sse2"))) static inline __m128i
+bilinear_axis_sse2(__m128 t, __m128i max, __m128i edge, __m128i *next,
+                   __m128i *weight) {
+  __m128i fixed = _mm_cvttps_epi32(_mm_mul_ps(t, _mm_set1_ps(256.0f)));
+  __m128i i = _mm_srli_epi32(fixed, 8);
+  __m128i size = _mm_add_epi32(max, _mm_set1_epi32(1));
+  i = _mm_sub_epi32(i, _mm_and_si128(_mm_cmpgt_epi32(i, max), size));
+  __m128i after = _mm_add_epi32(i, _mm_set1_epi32(1));
+  __m128i over = _mm_cmpgt_epi32(after, max);
+  *next =
+      _mm_or_si128(_mm_andnot_si128(over, after), _mm_and_si128(over, edge));
+  *weight = _mm_and_si128(fixed, _mm_set1_epi32(255));
+  return i;
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+bilinear_axis_avx2(__m256 t, __m256i max, __m256i edge, __m256i *next,
+                   __m256i *weight) {
+  __m256i fixed = _mm256_cvttps_epi32(_mm256_mul_ps(t, _mm256_set1_ps(256.0f)));
+  __m256i i = _mm256_srli_epi32(fixed, 8);
+  __m256i size = _mm256_add_epi32(max, _mm256_set1_epi32(1));
+  i = _mm256_sub_epi32(i, _mm256_and_si256(_mm256_cmpgt_epi32(i, max), size));
+  __m256i after = _mm256_add_epi32(i, _mm256_set1_epi32(1));
+  __m256i over = _mm256_cmpgt_epi32(after, max);
+  *next = _mm256_blendv_epi8(after, edge, over);
+  *weight = _mm256_and_si256(fixed, _mm256_set1_epi32(255));
+  return i;
+}
+
+// lerp_texel on channels widened to 16-bit lanes, f repeated per channel.
+__attribute__((target("sse2"))) static inline __m128i
+lerp16_sse2(__m128i a, __m128i b, __m128i f) {
+  __m128i g = _mm_sub_epi16(_mm_set1_epi16(256), f);
+  return _mm_srli_epi16(
+      _mm_add_epi16(_mm_mullo_epi16(a, g), _mm_mullo_epi16(b, f)), 8);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+lerp16_avx2(__m256i a, __m256i b, __m256i f) {
+  __m256i g = _mm256_sub_epi16(_mm256_set1_epi16(256), f);
+  return _mm256_srli_epi16(
+      _mm256_add_epi16(_mm256_mullo_epi16(a, g), _mm256_mullo_epi16(b, f)),
+      8);
+}
+
+// Blends four texels per lane (t<x><y>) by 32-bit weights. Unpacking to
+// 16 bits takes pixels 0-1 to lo and 2-3 to hi (per 128-bit half on AVX2),
+// so the weights are spread the same way and packing back restores the order.
+__attribute__((target("sse2"))) static inline __m128i
+bilinear_blend_sse2(__m128i t00, __m128i t10, __m128i t01, __m128i t11,
+                    __m128i wx, __m128i wy) {
+  const __m128i zero = _mm_setzero_si128();
+  wx = _mm_or_si128(wx, _mm_slli_epi32(wx, 16));
+  wy = _mm_or_si128(wy, _mm_slli_epi32(wy, 16));
+  __m128i wx_lo = _mm_unpacklo_epi32(wx, wx);
+  __m128i wx_hi = _mm_unpackhi_epi32(wx, wx);
+  __m128i wy_lo = _mm_unpacklo_epi32(wy, wy);
+  __m128i wy_hi = _mm_unpackhi_epi32(wy, wy);
+  __m128i top_lo = lerp16_sse2(_mm_unpacklo_epi8(t00, zero),
+                               _mm_unpacklo_epi8(t10, zero), wx_lo);
+  __m128i top_hi = lerp16_sse2(_mm_unpackhi_epi8(t00, zero),
+                               _mm_unpackhi_epi8(t10, zero), wx_hi);
+  __m128i bottom_lo = lerp16_sse2(_mm_unpacklo_epi8(t01, zero),
+                                  _mm_unpacklo_epi8(t11, zero), wx_lo);
+  __m128i bottom_hi = lerp16_sse2(_mm_unpackhi_epi8(t01, zero),
+                                  _mm_unpackhi_epi8(t11, zero), wx_hi);
+  return _mm_packus_epi16(lerp16_sse2(top_lo, bottom_lo, wy_lo),
+                          lerp16_sse2(top_hi, bottom_hi, wy_hi));
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+bilinear_blend_avx2(__m256i t00, __m256i t10, __m256i t01, __m256i t11,
+                    __m256i wx, __m256i wy) {
+  const __m256i zero = _mm256_setzero_si256();
+  wx = _mm256_or_si256(wx, _mm256_slli_epi32(wx, 16));
+  wy = _mm256_or_si256(wy, _mm256_slli_epi32(wy, 16));
+  __m256i wx_lo = _mm256_unpacklo_epi32(wx, wx);
+  __m256i wx_hi = _mm256_unpackhi_epi32(wx, wx);
+  __m256i wy_lo = _mm256_unpacklo_epi32(wy, wy);
+  __m256i wy_hi = _mm256_unpackhi_epi32(wy, wy);
+  __m256i top_lo = lerp16_avx2(_mm256_unpacklo_epi8(t00, zero),
+                               _mm256_unpacklo_epi8(t10, zero), wx_lo);
+  __m256i top_hi = lerp16_avx2(_mm256_unpackhi_epi8(t00, zero),
+                               _mm256_unpackhi_epi8(t10, zero), wx_hi);
+  __m256i bottom_lo = lerp16_avx2(_mm256_unpacklo_epi8(t01, zero),
+                                  _mm256_unpacklo_epi8(t11, zero), wx_lo);
+  __m256i bottom_hi = lerp16_avx2(_mm256_unpackhi_epi8(t01, zero),
+                                  _mm256_unpackhi_epi8(t11, zero), wx_hi);
+  return _mm256_packus_epi16(lerp16_avx2(top_lo, bottom_lo, wy_lo),
+                             lerp16_avx2(top_hi, bottom_hi, wy_hi));
+}
+
+// texel_index split into its row and column parts, which simply add up.
+// SSE2 has no 32-bit multiply: the even and odd lanes go through
+// _mm_mul_epu32 separately, exact while the offsets fit 32 bits.
+__attribute__((target("sse2"))) static inline __m128i
+texel_row_sse2(const SpanSetup *s, __m128i ty) {
+  __m128i row = ty;
+  __m128i inner = _mm_setzero_si128();
+  if (s->tiled) {
+    row = _mm_srli_epi32(ty, 2);
+    inner = _mm_slli_epi32(_mm_and_si128(ty, _mm_set1_epi32(3)), 2);
+  }
+  __m128i pitch = _mm_set1_epi32(s->tex_pitch);
+  __m128i even = _mm_mul_epu32(row, pitch);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(row, 32), pitch);
+  __m128i product = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, 0x08),
+                                       _mm_shuffle_epi32(odd, 0x08));
+  return _mm_add_epi32(product, inner);
+}
+
+__attribute__((target("sse2"))) static inline __m128i
+texel_col_sse2(const SpanSetup *s, __m128i tx) {
+  if (s->tiled) {
+    return _mm_add_epi32(_mm_slli_epi32(_mm_srli_epi32(tx, 2), 4),
+                         _mm_and_si128(tx, _mm_set1_epi32(3)));
+  }
+  return tx;
+}
+
+// Bilinear samples for the lanes set in bits, written straight to color.
+// SSE2 has no gather, so the texels are fetched one by one.
+__attribute__((target("sse2"))) static void
+bilinear_sse2(const SpanSetup *s, __m128 u, __m128 v, int bits, u32 *color) {
+  if (s->repeat) {
+    u = wrap_coord_sse2(u);
+    v = wrap_coord_sse2(v);
+  } else {
+    u = _mm_min_ps(_mm_max_ps(u, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  }
+  __m128i max_x = _mm_set1_epi32((int)s->tex_max_x);
+  __m128i max_y = _mm_set1_epi32((int)s->tex_max_y);
+  __m128i x1, y1, wx, wy;
+  __m128i x0 = bilinear_axis_sse2(
+      _mm_add_ps(_mm_mul_ps(u, _mm_set1_ps(s->tex_w)),
+                 _mm_set1_ps(s->tex_bias_x)),
+      max_x, s->repeat ? _mm_setzero_si128() : max_x, &x1, &wx);
+  __m128i y0 = bilinear_axis_sse2(
+      _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(s->tex_h)),
+                 _mm_set1_ps(s->tex_bias_y)),
+      max_y, s->repeat ? _mm_setzero_si128() : max_y, &y1, &wy);
+
+  __m128i col0 = texel_col_sse2(s, x0), col1 = texel_col_sse2(s, x1);
+  __m128i row0 = texel_row_sse2(s, y0), row1 = texel_row_sse2(s, y1);
+  int index[4][4]; // 00, 10, 01, 11
+  _mm_storeu_si128((__m128i *)index[0], _mm_add_epi32(row0, col0));
+  _mm_storeu_si128((__m128i *)index[1], _mm_add_epi32(row0, col1));
+  _mm_storeu_si128((__m128i *)index[2], _mm_add_epi32(row1, col0));
+  _mm_storeu_si128((__m128i *)index[3], _mm_add_epi32(row1, col1));
+  u32 texel[4][4] = {{0}};
+  for (int k = 0; k < 4; k++) {
+    if (bits & (1 << k)) {
+      for (int j = 0; j < 4; j++) {
+        texel[j][k] = s->texels[index[j][k]];
+      }
+    }
+  }
+  u32 out[4];
+  _mm_storeu_si128(
+      (__m128i *)out,
+      bilinear_blend_sse2(_mm_loadu_si128((const __m128i *)texel[0]),
+                          _mm_loadu_si128((const __m128i *)texel[1]),
+                          _mm_loadu_si128((const __m128i *)texel[2]),
+                          _mm_loadu_si128((const __m128i *)texel[3]), wx, wy));
+  for (int k = 0; k < 4; k++) {
+    if (bits & (1 << k)) {
+      color[k] = out[k];
+    }
+  }
+}
+
+// texel_index split into its row and column parts, which simply add up.
+__attribute__((target("avx2"))) static inline __m256i
+texel_row_avx2(const SpanSetup *s, __m256i ty) {
+  __m256i pitch = _mm256_set1_epi32(s->tex_pitch);
+  if (s->tiled) {
+    return _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_srli_epi32(ty, 2), pitch),
+        _mm256_slli_epi32(_mm256_and_si256(ty, _mm256_set1_epi32(3)), 2));
+  }
+  return _mm256_mullo_epi32(ty, pitch);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+texel_col_avx2(const SpanSetup *s, __m256i tx) {
+  if (s->tiled) {
+    return _mm256_add_epi32(
+        _mm256_slli_epi32(_mm256_srli_epi32(tx, 2), 4),
+        _mm256_and_si256(tx, _mm256_set1_epi32(3)));
+  }
+  return tx;
+}
+
+// Bilinear samples for the lanes set in mask; the others come back as 0.
+__attribute__((target("avx2"))) static inline __m256i
+bilinear_avx2(const SpanSetup *s, __m256 u, __m256 v, __m256i mask) {
+  if (s->repeat) {
+    u = wrap_coord_avx2(u);
+    v = wrap_coord_avx2(v);
+  } else {
+    u = _mm256_min_ps(_mm256_max_ps(u, _mm256_setzero_ps()),
+                      _mm256_set1_ps(1.0f));
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+                      _mm256_set1_ps(1.0f));
+  }
+  __m256i max_x = _mm256_set1_epi32((int)s->tex_max_x);
+  __m256i max_y = _mm256_set1_epi32((int)s->tex_max_y);
+  __m256i x1, y1, wx, wy;
+  __m256i x0 = bilinear_axis_avx2(
+      _mm256_add_ps(_mm256_mul_ps(u, _mm256_set1_ps(s->tex_w)),
+                    _mm256_set1_ps(s->tex_bias_x)),
+      max_x, s->repeat ? _mm256_setzero_si256() : max_x, &x1, &wx);
+  __m256i y0 = bilinear_axis_avx2(
+      _mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(s->tex_h)),
+                    _mm256_set1_ps(s->tex_bias_y)),
+      max_y, s->repeat ? _mm256_setzero_si256() : max_y, &y1, &wy);
+
+  __m256i col0 = texel_col_avx2(s, x0), col1 = texel_col_avx2(s, x1);
+  __m256i row0 = texel_row_avx2(s, y0), row1 = texel_row_avx2(s, y1);
+  const int *texels = (const int *)s->texels;
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i t00 = _mm256_mask_i32gather_epi32(
+      zero, texels, _mm256_add_epi32(row0, col0), mask, 4);
+  __m256i t10 = _mm256_mask_i32gather_epi32(
+      zero, texels, _mm256_add_epi32(row0, col1), mask, 4);
+  __m256i t01 = _mm256_mask_i32gather_epi32(
+      zero, texels, _mm256_add_epi32(row1, col0), mask, 4);
+  __m256i t11 = _mm256_mask_i32gather_epi32(
+      zero, texels, _mm256_add_epi32(row1, col1), mask, 4);
+  return bilinear_blend_avx2(t00, t10, t01, t11, wx, wy);
+}
+
+// The vector paths keep edge values in 32-bit lanes; spans whose values (or a
+// full vector step) would overflow fall back to the scalar loop.
+static bool span_fits_i32(const SpanSetup *s, int count, const long long a[3]) {
+  for (int i = 0; i < 3; i++) {
+    long long last = a[i] + s->dx[i] * count;
+    long long step = s->dx[i] * 8;
+    if (a[i] > INT_MAX || a[i] < INT_MIN || last > INT_MAX || last < INT_MIN ||
+        step > INT_MAX || step < INT_MIN) {
+      return false;
+    }
+  }
+  return true;
+}
+
+__attribute__((target("sse2"))) static int
+span_sse2(const SpanSetup *s, u32 *color_row, float *depth_row, int x,
+          int count, const long long a[3]) {
+  if (count < 4 || !span_fits_i32(s, count, a)) {
+    return span_scalar(s, color_row, depth_row, x, count, a);
+  }
+  int written = 0;
+  __m128i e[3], step[3];
+  for (int i = 0; i < 3; i++) {
+    int dx = (int)s->dx[i];
+    e[i] = _mm_add_epi32(_mm_set1_epi32((int)a[i]),
+                         _mm_setr_epi32(0, dx, 2 * dx, 3 * dx));
+    step[i] = _mm_set1_epi32(4 * dx);
+  }
+  const __m128 scale = _mm_set1_ps(s->scale);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 tex_w = _mm_set1_ps(s->tex_w);
+  const __m128 tex_h = _mm_set1_ps(s->tex_h);
+  const __m128 tex_max_x = _mm_set1_ps(s->tex_max_x);
+  const __m128 tex_max_y = _mm_set1_ps(s->tex_max_y);
+
+  int end = x + count;
+  for (; x + 4 <= end; x += 4) {
+    __m128 w0 = _mm_mul_ps(_mm_cvtepi32_ps(e[0]), scale);
+    __m128 w1 = _mm_mul_ps(_mm_cvtepi32_ps(e[1]), scale);
+    __m128 w2 = _mm_mul_ps(_mm_cvtepi32_ps(e[2]), scale);
+    for (int i = 0; i < 3; i++) {
+      e[i] = _mm_add_epi32(e[i], step[i]);
+    }
+
+    __m128 inv_w = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(s->inv_w[0])),
+                   _mm_mul_ps(w1, _mm_set1_ps(s->inv_w[1]))),
+        _mm_mul_ps(w2, _mm_set1_ps(s->inv_w[2])));
+    __m128 z = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(s->depth[0])),
+                   _mm_mul_ps(w1, _mm_set1_ps(s->depth[1]))),
+        _mm_mul_ps(w2, _mm_set1_ps(s->depth[2])));
+    __m128 z_old = _mm_loadu_ps(depth_row + x);
+    // !(z >= z_old) rather than z < z_old, to treat NaN like the scalar loop
+    __m128 mask = _mm_cmpneq_ps(inv_w, zero);
+    if (s->depth_test) {
+      mask = _mm_and_ps(mask, _mm_cmpnge_ps(z, z_old));
+    }
+    int bits = _mm_movemask_ps(mask);
+    if (bits == 0) {
+      continue;
+    }
+    written += __builtin_popcount(bits);
+    _mm_storeu_ps(depth_row + x,
+                  _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, z_old)));
+
+    __m128 u = _mm_div_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(s->uw[0])),
+                              _mm_mul_ps(w1, _mm_set1_ps(s->uw[1]))),
+                   _mm_mul_ps(w2, _mm_set1_ps(s->uw[2]))),
+        inv_w);
+    __m128 v = _mm_div_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(s->vw[0])),
+                              _mm_mul_ps(w1, _mm_set1_ps(s->vw[1]))),
+                   _mm_mul_ps(w2, _mm_set1_ps(s->vw[2]))),
+        inv_w);
+    if (s->bilinear) {
+      bilinear_sse2(s, u, v, bits, color_row + x);
+      continue;
+    }
+    __m128 fx, fy;
+    if (s->repeat) {
+      fx = _mm_min_ps(_mm_mul_ps(wrap_coord_sse2(u), tex_w), tex_max_x);
+      fy = _mm_min_ps(_mm_mul_ps(wrap_coord_sse2(v), tex_h), tex_max_y);
+    } else {
+      fx = _mm_mul_ps(_mm_min_ps(_mm_max_ps(u, zero), one), tex_w);
+      fy = _mm_mul_ps(_mm_min_ps(_mm_max_ps(v, zero), one), tex_h);
+    }
+
+    int tx[4], ty[4];
+    _mm_storeu_si128((__m128i *)tx, _mm_cvttps_epi32(fx));
+    _mm_storeu_si128((__m128i *)ty, _mm_cvttps_epi32(fy));
+    for (int k = 0; k < 4; k++) {
+      if (bits & (1 << k)) {
+        color_row[x + k] = s->texels[texel_index(s, tx[k], ty[k])];
+      }
+    }
+  }
+
+  if (x < end) {
+    long long rest[3];
+    for (int i = 0; i < 3; i++) {
+      rest[i] = a[i] + s->dx[i] * (x - (end - count));
+    }
+    written += span_scalar(s, color_row, depth_row, x, end - x, rest);
+  }
+  return written;
+}
+
+__attribute__((target("avx2"))) static int
+span_avx2(const SpanSetup *s, u32 *color_row, float *depth_row, int x,
+          int count, const long long a[3]) {
+  if (count < 8 || !span_fits_i32(s, count, a)) {
+    return span_sse2(s, color_row, depth_row, x, count, a);
+  }
+  int written = 0;
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i e[3], step[3];
+  for (int i = 0; i < 3; i++) {
+    int dx = (int)s->dx[i];
+    e[i] = _mm256_add_epi32(_mm256_set1_epi32((int)a[i]),
+                            _mm256_mullo_epi32(lanes, _mm256_set1_epi32(dx)));
+    step[i] = _mm256_set1_epi32(8 * dx);
+  }
+  const __m256 scale = _mm256_set1_ps(s->scale);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 tex_w = _mm256_set1_ps(s->tex_w);
+  const __m256 tex_h = _mm256_set1_ps(s->tex_h);
+  const __m256 tex_max_x = _mm256_set1_ps(s->tex_max_x);
+  const __m256 tex_max_y = _mm256_set1_ps(s->tex_max_y);
+
+  int end = x + count;
+  for (; x + 8 <= end; x += 8) {
+    __m256 w0 = _mm256_mul_ps(_mm256_cvtepi32_ps(e[0]), scale);
+    __m256 w1 = _mm256_mul_ps(_mm256_cvtepi32_ps(e[1]), scale);
+    __m256 w2 = _mm256_mul_ps(_mm256_cvtepi32_ps(e[2]), scale);
+    for (int i = 0; i < 3; i++) {
+      e[i] = _mm256_add_epi32(e[i], step[i]);
+    }
+
+    __m256 inv_w = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(w0, _mm256_set1_ps(s->inv_w[0])),
+                      _mm256_mul_ps(w1, _mm256_set1_ps(s->inv_w[1]))),
+        _mm256_mul_ps(w2, _mm256_set1_ps(s->inv_w[2])));
+    __m256 z = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(w0, _mm256_set1_ps(s->depth[0])),
+                      _mm256_mul_ps(w1, _mm256_set1_ps(s->depth[1]))),
+        _mm256_mul_ps(w2, _mm256_set1_ps(s->depth[2])));
+    __m256 z_old = _mm256_loadu_ps(depth_row + x);
+    __m256 mask = _mm256_cmp_ps(inv_w, zero, _CMP_NEQ_UQ);
+    if (s->depth_test) {
+      mask = _mm256_and_ps(mask, _mm256_cmp_ps(z, z_old, _CMP_NGE_UQ));
+    }
+    int bits = _mm256_movemask_ps(mask);
+    if (bits == 0) {
+      continue;
+    }
+    written += __builtin_popcount(bits);
+    __m256i imask = _mm256_castps_si256(mask);
+    _mm256_maskstore_ps(depth_row + x, imask, z);
+
+    __m256 u = _mm256_div_ps(
+        _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(w0, _mm256_set1_ps(s->uw[0])),
+                          _mm256_mul_ps(w1, _mm256_set1_ps(s->uw[1]))),
+            _mm256_mul_ps(w2, _mm256_set1_ps(s->uw[2]))),
+        inv_w);
+    __m256 v = _mm256_div_ps(
+        _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(w0, _mm256_set1_ps(s->vw[0])),
+                          _mm256_mul_ps(w1, _mm256_set1_ps(s->vw[1]))),
+            _mm256_mul_ps(w2, _mm256_set1_ps(s->vw[2]))),
+        inv_w);
+    if (s->bilinear) {
+      _mm256_maskstore_epi32((int *)(color_row + x), imask,
+                             bilinear_avx2(s, u, v, imask));
+      continue;
+    }
+    __m256 fx, fy;
+    if (s->repeat) {
+      fx = _mm256_min_ps(_mm256_mul_ps(wrap_coord_avx2(u), tex_w), tex_max_x);
+      fy = _mm256_min_ps(_mm256_mul_ps(wrap_coord_avx2(v), tex_h), tex_max_y);
+    } else {
+      fx = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(u, zero), one), tex_w);
+      fy = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(v, zero), one), tex_h);
+    }
+
+    __m256i tx = _mm256_cvttps_epi32(fx);
+    __m256i ty = _mm256_cvttps_epi32(fy);
+    __m256i index =
+        _mm256_add_epi32(texel_row_avx2(s, ty), texel_col_avx2(s, tx));
+    __m256i texel = _mm256_mask_i32gather_epi32(
+        _mm256_setzero_si256(), (const int *)s->texels, index, imask, 4);
+    _mm256_maskstore_epi32((int *)(color_row + x), imask, texel);
+  }
+
+  if (x < end) {
+    long long rest[3];
+    for (int i = 0; i < 3; i++) {
+      rest[i] = a[i] + s->dx[i] * (x - (end - count));
+    }
+    written += span_sse2(s, color_row, depth_row, x, end - x, rest);
+  }
+  return written;
+}
+#endif
+
+static SpanFn span_table(SpanPath path) {
+  switch (path) {
+#if SPAN_X86
+  case SPAN_SSE2:
+    return span_sse2;
+  case SPAN_AVX2:
+    return span_avx2;
+#endif
+  default:
+    return span_scalar;
+  }
+}
+
+static SDL_atomic_t current_path = {-1};
+
+bool span_path_supported(SpanPath path) {
+  switch (path) {
+  case SPAN_SCALAR:
+    return true;
+#if SPAN_X86
+  case SPAN_SSE2:
+    return SDL_HasSSE2();
+  case SPAN_AVX2:
+    return SDL_HasAVX2();
+#endif
+  default:
+    return false;
+  }
+}
+
+SpanPath span_path(void) {
+  int path = SDL_AtomicGet(&current_path);
+  if (path < 0) {
+    path = SPAN_SCALAR;
+    if (span_path_supported(SPAN_SSE2))
+      path = SPAN_SSE2;
+    if (span_path_supported(SPAN_AVX2))
+      path = SPAN_AVX2;
+    SDL_AtomicCAS(&current_path, -1, path);
+    path = SDL_AtomicGet(&current_path);
+  }
+  return (SpanPath)path;
+}
+
+SpanFn span_shader(void) { return span_table(span_path()); }
+
+bool span_set_path(SpanPath path) {
+  if (!span_path_supported(path)) {
+    return false;
+  }
+  SDL_AtomicSet(&current_path, (int)path);
+  return true;
+}
+
+const char *span_path_name(SpanPath path) {
+  switch (path) {
+  case SPAN_SSE2:
+    return "sse2";
+  case SPAN_AVX2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
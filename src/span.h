@@ -0,0 +1,53 @@
+#pragma once
+
+#include "types.h"
+#include <stdbool.h>
+
+// Per-triangle constants shared by every span of a textured triangle.
+// Edge values are the exact 28.4 fixed-point integers produced by shapes.c
+// and are already oriented so covered pixels have e >= 0.
+typedef struct {
+  long long dx[3]; // edge step for x + 1
+  float scale;     // 1 / |e0 + e1 + e2|, turns an edge value into a weight
+  float inv_w[3];
+  float depth[3];
+  float uw[3]; // u / w per vertex
+  float vw[3]; // v / w per vertex
+  // The mip level being sampled, w x h texels; shapes.c may switch it
+  // between spans.
+  const u32 *texels;
+  int tex_pitch;   // w, or texels per row of blocks when tiled
+  bool tiled;      // TEXTURE_TILED, see texel_index in span.c
+  float tex_w;     // texel scale: w - 1 clamped, w repeated
+  float tex_h;     // h - 1 clamped, h repeated
+  float tex_max_x; // w - 1
+  float tex_max_y; // h - 1
+  // Bilinear only: added to the scaled coordinate before it is split into
+  // texel and weight; w - 0.5 repeated (texel centres, kept positive), 0
+  // clamped.
+  float tex_bias_x;
+  float tex_bias_y;
+  bool repeat;     // tex->wrap == TEXTURE_REPEAT
+  bool bilinear;   // tex->filter == TEXTURE_BILINEAR
+  bool depth_test; // false when every pixel is known to pass
+} SpanSetup;
+
+// Shades `count` covered pixels starting at column x of one row. a[i] are the
+// edge values at that first pixel. Returns how many pixels were written.
+typedef int (*SpanFn)(const SpanSetup *s, u32 *color_row, float *depth_row,
+                      int x, int count, const long long a[3]);
+
+typedef enum {
+  SPAN_SCALAR,
+  SPAN_SSE2,
+  SPAN_AVX2,
+} SpanPath;
+
+// Best path the CPU supports, picked on first use.
+SpanFn span_shader(void);
+SpanPath span_path(void);
+bool span_path_supported(SpanPath path);
+// Overrides the runtime choice (benchmarks, comparisons). Returns false and
+// keeps the current path when the CPU can't run the requested one.
+bool span_set_path(SpanPath path);
+const char *span_path_name(SpanPath path);
@@ -31,10 +31,44 @@ typedef struct {
   v2i p1, p2, p3;
 } Triangle;
 
+// How texture coordinates outside [0, 1] are sampled.
+typedef enum {
+  TEXTURE_CLAMP = 0, // edge texels stretch outwards
+  TEXTURE_REPEAT,    // the image tiles, e.g. across merged voxel faces
+} TextureWrap;
+
+// How a pixel's texel is picked from the level being sampled.
+typedef enum {
+  TEXTURE_NEAREST = 0, // the texel the coordinate falls in
+  TEXTURE_BILINEAR,    // the four nearest texels, blended by 8-bit weights
+} TextureFilter;
+
+// How a texture's levels are stored. Tiled levels keep each 4x4 block of
+// texels together, so steep or rotated faces touch fewer cache lines than
+// they do walking rows; their size is padded to whole blocks.
+typedef enum {
+  TEXTURE_LINEAR = 0, // rows of w texels
+  TEXTURE_TILED,      // rows of 4x4 blocks, each block row by row
+} TextureLayout;
+
+#define TEXTURE_TILE 4
+#define TEXTURE_MAX_LEVELS 16
+
 typedef struct {
   int w;
   int h;
   u32 *pixels;
+  TextureWrap wrap;
+  TextureFilter filter;
+  TextureLayout layout; // see texture_set_layout
+  // Texels from one row of level 0 to the next; 0 means w. Only textures
+  // that don't own their texels set it: views into a TextureAtlas, and those
+  // of a cooked model, which point into its file (stride w).
+  int stride;
+  // Mip chain from texture_build_mips, 0 without one. Level i is
+  // max(w >> i, 1) x max(h >> i, 1) and levels[0] == pixels.
+  int level_count;
+  u32 *levels[TEXTURE_MAX_LEVELS];
 } Texture;
 
 typedef struct {
@@ -42,8 +76,12 @@ typedef struct {
   v2f uv;
 } VertexUV;
 
+// Screen positions handed to the textured rasterizer are 28.4 fixed point.
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+
 typedef struct {
-  v2i pos;
+  v2i pos; // in 1/SUBPIXEL_ONE pixels; pixel centres sit at +SUBPIXEL_ONE/2
   v2f uv;
   float inv_w;
   float depth;
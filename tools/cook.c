@@ -0,0 +1,107 @@
+// Offline model cooker: loads an OBJ with its MTL and textures through
+// obj_model_load (parsing, image decoding, mip chains, tiling) and writes the
+// result as a cooked model (cooked_model.h). It then loads the cooked file
+// back, checks it against the parsed model and prints both load times.
+//
+//   cook model.obj model.s3dm
+#include "cooked_model.h"
+#include "obj_loader.h"
+#include "render.h"
+#include "types.h"
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static double ms_since(Uint64 start) {
+  return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 /
+         (double)SDL_GetPerformanceFrequency();
+}
+
+static bool same_bytes(const void *a, const void *b, size_t size) {
+  return size == 0 || memcmp(a, b, size) == 0;
+}
+
+static bool same_texture(const Texture *a, const Texture *b) {
+  if (a->w != b->w || a->h != b->h || a->wrap != b->wrap ||
+      a->filter != b->filter || a->layout != b->layout ||
+      a->level_count != b->level_count) {
+    return false;
+  }
+  int levels = a->level_count > 1 ? a->level_count : 1;
+  for (int level = 0; level < levels; level++) {
+    const u32 *ta = level == 0 ? a->pixels : a->levels[level];
+    const u32 *tb = level == 0 ? b->pixels : b->levels[level];
+    if (!same_bytes(ta, tb, texture_level_size(a, level) * sizeof(u32))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool same_model(const ObjModel *a, const ObjModel *b) {
+  const Mesh *ma = &a->mesh, *mb = &b->mesh;
+  if (ma->position_count != mb->position_count ||
+      ma->vertex_count != mb->vertex_count ||
+      ma->index_count != mb->index_count ||
+      ma->group_count != mb->group_count ||
+      a->material_count != b->material_count ||
+      !same_bytes(ma->positions, mb->positions,
+                  (size_t)ma->position_count * sizeof(v3f)) ||
+      !same_bytes(ma->vertices, mb->vertices,
+                  (size_t)ma->vertex_count * sizeof(MeshVertex)) ||
+      !same_bytes(ma->indices, mb->indices,
+                  (size_t)ma->index_count * sizeof(u32)) ||
+      !same_bytes(ma->groups, mb->groups,
+                  (size_t)ma->group_count * sizeof(MeshGroup))) {
+    return false;
+  }
+  for (int i = 0; i < a->material_count; i++) {
+    const ObjMaterial *ka = &a->materials[i], *kb = &b->materials[i];
+    if (strcmp(ka->name, kb->name) != 0 ||
+        ka->has_diffuse != kb->has_diffuse ||
+        (ka->has_diffuse && !same_texture(&ka->diffuse, &kb->diffuse))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s model.obj model.s3dm\n", argv[0]);
+    return 2;
+  }
+  IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG | IMG_INIT_WEBP);
+
+  ObjModel parsed = {0}, cooked = {0};
+  Uint64 start = SDL_GetPerformanceCounter();
+  if (!obj_model_load(argv[1], &parsed)) {
+    fprintf(stderr, "could not load %s\n", argv[1]);
+    return 1;
+  }
+  double parse_ms = ms_since(start);
+  if (!cooked_model_write(&parsed, argv[2])) {
+    fprintf(stderr, "could not write %s\n", argv[2]);
+    obj_model_free(&parsed);
+    return 1;
+  }
+
+  start = SDL_GetPerformanceCounter();
+  bool loaded = cooked_model_load(argv[2], &cooked);
+  double cooked_ms = ms_since(start);
+  bool ok = loaded && same_model(&parsed, &cooked);
+  printf("%s: %d positions, %d vertices, %d triangles, %d materials, "
+         "%.1f MB\n",
+         argv[2], parsed.mesh.position_count, parsed.mesh.vertex_count,
+         parsed.mesh.index_count / 3, parsed.material_count,
+         (double)cooked.file_size / (1024.0 * 1024.0));
+  printf("obj load:    %9.2f ms\ncooked load: %9.2f ms%s\n", parse_ms,
+         cooked_ms, ok ? "" : " (MISMATCH)");
+
+  obj_model_free(&cooked);
+  obj_model_free(&parsed);
+  IMG_Quit();
+  return ok ? 0 : 1;
+}